@@ -0,0 +1,35 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOOM_BLOCK_WORDS 8         // One 64-byte cache line per block
+#define BLOOM_MAX_PROBES 7          // Bits set per key; each probe takes 9 bits of the key hash
+
+// Cache line blocked Bloom filter over 64-bit key hashes. Every key maps to one block and sets
+// num_probes bits inside it, so a lookup costs one cache miss whatever the probe count.
+// There are no false negatives; false positives happen at roughly the rate the filter was sized for.
+typedef struct {
+    uint64_t *words;                // num_blocks * BLOOM_BLOCK_WORDS words, cache line aligned.
+    size_t num_blocks;
+    int num_probes;
+} bloom_filter;
+
+//sizes the filter for expected_keys at the false positive rate fpr (0 < fpr < 1). when max_bytes is
+//non zero the filter is capped at that size and the rate rises instead. returns 0 on success
+int bloom_init(bloom_filter *filter, size_t expected_keys, double fpr, size_t max_bytes);
+
+//adds the key with this hash
+void bloom_add(bloom_filter *filter, unsigned long long hash);
+
+//returns 0 if the key was never added, 1 if it probably was
+int bloom_may_contain(const bloom_filter *filter, unsigned long long hash);
+
+//returns the bytes held by the filter
+size_t bloom_memory_usage(const bloom_filter *filter);
+
+//releases the bit array
+void bloom_free(bloom_filter *filter);
+
+#endif
@@ -1,8 +1,18 @@
 #ifndef BTREE_H
 #define BTREE_H
 
-#define MAX_KEYS 200
+#define MAX_KEY_LEN 200                   // Width of one key slot (longest n-gram plus its NUL).
+#define BTREE_NODE_BYTES 16384            // Every node occupies exactly 4 pages, page aligned.
+#define MAX_KEYS 72                       // Largest multiple of 8 whose node still fits in BTREE_NODE_BYTES.
 #define MAX_LINE_LENGTH 300
+#define BTREE_BLOCK_BYTES 4096            // One front coded block of a packed table.
+#define BTREE_RESTART_INTERVAL 16         // Every 16th key of a block is stored whole.
+#define BTREE_KEY_LEN_BUCKETS 6           // Key length histogram: [0,8) [8,16) [16,32) [32,64) [64,128) [128,MAX_KEY_LEN).
+
+#define BTREE_CHECK_UNSORTED 1            // Keys are not strictly increasing in walk order.
+#define BTREE_CHECK_SEPARATOR 2           // A separator (or a block index entry) disagrees with the keys below it.
+#define BTREE_CHECK_COUNT 4               // A count is zero or negative (an int overflow wraps negative).
+#define BTREE_CHECK_SHAPE 8               // Leaves at different depths, malformed block header or key total mismatch.
 
 // The B+ Tree implementation is a LEFT-BIASED B+ TREE.
 // This means that when splitting nodes, keys are retained in the left node as much as possible.
@@ -16,21 +26,74 @@ typedef struct {
 
 // Structure for a B+ Tree node.
 // Internal nodes are used for navigation, and leaf nodes store the actual data (n-grams and their counts).
+// Fields are ordered hot to cold: a search only reads the header, keyPrefix and children (the first
+// page) and touches the wide keys array once the prefixes tie.
 typedef struct BTreeNode {
     int isLeaf;                           // Flag to indicate if the node is a leaf (1) or internal (0).
     int numKeys;                          // Current number of keys in the node.
-    char keys[MAX_KEYS][200];             // Array of keys stored in the node.
+    struct BTreeNode *next;               // Pointer to the next leaf node (used for leaf node chaining).
+    unsigned long long keyPrefix[MAX_KEYS];// First 8 bytes of every key, big-endian: integer order == strcmp order.
     int counts[MAX_KEYS];                 // Array of counts (used only in leaf nodes).
     struct BTreeNode *children[MAX_KEYS + 1];// Array of pointers to child nodes (internal nodes only).
-    struct BTreeNode *next;               // Pointer to the next leaf node (used for leaf node chaining).
+    char keys[MAX_KEYS][MAX_KEY_LEN];     // Array of keys stored in the node.
 } BTreeNode;
 
+_Static_assert(sizeof(BTreeNode) <= BTREE_NODE_BYTES, "BTreeNode must fit in BTREE_NODE_BYTES");
+
+// One entry of a bulk update: the n-gram and the amount to add to its count (negative to decay).
+typedef struct {
+    const char *ngram;
+    long long delta;
+} ngram_delta;
+
+// Read-only form of a table built by packBPlusTree: every key in order, front coded into fixed-size blocks.
+// A block is [numKeys:u16][numRestarts:u16][restart offsets:u16 ...] followed by its entries, each
+// [shared:u8][suffix length:u8][count:varint][suffix bytes], where shared is the number of leading bytes
+// the key has in common with the previous one. Restart entries (the first of every
+// BTREE_RESTART_INTERVAL keys) share nothing, so a lookup binary searches them and decodes at most
+// BTREE_RESTART_INTERVAL entries.
+typedef struct {
+    unsigned char *blocks;                // numBlocks * BTREE_BLOCK_BYTES, page aligned.
+    unsigned long long *firstPrefix;      // Packed prefix of every block's first key: the block index.
+    long numBlocks;
+    long long numKeys;
+} BTreePacked;
+
 // Structure for the B+ Tree itself.
 typedef struct BPlusTree {
-    BTreeNode *root;                      // Pointer to the root node of the tree.
+    BTreeNode *root;                      // Pointer to the root node of the tree (NULL while packed).
     long long int totalNgramsCount;       // Total count of n-grams stored in the tree.
+    BTreeNode *arena;                     // Contiguous node region built by compactBPlusTree (NULL if none).
+    long long arenaNodes;                 // Number of nodes in the arena.
+    BTreePacked *packed;                  // Set while the table is packed; the first update unpacks it.
 } BPlusTree;
 
+// Shape and health of one table, gathered by statBPlusTree.
+typedef struct {
+    long long keys;
+    long long totalCount;                 // Sum of the counts.
+    int maxCount;
+    int height;                           // Node levels including the leaves; 0 for a packed table.
+    long long nodes;                      // Nodes, or blocks of a packed table.
+    double fill;                          // Average node occupancy (keys / MAX_KEYS) or block occupancy (bytes / BTREE_BLOCK_BYTES).
+    long long bytes;                      // bPlusTreeMemoryUsage.
+    long long keyLengths[BTREE_KEY_LEN_BUCKETS];
+    unsigned int violations;              // BTREE_CHECK_* bits of the invariants that failed.
+} BTreeStats;
+
+// Walks the keys of a tree in order, whichever form it is in.
+typedef struct {
+    const BPlusTree *tree;
+    const BTreeNode *leaf;                // Node form: current leaf and slot.
+    int index;
+    long block;                           // Packed form: current block, next entry and entries left in it.
+    const unsigned char *pos;
+    int left;
+    int length;                           // Length of key.
+    char key[MAX_KEY_LEN];                // Current n-gram.
+    int count;                            // Its count.
+} BTreeCursor;
+
 // Initializes the priority queue used for storing n-grams.
 void init_bt_pq(bt_priority_q *bt_q);
 
@@ -61,12 +124,26 @@ BTreeNode* splitLeaf(BTreeNode* leaf, const char* word, int count);
 // Splits a full internal node into two internal nodes and handles key redistribution. Promotes the middle key to the parent node.
 BTreeNode* splitInternal(BTreeNode* node, int* promotedIndex);
 
-// Recursive helper function for inserting n-grams into the B+ Tree. Manages splits at both leaf and internal node levels.
-BTreeNode* insertRecursive(BTreeNode* root, const char* ngram, int count, char* promotedKey, int* promotedCount, BTreeNode** newChild);
+// Recursive helper function for inserting n-grams into the B+ Tree. Manages splits at both leaf and internal node levels:
+// a full node is split around the new key and the first key of the right half is promoted through promotedKey.
+BTreeNode* insertRecursive(BTreeNode* root, const char* ngram, int count, char* promotedKey, BTreeNode** newChild);
 
 // Inserts a new n-gram into the B+ Tree. Handles root splits and ensures tree properties are maintained.
 void insertBPlusTree(BPlusTree* tree, const char* ngram, int count);
 
+// Lowers the count of an n-gram by amount; the n-gram is removed once its count reaches zero.
+// Underfull nodes are merged with or refilled from a sibling. Returns the remaining count (0 if removed or absent).
+int decrementNGram(BPlusTree* tree, const char* ngram, int amount);
+
+// Removes an n-gram whatever its count. Returns the count it had (0 if it was not stored).
+int deleteNGram(BPlusTree* tree, const char* ngram);
+
+// Applies a batch of count changes (sorted in place by key) with a single walk along the leaf chain
+// instead of one descent per key. Deltas of the same n-gram are summed first. Counts that drop to
+// zero or below are removed and the tree is rebalanced once at the end; n-grams not yet stored are
+// inserted when their delta is positive. Returns the number of n-grams changed, or -1 if memory ran out.
+long applyNGramDeltas(BPlusTree* tree, ngram_delta* deltas, int numDeltas);
+
 // Reads n-grams from a CSV file and inserts them into the B+ Tree.
 void readCSVAndInsert(BPlusTree* tree, const char* filename);
 
@@ -76,6 +153,51 @@ void listAllNgrams(BPlusTree* tree);
 // Searches for n-grams in the B+ Tree based on a given prefix. Results are stored in a priority queue.
 void searchNGrams(BPlusTree* tree, const char* firstWord, const char* secondWord, bt_priority_q *result);
 
+// Generic search for any order: collects the n-grams whose leading words equal the context array.
+// Stops walking the leaf chain as soon as the keys move past the context prefix.
+void searchNGramsContext(BPlusTree* tree, const char* context[], int contextLen, bt_priority_q *result);
+
+// Like searchNGramsContext, restricted to n-grams whose word after the context starts with wordPrefix
+// (an empty prefix matches every continuation). The matches are one contiguous key range, read with
+// one seek and one scan that stops at the first key past the prefix.
+void searchNGramsCompletion(BPlusTree* tree, const char* context[], int contextLen, const char* wordPrefix, bt_priority_q *result);
+
+// Returns the count stored for one exact n-gram, or 0 if the n-gram is not in the tree.
+int searchExactNGram(BPlusTree* tree, const char* ngram);
+
+// Returns the number of bytes held by the tree's nodes (or blocks, when packed).
+long long bPlusTreeMemoryUsage(const BPlusTree* tree);
+
+// Moves every node into one contiguous, page aligned region: internal nodes in breadth-first order
+// followed by the leaves in key order, so a descent walks forward and a leaf scan is sequential.
+// Call it once a table is fully loaded; later inserts still work (new nodes live outside the arena).
+// Returns 0 on success, -1 if the region could not be allocated (the tree is left as it was).
+int compactBPlusTree(BPlusTree* tree);
+
+// Re-encodes the table into its packed read-only form (see BTreePacked) and frees the nodes. Lookups
+// and cursors work on it directly; insert, decrement, delete and applyNGramDeltas unpack it first.
+// Returns 0 on success, -1 if memory ran out (the tree is left as it was).
+int packBPlusTree(BPlusTree* tree);
+
+// Rebuilds the node form of a packed table. Returns 0 on success (or if it was not packed), -1 if memory ran out.
+int unpackBPlusTree(BPlusTree* tree);
+
+// Positions the cursor on the smallest key of the tree. Returns 1 if there is one, 0 if the tree is empty.
+int bPlusTreeFirst(const BPlusTree* tree, BTreeCursor* cursor);
+
+// Positions the cursor on the first key >= key. Returns 1 if there is one, 0 if every key is smaller.
+int bPlusTreeSeek(const BPlusTree* tree, const char* key, BTreeCursor* cursor);
+
+// Moves the cursor to the next key. Returns 1 if there is one, 0 past the last key.
+int bPlusTreeNext(BTreeCursor* cursor);
+
+// Fills stats with one pass over the tree and checks its invariants: keys sorted, separators (or the
+// block index) consistent with the keys below them, positive counts, balanced leaves / well formed blocks.
+void statBPlusTree(const BPlusTree* tree, BTreeStats* stats);
+
+// Frees all nodes of the B+ Tree along with the tree structure itself.
+void freeBPlusTree(BPlusTree* tree);
+
 
 //function to display the result along with the corrected string
 void display_unique_bt_q(bt_priority_q *bt_q, char *corrected_string);
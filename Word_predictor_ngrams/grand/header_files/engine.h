@@ -0,0 +1,178 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+#include "ngram.h"
+#include "ranking.h"
+#include "spell_cache.h"
+#include "shard.h"
+#include "numa.h"
+#include "model_store.h"
+
+// Embeddable prediction engine: open a model once, then predict and correct through the handle.
+// Nothing here prints or reads stdin; errors are reported through return values only.
+// wp_predict, wp_complete and wp_correct may be called from several threads on the same engine; each
+// call reads one model generation from start to end, even while wp_reload publishes the next one.
+
+#define WP_MAX_SUGGESTIONS 3                        // The n-gram search keeps the top 3 continuations
+#define WP_MAX_CONTEXT_WORDS (MAX_NGRAM_ORDER - 1)
+
+// Where the read-only model lives on a multi-socket machine.
+typedef enum {
+    WP_NUMA_OFF,                                    // Wherever the loading thread's allocations landed.
+    WP_NUMA_REPLICATE,                              // One model and spell cache per node; threads read their node's copy.
+    WP_NUMA_INTERLEAVE                              // One model spread page by page over every node.
+} wp_numa_mode;
+
+typedef struct {
+    ngram_source source;                            // Model files / snapshot and load-time pruning.
+    int cache_capacity;                             // Spell cache entries (0 disables the cache).
+    int noisy_channel;                              // Rank fuzzy corrections with the noisy channel model.
+    int num_shards;                                 // > 0: route n-gram lookups to shard processes...
+    const char *shards[SHARD_MAX];                  // ...listening on these sockets (shards[i] serves partition i).
+    wp_numa_mode numa;                              // Model placement (no effect on single node machines).
+    int learn_interval_ms;                          // > 0: wp_learn is on and its counts are merged this often (0: off).
+} wp_options;
+
+typedef struct {
+    char ngram[MAX_NGRAM_LEN];                      // Matching n-gram: the context words plus the prediction.
+    char word[MAX_TOKEN_LEN];                       // The predicted next word (last word of the n-gram).
+    int count;                                      // Corpus count of the n-gram.
+    int order;                                      // Order of the table that produced it.
+} wp_suggestion;
+
+// How the input was read: the corrected context words the prediction was conditioned on.
+typedef struct {
+    int num_words;                                  // Context words found (at most order - 1).
+    char words[WP_MAX_CONTEXT_WORDS][MAX_TOKEN_LEN];// Corrected context words, oldest first.
+    int offset;                                     // Byte offset of the first context word in the input.
+    int order;                                      // Order that produced the suggestions (0: none).
+    char prefix[MAX_TOKEN_LEN];                     // Partly typed last word (wp_complete only, else empty).
+} wp_context;
+
+// Copy of the read-only state built on one NUMA node (WP_NUMA_REPLICATE).
+typedef struct {
+    ngram_model *model;
+    spell_cache cache;
+    int has_cache;
+} wp_replica;
+
+typedef struct {
+    model_store store;                              // Published model generations; every call reads the current one.
+    ngram_source source;                            // What wp_reload loads (the paths stay the caller's).
+    int learning;                                   // wp_learn may queue counts (learn interval set, no replicas or shards).
+    spell_cache cache;
+    int has_cache;
+    shard_router *router;                           // Set when the n-gram tables live in shard processes.
+    wp_numa_mode numa_mode;
+    numa_topology numa;
+    int home_node;                                  // Node the fields above were allocated on.
+    wp_replica *replicas[NUMA_MAX_NODES];           // Copies for the other nodes (NULL for home_node).
+} wp_engine;
+
+#define WP_SESSION_SKIP_LIMIT 64                    // Keys a range walks forward before a fresh seek is cheaper
+
+// Where a session's range of one order stands.
+typedef enum {
+    WP_RANGE_UNSET,                                 // Not positioned yet: the next search seeks.
+    WP_RANGE_SET,                                   // The cursor holds the first key >= the last search key.
+    WP_RANGE_END,                                   // Every key of the table is smaller.
+    WP_RANGE_ABSENT                                 // The context filter ruled this order out.
+} wp_range_state;
+
+// Keystroke state for one input that is retyped on every key press (see wp_session_complete). Not
+// thread safe: one session per client.
+typedef struct {
+    wp_engine *engine;
+    ngram_model *model;                             // Model read by the last full pass (the thread's replica).
+    unsigned long long generation;                  // Its generation: a freed model's address can come back.
+    char *text;                                     // Input of the last call.
+    size_t len, cap;
+    wp_context ctx;                                 // Its corrected context words and partial word.
+    int growable;                                   // Typed letters extend the partial word in place.
+    trie_node *node;                                // Trie node of the partial word (NULL: no word starts with it).
+    BTreeCursor range[MAX_NGRAM_ORDER + 1];         // Per order: first key >= "context partial".
+    wp_range_state range_state[MAX_NGRAM_ORDER + 1];
+    long long reuses;                               // Calls answered from the kept state.
+    long long rebuilds;                             // Calls that tokenized and corrected the input again.
+} wp_session;
+
+//fills opts with the shipped trigram datasets, context filters at NGRAM_FILTER_FPR, a 4096 entry cache
+//and noisy channel ranking
+void wp_default_options(wp_options *opts);
+
+//loads the model described by opts; returns NULL on failure. with shards, only the unigrams are
+//loaded here and every n-gram lookup goes to the shard processes. the paths in opts->source must
+//stay valid while the engine is open: wp_reload reads them again
+wp_engine *wp_open(const wp_options *opts);
+
+//takes ownership of an already built model (for example a pruned one); returns NULL on failure.
+//WP_NUMA_INTERLEAVE replaces it with an interleaved copy, so use wp_current_model afterwards.
+//wp_reload loads opts->source, not the model given here
+wp_engine *wp_open_model(ngram_model *model, const wp_options *opts);
+
+//the generation new calls read, for single threaded callers that neither reload nor learn while they
+//use it (a published generation frees the one before it)
+ngram_model *wp_current_model(wp_engine *engine);
+
+//loads the engine's source again on a background thread and publishes it: calls keep answering from
+//the old generation until then and the old one is freed once its last reader leaves. a source that
+//fails to load leaves the old generation live. interleaved placement is not applied to the new
+//generation. returns 0 if the reload started, -1 if one is already running, the engine has NUMA
+//replicas (fixed copies of the first generation) or the thread could not be started
+int wp_reload(wp_engine *engine);
+
+//waits for the reload started by wp_reload; returns 0 if its generation was published
+int wp_reload_wait(wp_engine *engine);
+
+//learns from user text: every n-gram of each run of words (orders 1..model order; numbers and
+//hashtags end a run) gets +1. words are taken as typed (lowercased), so new words join the
+//vocabulary and are no longer corrected once merged. the counts reach predictions at the next
+//merge: every opts->learn_interval_ms in the background, or on wp_merge. a reload replaces what
+//was merged. returns the number of words learned, or -1 on error, when learning is off
+//(learn_interval_ms 0) or the engine has NUMA replicas or shards (their copies could not follow)
+int wp_learn(wp_engine *engine, const char *text);
+
+//merges every count wp_learn queued into a new generation now; returns the number of n-grams
+//merged, or -1 on error
+long wp_merge(wp_engine *engine);
+
+//predicts up to k next words for text, whose last (order - 1) words are the context (spell corrected
+//first). suggestions are unique and sorted by count. ctx (may be NULL) receives the corrected context.
+//returns the number of suggestions written to out, or -1 on error
+int wp_predict(wp_engine *engine, const char *text, wp_suggestion out[], int k, wp_context *ctx);
+
+//completes the word being typed: when text does not end in a delimiter its last word is taken as a
+//prefix (as typed) and the words before it as context, and only continuations starting with the prefix
+//are returned. backs off like wp_predict, then to the most frequent vocabulary words with the prefix
+//(order 1). text ending in a delimiter predicts the next word exactly like wp_predict
+int wp_complete(wp_engine *engine, const char *text, wp_suggestion out[], int k, wp_context *ctx);
+
+//spell corrects text[0..len) and writes the tokens, each followed by a space, into out.
+//returns the length of the full result (like snprintf: >= cap means it was truncated), or -1 on error
+int wp_correct(wp_engine *engine, const char *text, size_t len, char *out, size_t cap);
+
+//parses a placement name ("off", "replicate" or "interleave") into mode; returns 0 on success
+int wp_parse_numa_mode(const char *name, wp_numa_mode *mode);
+
+//pins the calling thread to one NUMA node, spreading threads round robin by index, so it reads that
+//node's replica. returns the node, or -1 when the engine has a single node or placement is off
+int wp_pin_thread(wp_engine *engine, int index);
+
+//starts an empty session on engine
+void wp_session_init(wp_session *session, wp_engine *engine);
+
+//same results as wp_complete(text), but when text is the previous input plus typed letters the
+//tokenized and corrected context is kept, the partial word advances one trie step per letter and each
+//order's range cursor only moves forward from where it stood. any other edit, or a new generation
+//published since the last call, reads the input again.
+//returns the number of suggestions written to out, or -1 on error
+int wp_session_complete(wp_session *session, const char *text, wp_suggestion out[], int k, wp_context *ctx);
+
+//frees the session's buffers (the engine stays open)
+void wp_session_free(wp_session *session);
+
+//waits for a running reload, then frees the engine and its model
+void wp_close(wp_engine *engine);
+
+#endif
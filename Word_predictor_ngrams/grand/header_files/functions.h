@@ -2,12 +2,15 @@
 #define FUNCTIONS_H
 
 #include <stdbool.h>
+#include "tokenizer.h"
 
 #define MAX_WORDS 3
 #define MAX_EDIT_DISTANCE 0.3
 #define MAX_TOKEN_LEN 100
 #define DELIMS " .,/?;:{}[]~`!|$%&*()_-+=^\'\"\t\n"
 
+struct ranking_vocab;               // Defined in ranking.h
+
 //structure for trie node
 typedef struct trie_node {
     struct trie_node *children[26]; 
@@ -19,6 +22,8 @@ typedef struct trie_node {
 typedef struct trie{
     trie_node * root;
     long long int total_unigram_count;
+    unsigned long long serial;          // Unique per init_trie: spell cache decisions made on another trie miss
+    struct ranking_vocab * vocab;       // Noisy channel copy of the words (NULL: none), see attach_ranking_vocab
 }trie;
 
 
@@ -55,9 +60,17 @@ void init_trie(trie * T);
 //helper function for get a trie node
 trie_node * get_node();
 
+//functions to release the memory held by the trie
+void free_trie_node(trie_node * p);
+void free_trie(trie * T);
+
 //function to insert a unigram into trie
 void insert_word(trie * T, const char * word, int count);
 
+//function to lower the count of a unigram; the word is removed once its count reaches zero.
+//returns the remaining count (0 if removed or absent)
+int decrement_word(trie * T, const char * word, int amount);
+
 //file handling function : extracts the word and
 //their counts from the file and inserts in the trie
 void process_csv_file(const char *filename, trie *T);
@@ -84,6 +97,9 @@ int min3(int a, int b, int c);
 //function to calculate the edit distance for the Levenshtein algorithm 
 float edit_distance(const char* word1, const char* word2);
 
+//matrix based Levenshtein ratio that edit_distance used before the bit-parallel kernel (reference only)
+float edit_distance_reference(const char* word1, const char* word2);
+
 //IS THIS FUNCTION EVEN USED ANYWHERE
 void sort_by_edits(priority_Q *pq);
 
@@ -132,7 +148,15 @@ void tokenize_user_string(char *user_string, stack *s);
 //the predicted phrase would be concatenated to the string returned by this function 
 char* word_processor(stack *s1, stack *s2, trie *T);
 
-//
+//spell checks one token with the unigram -> prefix -> fuzzy cascade; returns the best candidate
+//(stored in pq) or the token itself when nothing matched
+const char *correct_word(trie *T, const char *token, priority_Q *pq);
+
+//span based version of word_processor : corrects the word spans of the (already lowercased) input
+//and joins all tokens with spaces. decisions go through the spell cache when one is given (may be NULL).
+//the caller frees the returned string
+struct spell_cache;
+char *correct_spans(trie *T, struct spell_cache *cache, const char *input, const token_span *spans, int num_spans);
 
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef LEVENSHTEIN_H
+#define LEVENSHTEIN_H
+
+// Bit-parallel Levenshtein kernels (Myers 1999 / Hyyro 2003).
+// One 64-bit word holds a whole column of the DP matrix for patterns up to 64 bytes;
+// longer patterns use the blocked variant that chains several words.
+
+#define LEVENSHTEIN_WORD_BITS 64
+#define LEVENSHTEIN_STACK_BLOCKS 2      // Patterns up to 128 bytes (any token) are scored without malloc
+
+//raw edit distance (insertions, deletions and substitutions all cost 1). if a pattern longer than
+//LEVENSHTEIN_STACK_BLOCKS words cannot get memory, returns len_a + len_b, which no real distance reaches
+int levenshtein_distance(const char *a, int len_a, const char *b, int len_b);
+
+//normalized ratio with the same semantics as edit_distance : raw distance / average length
+float levenshtein_ratio(const char *a, const char *b);
+
+//scores one query against many candidates: out[i] = levenshtein_ratio(query, candidates[i]).
+//queries up to 64 bytes run four candidates at a time in AVX2 lanes when the CPU supports it
+void levenshtein_ratio_batch(const char *query, const char *const candidates[], int num_candidates, float out[]);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Leveled logger. Messages above WP_LOG_MAX_LEVEL are removed at compile time (arguments
+// are not even evaluated); the rest are filtered at run time against log_level.
+
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3
+
+#ifndef WP_LOG_MAX_LEVEL
+#define WP_LOG_MAX_LEVEL LOG_LEVEL_INFO     // Release builds: LOG_DEBUG costs nothing
+#endif
+
+extern int log_level;                       // Run time threshold (default LOG_LEVEL_WARN)
+
+//writes "[LEVEL] message\n" to stderr
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_AT(level, ...) do { \
+    if ((level) <= WP_LOG_MAX_LEVEL && (level) <= log_level) log_write((level), __VA_ARGS__); \
+} while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif
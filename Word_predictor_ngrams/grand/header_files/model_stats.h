@@ -0,0 +1,31 @@
+#ifndef MODEL_STATS_H
+#define MODEL_STATS_H
+
+#include "ngram.h"
+
+#define STATS_CHECK_UNIGRAM_COUNT 16    // A unigram count is zero or negative (next to the BTREE_CHECK_* bits)
+
+// Health report of a whole model. save_ngram_snapshot stores it in the snapshot header, so a snapshot
+// can be checked with read_snapshot_stats before it is promoted, without loading a single table.
+typedef struct {
+    int order;
+    long long vocabulary;                       // Words in the unigram trie.
+    long long unigram_total;                    // Sum of their counts.
+    long long trie_nodes;
+    long long trie_bytes;
+    BTreeStats tables[MAX_NGRAM_ORDER + 1];     // tables[n] describes the n-gram table of order n (n >= 2).
+    long long filter_bytes;                     // Context filters (see set_ngram_filter).
+    unsigned int violations;                    // Every failed check: BTREE_CHECK_* of any table, STATS_CHECK_*.
+} ngram_stats;
+
+//gathers the statistics of the model with one pass over the trie and every table
+void compute_ngram_stats(const ngram_model *model, ngram_stats *stats);
+
+//reads the statistics stored in a snapshot header without reading the rest of the file.
+//returns 0 on success, -1 if the file is not a snapshot or predates stored statistics
+int read_snapshot_stats(const char *filename, ngram_stats *stats);
+
+//prints the statistics in a human readable form
+void display_ngram_stats(const ngram_stats *stats);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MODEL_STORE_H
+#define MODEL_STORE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ngram.h"
+
+#define MAX_READER_SLOTS 256        // Maximum number of threads that can read the store (each keeps its slot)
+#define READER_SLOT_BYTES 64        // One cache line per slot, so readers never write a line another reader writes
+#define DELTA_TABLE_SIZE 4096       // Buckets of the pending delta hash table
+
+// The store publishes immutable model generations with epoch based reclamation (a userspace RCU):
+//  - readers announce the epoch they entered in their own slot, then load the current model pointer.
+//    They never take a lock and keep a consistent generation until they release it. A thread claims
+//    its slot once (model_store_thread_slot) and keeps it, so entering only writes its own cache line.
+//  - writers build a new generation off to the side, swap the pointer, advance the epoch and wait
+//    until no reader still announces an older epoch before freeing the previous generation.
+
+struct reader_binding;
+
+// One reader slot, alone on its cache line.
+typedef struct {
+    _Alignas(READER_SLOT_BYTES) atomic_ullong epoch;            // Epoch the reader entered, 0 when idle.
+    atomic_int used;                                            // Slot ownership for reader registration.
+    struct reader_binding *binding;                             // Thread keeping the slot (NULL: none or explicit).
+} model_store_reader;
+
+// One pending count update collected from live traffic.
+typedef struct delta_entry {
+    char ngram[MAX_NGRAM_LEN];
+    int order;
+    long long delta;
+    struct delta_entry *next;
+} delta_entry;
+
+typedef struct {
+    _Atomic(ngram_model *) current;                             // Generation new readers will see.
+    atomic_int order;                                           // Order of the current generation (readable without a slot).
+    atomic_ullong epoch;                                        // Global epoch, advanced on every publish.
+    model_store_reader *readers;                                // MAX_READER_SLOTS slots, cache line aligned.
+
+    pthread_mutex_t writer_lock;                                // Serialises merges and publishes.
+    pthread_mutex_t delta_lock;                                 // Protects the delta table.
+    delta_entry *deltas[DELTA_TABLE_SIZE];                      // Pending updates, keyed by n-gram.
+    long pending_deltas;                                        // Number of distinct n-grams pending.
+
+    unsigned long long published;                               // Generations published so far (writer lock).
+
+    pthread_mutex_t reload_lock;                                // Protects reload_status, signals reload_done.
+    pthread_cond_t reload_done;                                 // Broadcast by the loader thread when it finishes.
+    atomic_int reload_running;                                  // A loader thread is working (it clears this itself).
+    int reload_status;                                          // 0 if the last reload published, -1 if it failed.
+
+    pthread_t merger;                                           // Background merge thread.
+    atomic_int merger_running;
+    int merge_interval_ms;
+} model_store;
+
+//initialises the store with its first generation (the store takes ownership of the heap allocated model).
+//every published generation gets the next number in its generation field, starting at 1
+int model_store_init(model_store *store, ngram_model *initial);
+
+//claims a reader slot for the calling thread; returns the slot or -1 if all slots are taken
+int model_store_register_reader(model_store *store);
+
+//returns the calling thread's own reader slot, claimed on its first call and kept until the thread
+//exits or the store is destroyed, so repeated reads cost no registration. returns -1 if every slot
+//is kept by another thread (more than MAX_READER_SLOTS reader threads)
+int model_store_thread_slot(model_store *store);
+
+//gives a reader slot back
+void model_store_unregister_reader(model_store *store, int slot);
+
+//enters a read-side critical section and returns the current generation. never blocks.
+//the returned model stays valid until model_store_release is called with the same slot, which must
+//not be acquired again before then
+const ngram_model *model_store_acquire(model_store *store, int slot);
+
+//leaves the read-side critical section
+void model_store_release(model_store *store, int slot);
+
+//waits until every reader that could still see a previous generation has released it
+void model_store_synchronize(model_store *store);
+
+//publishes a new generation (store takes ownership) and frees the old one after a grace period. the
+//new trie gets a ranking vocabulary when the current one has one
+void model_store_publish(model_store *store, ngram_model *next);
+
+//queues a count delta for one n-gram (the order is taken from the number of words). negative deltas
+//decay the count and remove the n-gram once it reaches zero (privacy deletions, aging).
+//returns 0 on success, -1 if the n-gram is invalid or memory ran out
+int model_store_add_delta(model_store *store, const char *ngram, long long delta);
+
+//queues +1 deltas for every n-gram (orders 1..model order) found in a sequence of words
+void model_store_learn_words(model_store *store, const char *words[], int num_words);
+
+//builds a new generation from the current one plus every pending delta and publishes it. only the
+//orders with pending deltas are copied (then packed and filtered again); the other tables and the
+//trie are shared with the previous generation. returns the number of deltas merged, or -1 if memory
+//ran out (the deltas stay pending)
+long model_store_merge(model_store *store);
+
+//starts a background thread that merges pending deltas every interval_ms milliseconds
+int model_store_start_merger(model_store *store, int interval_ms);
+
+//stops the background merge thread (pending deltas are merged one last time)
+void model_store_stop_merger(model_store *store);
+
+//loads a new generation from the source on a background thread and publishes it atomically.
+//queries keep running on the old generation, which is freed once its last reader leaves. if the
+//current generation's trie has a ranking vocabulary, the new one gets one too. a load that fails
+//publishes nothing. returns -1 if a reload is already in progress or the thread could not be started
+int model_store_reload_async(model_store *store, const ngram_source *source);
+
+//waits for the background reload to finish (returns at once when none is running); returns 0 if the
+//last reload published its generation
+int model_store_reload_wait(model_store *store);
+
+//stops the merger, frees the current generation and every pending delta. threads that kept a slot
+//with model_store_thread_slot give it up here
+void model_store_destroy(model_store *store);
+
+#endif
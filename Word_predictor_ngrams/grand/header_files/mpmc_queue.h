@@ -0,0 +1,38 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define MPMC_CACHE_LINE 64
+
+// Bounded lock-free multi-producer multi-consumer queue of pointers (Vyukov's array queue).
+// Every cell carries a sequence number that tells producers and consumers whose turn it is, so a
+// push or pop is one CAS on a position counter plus one release store; nobody ever blocks.
+
+typedef struct {
+    atomic_size_t sequence;
+    void *data;
+} mpmc_cell;
+
+typedef struct {
+    mpmc_cell *cells;
+    size_t mask;                                                    // Capacity - 1 (capacity is a power of two).
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t enqueue_pos;            // Producers and consumers on separate lines.
+    _Alignas(MPMC_CACHE_LINE) atomic_size_t dequeue_pos;
+    char pad[MPMC_CACHE_LINE - sizeof(atomic_size_t)];
+} mpmc_queue;
+
+//creates a queue holding at least capacity pointers (rounded up to a power of two); returns 0 on success
+int mpmc_init(mpmc_queue *q, size_t capacity);
+
+//appends item; returns 0 on success, -1 if the queue is full
+int mpmc_push(mpmc_queue *q, void *item);
+
+//removes the oldest item into *item; returns 0 on success, -1 if the queue is empty
+int mpmc_pop(mpmc_queue *q, void **item);
+
+//frees the cells (items still queued are not touched)
+void mpmc_destroy(mpmc_queue *q);
+
+#endif
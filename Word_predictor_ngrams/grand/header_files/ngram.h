@@ -0,0 +1,138 @@
+#ifndef NGRAM_H
+#define NGRAM_H
+
+#include <stddef.h>
+#include "btree.h"
+#include "bloom.h"
+#include "functions.h"
+
+#define MAX_NGRAM_ORDER 5
+#define MAX_NGRAM_LEN 200           // Matches the width of a B+ Tree key
+#define NGRAM_SNAPSHOT_MAGIC "WPNG"
+#define NGRAM_SNAPSHOT_VERSION 2   // 2 added the stats block; version 1 files still load
+#define NGRAM_SHARD_NONE -1         // Shard index that owns no n-gram
+#define NGRAM_FILTER_FPR 0.01       // Default false positive rate of the context filters
+
+// An n-gram language model of any order up to MAX_NGRAM_ORDER.
+// Unigrams live in the trie (they double as the spelling dictionary),
+// every higher order has its own B+ Tree keyed by the space separated n-gram.
+typedef struct {
+    int order;                                  // Highest order the model was built for (1..MAX_NGRAM_ORDER).
+    trie unigrams;                              // Order 1: words and counts.
+    BPlusTree *tables[MAX_NGRAM_ORDER + 1];     // tables[n] stores the n-grams of order n (n >= 2), NULL if not loaded.
+    int min_count[MAX_NGRAM_ORDER + 1];         // Pruning threshold per order: entries below it are dropped at load time.
+    int shard;                                  // Partition of the n-gram tables this model keeps (see ngram_shard_of).
+    int num_shards;                             // Number of partitions; 0 or 1 keeps every n-gram.
+    bloom_filter *filters[MAX_NGRAM_ORDER + 1]; // filters[n] holds the contexts of tables[n] (NULL: no filter).
+    double filter_fpr;                          // Target false positive rate of the filters (0 disables them).
+    size_t filter_max_bytes;                    // Size cap of each filter (0: sized by the rate alone).
+    unsigned long long generation;              // Set when a model_store publishes the model (0: never published).
+    unsigned char shared[MAX_NGRAM_ORDER + 1];  // shared[n]: the order n structures (1: the trie and its vocabulary)
+                                                // belong to another model, so free_ngram_model leaves them alone.
+} ngram_model;
+
+// Where a model generation is built from: a snapshot, or one CSV file per order.
+typedef struct {
+    int order;
+    const char *snapshot;                       // Snapshot path; when set the CSV files are ignored.
+    const char *files[MAX_NGRAM_ORDER + 1];     // files[n] is the CSV of order n (NULL to skip).
+    int min_count[MAX_NGRAM_ORDER + 1];         // Load-time pruning thresholds per order.
+    int shard;                                  // Only load this partition of the n-gram tables...
+    int num_shards;                             // ...out of this many (0 or 1: load everything).
+    double filter_fpr;                          // Context filter false positive rate (0: no filters).
+    size_t filter_max_bytes;                    // Context filter size cap per order (0: no cap).
+} ngram_source;
+
+//initialises an empty model of the given order with all pruning thresholds disabled
+void init_ngram_model(ngram_model *model, int order);
+
+//sets the load-time pruning threshold for one order (entries with count < min_count are skipped)
+void set_ngram_min_count(ngram_model *model, int n, int min_count);
+
+//restricts the n-gram tables (orders >= 2) to one partition: only n-grams whose context hashes to
+//shard are kept while loading. unigrams are always loaded in full (they are the spelling dictionary).
+//NGRAM_SHARD_NONE keeps no n-gram at all (a router only needs the dictionary)
+void set_ngram_shard(ngram_model *model, int shard, int num_shards);
+
+//configures the per-order context filters built by compact_ngram_model: each is sized for the false
+//positive rate fpr and capped at max_bytes (0: no cap). fpr 0 disables the filters
+void set_ngram_filter(ngram_model *model, double fpr, size_t max_bytes);
+
+//returns 0 when the table of order n certainly has no n-gram continuing the (n - 1) context words,
+//1 when it may have one (always 1 for an order without a filter)
+int ngram_context_may_exist(const ngram_model *model, int n, const char *context[]);
+
+//returns the bytes held by the context filters
+size_t ngram_filter_memory_usage(const ngram_model *model);
+
+//returns the partition an n-gram of order >= 2 belongs to. n-grams are partitioned by their context
+//(every word but the last), so all continuations of a context live in the same shard
+int ngram_shard_of(const char *ngram, int num_shards);
+
+//returns the partition that holds the continuations of a context given as its space separated words
+int ngram_context_shard(const char *context_key, int num_shards);
+
+//helper function : counts the space separated words of an n-gram key
+int ngram_word_count(const char *ngram);
+
+//reads "w1 ... wn,count" rows from a CSV file into the table of order n.
+//rows with the wrong number of words or below the pruning threshold are skipped.
+//returns the number of rows kept, or -1 if the file could not be opened
+long load_ngram_table(ngram_model *model, int n, const char *filename);
+
+//predicts continuations of the context using the highest order available and backs off to lower
+//orders until something is found. only the last (order - 1) context words are used.
+//returns the order of the table that produced the results, or 0 if every order came up empty
+int predict_ngrams(const ngram_model *model, const char *context[], int context_len, bt_priority_q *result);
+
+//like predict_ngrams, but only continuations whose next word starts with prefix are returned, so a
+//partly typed word is completed with one bounded range scan per order instead of a full context scan
+int complete_ngrams(const ngram_model *model, const char *context[], int context_len, const char *prefix, bt_priority_q *result);
+
+//writes the whole model (unigrams and every n-gram table) into a binary snapshot file
+int save_ngram_snapshot(const ngram_model *model, const char *filename);
+
+//rebuilds a model from a snapshot written by save_ngram_snapshot; pruning thresholds set on the
+//model beforehand are applied while loading. returns 0 on success, -1 on failure
+int load_ngram_snapshot(ngram_model *model, const char *filename);
+
+//builds a complete heap allocated model from a source description; returns NULL on failure, including
+//when any configured CSV file cannot be read (no partial model is returned)
+ngram_model *load_ngram_model(const ngram_source *source);
+
+//helper function : 64-bit FNV-1a hash of an n-gram key, shared by every hashed structure
+unsigned long long hash_ngram(const char *ngram);
+
+//helper function : hash_ngram of the first len bytes of a key
+unsigned long long hash_ngram_prefix(const char *ngram, size_t len);
+
+//packs every n-gram table into its read-only front coded form (see packBPlusTree), falling back to
+//one contiguous node region (compactBPlusTree), and rebuilds the context filters. load_ngram_model
+//and clone_ngram_model already do this; call it after other bulk changes
+void compact_ngram_model(ngram_model *model);
+
+//compact_ngram_model for the table and context filter of order n (n >= 2) only; shared orders are skipped
+void compact_ngram_table(ngram_model *model, int n);
+
+//returns a heap allocated deep copy of the model (NULL if memory ran out). the copy has a trie of
+//its own and no ranking vocabulary
+ngram_model *clone_ngram_model(const ngram_model *model);
+
+//returns a heap allocated model that reads every structure of model instead of copying it (NULL if
+//memory ran out). copy an order with unshare_ngram_order before changing it, and hand the rest over
+//with hand_on_ngram_model once the new model replaces the old one
+ngram_model *share_ngram_model(const ngram_model *model);
+
+//gives the model a private copy of the order n structures it shares: the trie for n = 1 (without
+//its ranking vocabulary), the table for n >= 2 (in node form, without its context filter until the
+//next compaction). no effect on an order it owns. returns 0, or -1 if memory ran out
+int unshare_ngram_order(ngram_model *model, int n);
+
+//moves the structures next still shares with prev over to next, so freeing prev keeps them.
+//prev must not be used for anything but free_ngram_model afterwards
+void hand_on_ngram_model(ngram_model *prev, ngram_model *next);
+
+//releases the trie (and its ranking vocabulary) and all n-gram tables of the model, except shared ones
+void free_ngram_model(ngram_model *model);
+
+#endif
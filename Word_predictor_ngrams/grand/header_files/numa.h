@@ -0,0 +1,32 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#define NUMA_MAX_NODES 8
+#define NUMA_MAX_CPUS 1024
+#define NUMA_MASK_WORDS (NUMA_MAX_CPUS / 64)
+#define NUMA_ANY_NODE -1
+
+// NUMA nodes of the machine and the CPUs of each, read from /sys/devices/system/node.
+// Machines without that directory (or with one node) report a single node holding every CPU.
+typedef struct {
+    int num_nodes;
+    unsigned long long cpus[NUMA_MAX_NODES][NUMA_MASK_WORDS];   // Bit c of cpus[n] is set when CPU c belongs to node n.
+} numa_topology;
+
+//fills topo with the online nodes (at most NUMA_MAX_NODES); returns the number of nodes
+int numa_discover(numa_topology *topo);
+
+//returns the node of the CPU the calling thread is running on (0 if it cannot be told)
+int numa_current_node(const numa_topology *topo);
+
+//restricts the calling thread to the CPUs of node (NUMA_ANY_NODE: every CPU again); returns 0 on success
+int numa_pin_to_node(const numa_topology *topo, int node);
+
+//makes the calling thread's new allocations interleave page by page across every node (until
+//numa_interleave_end); returns 0 on success, -1 if the kernel refused
+int numa_interleave_begin(const numa_topology *topo);
+
+//restores the default first-touch allocation policy of the calling thread
+void numa_interleave_end(void);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include "ngram.h"
+
+#define PRUNE_BACKOFF_WEIGHT 0.4    // Stupid backoff weight used when estimating the lower-order probability
+
+// How entries are ranked before the lowest ranked ones are dropped.
+typedef enum {
+    PRUNE_BY_COUNT,     // Keep the most frequent n-grams.
+    PRUNE_BY_ENTROPY    // Keep the n-grams whose removal would change the model the most (Stolcke pruning).
+} prune_method;
+
+// Settings for one pruning pass over the n-gram tables (order 2 and above; the trie is kept whole).
+typedef struct {
+    prune_method method;
+    int min_count;                  // Entries below this count are always dropped (0 disables).
+    double entropy_threshold;       // PRUNE_BY_ENTROPY: entries scoring below this are dropped (0 disables).
+    long long target_bytes;         // Memory budget for all n-gram tables together (0 disables).
+} prune_config;
+
+// What the pruning pass did, per order and in total.
+typedef struct {
+    long entries_before[MAX_NGRAM_ORDER + 1];
+    long entries_after[MAX_NGRAM_ORDER + 1];
+    long long bytes_before;         // Bytes held by the n-gram tables before pruning.
+    long long bytes_after;          // Bytes held by the n-gram tables after pruning.
+    double entropy_increase;        // Estimated increase of the cross entropy, in nats per word.
+    double perplexity_increase;     // Estimated relative perplexity change: exp(entropy_increase) - 1.
+} prune_report;
+
+//initialises a config that keeps everything (count ranking, no thresholds, no budget)
+void init_prune_config(prune_config *config);
+
+//prunes the n-gram tables of the model in place and fills the report (report may be NULL).
+//returns 0 on success, -1 if memory ran out
+int prune_ngram_model(ngram_model *model, const prune_config *config, prune_report *report);
+
+//prints the pruning report in a human readable form
+void display_prune_report(const prune_report *report);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef RANKING_H
+#define RANKING_H
+
+#include "functions.h"
+#include "ngram.h"
+
+#define RANK_MAX_EDITS 2            // Candidates further than this (plain Levenshtein) are not considered
+#define RANK_MAX_RATIO 0.7f         // ...nor those whose normalized distance is above this
+#define RANK_ADJACENT_COST 0.5f     // Substituting a neighbouring key on a QWERTY keyboard
+#define RANK_TRANSPOSE_COST 0.5f    // Swapping two adjacent letters (Damerau)
+#define RANK_PHONETIC_BONUS 0.5f    // Taken off the cost when both words share a Soundex code
+#define RANK_CHANNEL_WEIGHT 4.0f    // log P(typed | word) = -weight * cost
+#define RANK_BACKOFF_WEIGHT 0.4f    // Stupid backoff from the bigram context to the unigram prior
+
+// Flat copy of the trie vocabulary, laid out so candidate scoring runs over plain arrays.
+typedef struct ranking_vocab {
+    int size;
+    const char **words;             // words[i] points into the arena.
+    float *log_prior;               // log P(word) from the unigram counts.
+    int *counts;                    // Unigram counts.
+    char *arena;
+    long long total_count;
+} ranking_vocab;
+
+//copies every word of the trie into the vocabulary; returns 0 on success
+int init_ranking_vocab(ranking_vocab *vocab, trie *T);
+
+//frees the vocabulary
+void free_ranking_vocab(ranking_vocab *vocab);
+
+//builds a vocabulary of the trie and attaches it (T->vocab), replacing any previous one. spell
+//corrections on a trie with a vocabulary rank fuzzy candidates with the noisy channel model.
+//returns 0 on success. free_ngram_model frees the vocabulary of the model's trie
+int attach_ranking_vocab(trie *T);
+
+//frees the vocabulary attached to the trie (no effect without one)
+void detach_ranking_vocab(trie *T);
+
+//weighted Damerau-Levenshtein cost of typing "typed" when "word" was meant:
+//keyboard neighbours and transpositions are cheaper, words that sound alike get a bonus
+float weighted_edit_cost(const char *typed, const char *word);
+
+//helper function : 4 character Soundex code of a word (out needs 5 bytes)
+void soundex(const char *word, char out[5]);
+
+//noisy channel ranking: argmax P(word | prev) * P(typed | word) over the vocabulary.
+//prev (may be NULL) adds bigram context from the model. the best MAX_WORDS candidates go into result
+//with their score as probability and their weighted cost as distance. returns result->size
+int rank_candidates(const ranking_vocab *vocab, const ngram_model *model, const char *prev, const char *typed, priority_Q *result);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SCORE_H
+#define SCORE_H
+
+#include <stdio.h>
+#include "ngram.h"
+#include "threadpool.h"
+
+#define SCORE_CHUNK_SIZE (1024 * 1024)      // Bytes scored per step (grown when one sentence is longer)
+#define SCORE_SLICE_SENTENCES 1024          // Sentences per thread pool task: their lookups are sorted together
+#define SCORE_DISCOUNT 0.75                 // Absolute discount taken from every stored n-gram count
+#define SCORE_SKIP_LIMIT 64                 // Keys a cursor walks forward before a fresh seek is cheaper
+
+// Scores of one sentence (one input line) under the model.
+typedef struct {
+    double logprob;                         // log10 P(sentence): the sum over its words.
+    int words;
+    int oovs;                               // Words missing from the unigram trie.
+} sentence_score;
+
+// Sums over everything scored so far.
+typedef struct {
+    long long sentences;
+    long long words;
+    long long oovs;
+    double logprob;
+} score_totals;
+
+// Scores every line of in as one sentence and writes "logprob<TAB>perplexity<TAB>words<TAB>oovs" per
+// line to out (perplexity 0 for a line without words). Word tokens are lowercased like the interactive
+// path; numbers, hashtags and punctuation are skipped.
+//
+// The model interpolates every order with absolute discounting:
+//   P1(w)   = (c(w) + 1) / (N + V + 1)      N: unigram total, V: vocabulary; an OOV word gets the
+//                                            single extra slot
+//   Pn(w|h) = max(c(h w) - D, 0) / S(h) + D * T(h) / S(h) * Pn-1(w|h')
+// where S(h) and T(h) are the total count and the number of distinct words stored after the context h,
+// and h' drops its oldest word. An order whose table holds nothing after h passes Pn-1 through.
+//
+// Each task scores a slice of sentences: it gathers every n-gram lookup of the slice, sorts them so
+// lookups sharing a context become one range scan and ranges follow each other in key order, and
+// resolves them with one cursor per order that only moves forward. Returns 0 on success, -1 on an I/O
+// or allocation error.
+int score_stream(FILE *in, FILE *out, const ngram_model *model, threadpool *pool, score_totals *totals);
+
+//prints the totals and the overall perplexity as one "# ..." line
+void display_score_totals(FILE *out, const score_totals *totals);
+
+#endif
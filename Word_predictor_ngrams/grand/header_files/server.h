@@ -0,0 +1,102 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include "engine.h"
+#include "mpmc_queue.h"
+
+#define SERVER_MAX_LINE 4096            // Longest request line; a longer one closes the connection
+#define SERVER_PIPELINE_DEPTH 64        // Requests one connection may have in flight before reading pauses
+#define SERVER_QUEUE_CAPACITY 4096      // Requests in flight across all connections; more are refused with ERR busy
+#define SERVER_MAX_EVENTS 256           // epoll events handled per wakeup
+#define SERVER_IOV_BATCH 64             // Responses written per sendmsg call
+#define SERVER_MAX_WORKERS (MAX_READER_SLOTS - 8)  // Leaves reader slots for threads outside the server
+
+// Non-blocking front end for the engine. One event loop thread owns every socket: it accepts
+// connections, splits their input into request lines and pushes them onto a lock-free queue. Worker
+// threads pop requests, run them on the engine and push the responses onto a second queue, waking
+// the event loop through an eventfd. The loop puts each connection's responses back in request
+// order and writes all the ready ones with a single sendmsg.
+//
+// Protocol, one line per request and response (requests may be pipelined):
+//   PREDICT <text>   ->  OK[ <word> <count>]...        next words for the end of text, best first
+//   COMPLETE <text>  ->  OK[ <word> <count>]...        completions of the partly typed last word
+//   CORRECT <text>   ->  OK <corrected text>
+//   LEARN <text>     ->  OK                            counts the text's n-grams into the model at the
+//                                                      next merge (see wp_learn)
+//   RELOAD           ->  OK                            loads the model files again in the background;
+//                                                      requests keep being answered meanwhile
+//   anything else    ->  ERR <reason>
+
+struct wp_connection;
+
+// One request line travelling from the event loop to a worker and back.
+typedef struct {
+    struct wp_connection *conn;
+    unsigned int seq;                   // Position in the connection's request order.
+    char *response;                     // Filled by the worker (malloc'd, newline terminated).
+    size_t response_len;
+    char line[];                        // The request, NUL terminated.
+} server_request;
+
+typedef struct wp_connection {
+    int fd;
+    char in[SERVER_MAX_LINE];           // Bytes read but not yet split into requests.
+    size_t in_used;
+    unsigned int next_seq;              // Sequence number of the next request read.
+    unsigned int send_seq;              // Sequence number of the next response to write.
+    size_t sent;                        // Bytes of that response already written.
+    server_request *ready[SERVER_PIPELINE_DEPTH];// Completed requests indexed by seq % depth.
+    int inflight;                       // Requests read whose response is not written yet.
+    int events;                         // epoll events currently registered.
+    int eof;                            // Peer finished sending: close once everything is written.
+    int dead;                           // Socket failed: drop responses, free once inflight is 0.
+    int blocked;                        // The socket buffer is full: wait for EPOLLOUT.
+    int dirty;                          // Queued for the end-of-round pass.
+    struct wp_connection *next_dirty;
+    struct wp_connection *prev, *next;  // Every open connection.
+} wp_connection;
+
+typedef struct {
+    wp_engine *engine;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;                        // eventfd: workers -> event loop.
+    atomic_int wake_pending;            // Set while a wakeup is already on its way.
+    atomic_int running;
+    atomic_int reload_requested;        // Set by wp_server_reload, handled by the event loop.
+    int unix_socket;                    // Listening on a Unix socket (unlinked on destroy).
+    char path[108];
+
+    mpmc_queue requests;                // Event loop -> workers.
+    mpmc_queue responses;               // Workers -> event loop.
+    sem_t work_ready;                   // Counts queued requests; idle workers sleep on it.
+    int inflight;                       // Requests in either queue or in a worker (event loop only).
+    wp_connection *connections;         // Every connection not freed yet (event loop only).
+    wp_connection *dirty;               // Connections to write / resume / close this round.
+
+    pthread_t *workers;
+    int num_workers;
+    atomic_int next_worker;             // Index handed to the next worker that starts (NUMA pinning).
+} wp_server;
+
+//binds the address ("unix:/path", "/path", "host:port" or "port" for 127.0.0.1) and starts num_workers
+//worker threads (at most SERVER_MAX_WORKERS). returns 0 on success, -1 on failure
+int wp_server_init(wp_server *server, wp_engine *engine, const char *address, int num_workers);
+
+//runs the event loop on the calling thread until wp_server_stop is called; returns 0, or -1 on an epoll error
+int wp_server_run(wp_server *server);
+
+//asks the event loop to return; safe to call from other threads and from signal handlers
+void wp_server_stop(wp_server *server);
+
+//asks the event loop to reload the engine's model (see wp_reload); safe to call from other threads
+//and from signal handlers
+void wp_server_reload(wp_server *server);
+
+//stops the workers, closes every connection and the listening socket
+void wp_server_destroy(wp_server *server);
+
+#endif
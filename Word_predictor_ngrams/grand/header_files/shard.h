@@ -0,0 +1,53 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "ngram.h"
+
+#define SHARD_MAX 64                        // Most shards one router talks to
+#define SHARD_PATH_LEN 108                  // sizeof(sockaddr_un.sun_path)
+#define SHARD_LINE_LEN (MAX_NGRAM_LEN + 32) // One request or response line
+
+// Scale-out serving: the n-gram tables are partitioned by context (ngram_shard_of), each partition is
+// loaded and served by its own process on a Unix socket, and a router fans predict calls out to them.
+// Every shard and the router keep the full unigram trie: it is small and spell correction needs it.
+//
+// Wire protocol, one text line per message:
+//   request   "<order> <w1> ... <w(order-1)>\n"         search one table for continuations of a context
+//             "<order> <w1> ... <w(order-1)> <prefix>\n" only continuations whose next word starts with prefix
+//   response  "<k>\n" then k lines "<count> <ngram>\n"   at most 3 matches, highest count first (-1: bad request)
+
+// One connection from the router to a shard process.
+typedef struct {
+    char path[SHARD_PATH_LEN];
+    int fd;                                 // -1 while disconnected; reconnected on the next request.
+    FILE *in;                               // Buffered reader over fd (requests are sent with send()).
+    pthread_mutex_t lock;                   // One request/response exchange at a time.
+} shard_conn;
+
+typedef struct {
+    int num_shards;
+    shard_conn shards[SHARD_MAX];
+} shard_router;
+
+//serves the model's partition on a Unix socket (an existing socket file is replaced), one thread per
+//connection. only returns if the socket could not be set up or accept fails; returns -1
+int shard_serve(const ngram_model *model, const char *socket_path);
+
+//connects to every shard; paths[i] must serve partition i of num_shards. returns 0 on success
+int shard_router_open(shard_router *router, const char *const paths[], int num_shards);
+
+//predict_ngrams over the shards: the table of every order the context allows is queried on the shard
+//owning that context, all in flight at once, and the highest order with matches wins.
+//returns that order, 0 if every order came up empty, or -1 if a shard could not be reached
+int shard_router_predict(shard_router *router, int order, const char *context[], int context_len, bt_priority_q *result);
+
+//shard_router_predict restricted to continuations whose next word starts with prefix (see complete_ngrams)
+int shard_router_complete(shard_router *router, int order, const char *context[], int context_len, const char *prefix,
+                          bt_priority_q *result);
+
+//closes every connection
+void shard_router_close(shard_router *router);
+
+#endif
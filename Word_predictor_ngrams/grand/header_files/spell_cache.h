@@ -0,0 +1,60 @@
+#ifndef SPELL_CACHE_H
+#define SPELL_CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "functions.h"
+#include "ngram.h"
+
+#define SPELL_CACHE_SHARDS 16       // Independent locks, so concurrent requests rarely contend
+#define SPELL_CACHE_PROBES 8        // Slots examined per lookup; eviction picks a victim among them
+
+// The correction decision for one raw token, including "no correction found".
+typedef struct {
+    char token[MAX_TOKEN_LEN];      // Raw (lowercased) token the decision belongs to.
+    char prev[MAX_TOKEN_LEN];       // Previous word the fuzzy ranking was conditioned on ("" for none).
+    int any_prev;                   // The decision holds whatever the previous word (not a ranked correction).
+    unsigned long long generation;  // Serial of the trie the decision was computed on; other tries miss.
+    word_element best;              // Best candidate of the unigram -> prefix -> fuzzy cascade.
+    int has_match;                  // 0 when the cascade found nothing.
+    int used;                       // Slot holds a decision.
+    int referenced;                 // Second chance bit: set on every hit, cleared when an eviction scan passes.
+} spell_cache_entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    spell_cache_entry *entries;
+    int capacity;
+    int victim_offset;              // Slot of the probe window the next eviction scan starts at (rotates).
+} spell_cache_shard;
+
+// Bounded token -> correction cache shared by every request and thread.
+typedef struct spell_cache {
+    spell_cache_shard shards[SPELL_CACHE_SHARDS];
+    atomic_ullong hits;
+    atomic_ullong misses;
+    atomic_ullong evictions;
+} spell_cache;
+
+//initialises a cache holding about capacity decisions; returns 0 on success
+int spell_cache_init(spell_cache *cache, int capacity);
+
+//frees the cache
+void spell_cache_destroy(spell_cache *cache);
+
+//cached version of validate: the best candidate for the token, or an empty element if none.
+//a NULL cache runs the cascade directly. the fuzzy step ranks candidates with the noisy channel model
+//instead of by unigram probability when the trie carries a vocabulary (see attach_ranking_vocab)
+word_element spell_cache_validate(spell_cache *cache, trie *T, const char *token);
+
+//same as spell_cache_validate on the model's unigrams, with the fuzzy ranking conditioned on the
+//previous word (may be NULL) through the model's bigrams
+word_element spell_cache_validate_context(spell_cache *cache, ngram_model *model, const char *prev, const char *token);
+
+//cached version of correct_word: writes the correction (or the token itself) into out
+void spell_cache_correct(spell_cache *cache, trie *T, const char *token, char out[MAX_TOKEN_LEN]);
+
+//prints the hit / miss / eviction counters
+void display_spell_cache_stats(spell_cache *cache);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include "functions.h"
+#include "spell_cache.h"
+#include "threadpool.h"
+
+#define STREAM_CHUNK_SIZE (64 * 1024)       // Bytes corrected per step; memory use does not grow with the input
+#define STREAM_SLICE_SPANS 512              // Tokens per thread pool task
+
+// Corrects a document of any size read from in and writes it to out, chunk by chunk.
+// Chunks are cut at whitespace so no token is split (unless a single token is longer than a chunk).
+// Word tokens are corrected in parallel on the pool; everything else, and every word that needs no
+// correction, is written straight from the input buffer. Token bytes are lowercased like the
+// interactive path. Returns 0 on success, -1 on an I/O or allocation error.
+int stream_correct(FILE *in, FILE *out, trie *T, spell_cache *cache, threadpool *pool);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+
+// A task is called once for every index in [0, num_tasks).
+typedef void (*threadpool_task)(void *ctx, int index);
+
+// Fixed set of worker threads running parallel-for style batches.
+// The calling thread takes part in every batch, so a pool with 0 workers runs batches inline.
+typedef struct {
+    pthread_t *threads;
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;      // Signalled when a batch is posted or the pool shuts down.
+    pthread_cond_t work_done;       // Signalled when the last task of a batch finished.
+    threadpool_task task;           // Current batch (NULL when idle).
+    void *ctx;
+    int num_tasks;
+    int next_task;                  // Next index to hand out.
+    int pending;                    // Tasks of the batch not finished yet.
+    int shutdown;
+} threadpool;
+
+//starts num_threads workers; returns 0 on success
+int threadpool_init(threadpool *pool, int num_threads);
+
+//runs task(ctx, i) for every i in [0, num_tasks) across the pool and the caller, and waits for all of them
+void threadpool_run(threadpool *pool, threadpool_task task, void *ctx, int num_tasks);
+
+//stops and joins every worker
+void threadpool_destroy(threadpool *pool);
+
+#endif
@@ -1,6 +0,0 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <limits.h>
-#define MAX_TOKEN_LEN 100
-#include "functions.h"
-
@@ -0,0 +1,41 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+// Character classes used by the span tokenizer (one lookup per input byte).
+#define CC_DELIM  0x01      // Characters from DELIMS and whitespace: end the current token.
+#define CC_SPACE  0x02      // Whitespace: a token never spans it, so the reverse scan can restart after it.
+#define CC_DIGIT  0x04      // 0-9: starts a number run that may contain '.'.
+#define CC_ALNUM  0x08      // Letters and digits: allowed in hashtags.
+#define CC_HASH   0x10      // '#': starts a hashtag.
+#define CC_EMOJI  0x20      // Lead byte of a 4 byte UTF-8 sequence: skipped with its continuation bytes.
+#define CC_UPPER  0x40      // A-Z: lowercased while scanning.
+
+extern const unsigned char char_class[256];
+
+typedef enum {
+    TOKEN_WORD,             // Anything that is not a number or a hashtag (these get spell checked).
+    TOKEN_NUMBER,           // Starts with a digit; digits and '.' stay together ("3.14").
+    TOKEN_HASHTAG           // '#' followed by letters and digits.
+} token_kind;
+
+// A token is a view into the input: no copies, no allocation.
+typedef struct {
+    int offset;             // Index of the first byte of the token in the input.
+    int length;             // Number of bytes.
+    token_kind kind;
+} token_span;
+
+//tokenizes input[0..len) in one pass, lowercasing the token bytes in place.
+//stores up to max_spans spans and returns the total number of tokens found
+int tokenize_spans(char *input, size_t len, token_span *spans, int max_spans);
+
+//scans input[0..len) backwards and returns (oldest first) up to wanted of the last TOKEN_WORD spans,
+//lowercasing them in place. only the tail of the input that holds those words is tokenized
+int last_word_spans(char *input, size_t len, token_span *spans, int wanted);
+
+//helper function : copies a span into a NUL terminated buffer of size cap (truncating if needed)
+void span_to_string(const char *input, const token_span *span, char *out, size_t cap);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+// Hot path instrumentation. Trace points are compiled in only when WP_TRACE is defined;
+// otherwise every TRACE_* macro expands to nothing and the functions below are never called.
+
+#define TRACE_SUB_BUCKET_BITS 4                                 // 16 linear sub-buckets per power of two (~6% error)
+#define TRACE_SUB_BUCKETS (1 << TRACE_SUB_BUCKET_BITS)
+#define TRACE_BUCKETS (64 * TRACE_SUB_BUCKETS)
+#define TRACE_MAX_THREADS 256
+
+typedef enum {
+    TRACE_TOKENIZE,         // tokenize_spans / last_word_spans
+    TRACE_CORRECT,          // One token through the spell cache (hit or cascade)
+    TRACE_BACKOFF,          // predict_ngrams, all orders tried
+    TRACE_SEARCH,           // One searchNGramsContext call
+    TRACE_DISPLAY,          // display_unique_bt_q
+    TRACE_NUM_STAGES
+} trace_stage;
+
+typedef enum {
+    TRACE_BTREE_NODES,      // Internal nodes visited while descending in searchNGramsContext
+    TRACE_BTREE_LEAVES,     // Leaves scanned along the leaf chain
+    TRACE_TRIE_NODES,       // Trie nodes visited by collect_fuzzy
+    TRACE_FILTER_SKIPS,     // Backoff levels skipped because the context filter ruled the context out
+    TRACE_NUM_COUNTERS
+} trace_counter;
+
+// HDR style histogram of nanosecond latencies: log2 buckets split linearly into sub-buckets.
+typedef struct {
+    atomic_ullong buckets[TRACE_BUCKETS];
+    atomic_ullong count;
+    atomic_ullong sum;
+    atomic_ullong max;
+} trace_histogram;
+
+// Owned by one thread (single writer, relaxed stores); the dump reads every thread's copy.
+typedef struct {
+    trace_histogram stages[TRACE_NUM_STAGES];
+    atomic_ullong counters[TRACE_NUM_COUNTERS];
+} trace_thread_state;
+
+//monotonic clock in nanoseconds
+unsigned long long trace_now_ns(void);
+
+//adds one latency sample to the calling thread's histogram for the stage
+void trace_record(trace_stage stage, unsigned long long ns);
+
+//adds n to the calling thread's counter
+void trace_add(trace_counter counter, unsigned long long n);
+
+//zeroes every thread's histograms and counters
+void trace_reset(void);
+
+//writes the merged histograms (count, mean, p50/p90/p99/p999, max) and counters as one JSON object
+void trace_dump(FILE *out);
+
+#ifdef WP_TRACE
+#define TRACE_BEGIN(var) unsigned long long var = trace_now_ns()
+#define TRACE_END(stage, var) trace_record((stage), trace_now_ns() - (var))
+#define TRACE_COUNT(counter, n) trace_add((counter), (n))
+#else
+#define TRACE_BEGIN(var) do { } while (0)
+#define TRACE_END(stage, var) do { } while (0)
+#define TRACE_COUNT(counter, n) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "btree.h"
+#include "functions.h"
+#include "engine.h"
+#include "trace.h"
+
+// Benchmark suite: every stage is measured on its own and reported as one JSON object per line:
+//   {"stage":..., "ops":..., "total_s":..., "throughput_ops_s":..., "p50_ns":..., "p99_ns":..., "p999_ns":..., "peak_rss_kb":...}
+// Query stages also report LLC and dTLB read misses per op where perf events are available.
+// Synthetic corpora are the shipped datasets scaled up: --scale 10 writes 10x as many unigrams,
+// bigrams and trigrams (drawn from a skewed distribution over the vocabulary) into --workdir.
+
+#define BENCH_DEFAULT_OPS 20000
+#define BENCH_QUERY_LEN (4 * MAX_TOKEN_LEN)      // Room for the three word end-to-end inputs
+
+typedef struct {
+    int scale;                      // Multiplier over the shipped dataset sizes.
+    long long ngrams;               // Explicit n-gram target (overrides scale for bigrams + trigrams).
+    int ops;                        // Timed operations per query stage.
+    unsigned int seed;
+    const char *workdir;
+    const char *only;               // Run a single stage when set.
+    int trace;                      // Append the trace histograms (WP_TRACE builds) as a last line.
+    int compact;                    // Lay the loaded tables out contiguously (compactBPlusTree).
+    int pack;                       // Pack them into front coded blocks instead (packBPlusTree).
+    double filter_fpr;              // Context filter false positive rate (0: no filters).
+    int per_node;                   // Repeat end_to_end pinned to every NUMA node (set by --numa).
+    wp_numa_mode numa;              // Model placement of the engine.
+} bench_config;
+
+typedef struct {
+    char **words;
+    int size;
+} word_list;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Percentile of an already sorted sample
+static double percentile(const double *sorted, int n, double p) {
+    if (n == 0) return 0.0;
+    int index = (int)(p * (double)(n - 1) + 0.5);
+    return sorted[index];
+}
+
+// Hardware cache counters for the query stages; fd is -1 where perf events are unavailable
+typedef struct {
+    const char *name;
+    unsigned long long config;
+    int fd;
+    long long value;
+} hw_counter;
+
+#define HW_CACHE_READ_MISSES(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static hw_counter hw_counters[] = {
+    { "llc_misses", HW_CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL), -1, -1 },
+    { "dtlb_misses", HW_CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_DTLB), -1, -1 },
+};
+#define NUM_HW_COUNTERS ((int)(sizeof(hw_counters) / sizeof(hw_counters[0])))
+
+static void open_hw_counters(void) {
+    for (int i = 0; i < NUM_HW_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = hw_counters[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        hw_counters[i].fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void start_hw_counters(void) {
+    for (int i = 0; i < NUM_HW_COUNTERS; i++) {
+        hw_counters[i].value = -1;
+        if (hw_counters[i].fd < 0) continue;
+        ioctl(hw_counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(hw_counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static void stop_hw_counters(void) {
+    for (int i = 0; i < NUM_HW_COUNTERS; i++) {
+        if (hw_counters[i].fd < 0) continue;
+        ioctl(hw_counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(hw_counters[i].fd, &hw_counters[i].value, sizeof(long long)) != sizeof(long long)) {
+            hw_counters[i].value = -1;
+        }
+    }
+}
+
+// One JSON line; latencies (if any) are sorted in place
+static void report(const char *stage, long long ops, double total_ns, double *latencies, int num_latencies) {
+    printf("{\"stage\":\"%s\",\"ops\":%lld,\"total_s\":%.6f,\"throughput_ops_s\":%.1f",
+           stage, ops, total_ns / 1e9, total_ns > 0 ? (double)ops / (total_ns / 1e9) : 0.0);
+    if (num_latencies > 0) {
+        qsort(latencies, num_latencies, sizeof(double), compare_double);
+        printf(",\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"p999_ns\":%.0f",
+               percentile(latencies, num_latencies, 0.50),
+               percentile(latencies, num_latencies, 0.99),
+               percentile(latencies, num_latencies, 0.999));
+        for (int i = 0; i < NUM_HW_COUNTERS; i++) {
+            if (hw_counters[i].value >= 0) {
+                printf(",\"%s_per_op\":%.2f", hw_counters[i].name, (double)hw_counters[i].value / (double)ops);
+            }
+        }
+    }
+    printf(",\"peak_rss_kb\":%ld}\n", peak_rss_kb());
+    fflush(stdout);
+}
+
+static int stage_enabled(const bench_config *cfg, const char *stage) {
+    return cfg->only == NULL || strcmp(cfg->only, stage) == 0;
+}
+
+// Skewed pick: low indices (frequent words) come up far more often, like real text
+static int skewed_index(int size) {
+    double u = (double)rand() / ((double)RAND_MAX + 1.0);
+    return (int)((double)size * u * u * u);
+}
+
+// Read the first column of the shipped unigram CSV
+static int load_vocab(word_list *vocab, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Could not open file");
+        return -1;
+    }
+    int capacity = 4096;
+    vocab->words = (char **)malloc(sizeof(char *) * capacity);
+    vocab->size = 0;
+    char line[256], word[128];
+    int count;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%127[^,],%d", word, &count) != 2) continue;
+        if (vocab->size == capacity) {
+            capacity *= 2;
+            vocab->words = (char **)realloc(vocab->words, sizeof(char *) * capacity);
+        }
+        vocab->words[vocab->size++] = strdup(word);
+    }
+    fclose(file);
+    return 0;
+}
+
+// Grow the vocabulary with random a-z words so larger scales do not only repeat keys
+static void extend_vocab(word_list *vocab, int target) {
+    vocab->words = (char **)realloc(vocab->words, sizeof(char *) * (target > vocab->size ? target : vocab->size));
+    while (vocab->size < target) {
+        char word[16];
+        int len = 3 + rand() % 8;
+        for (int i = 0; i < len; i++) word[i] = (char)('a' + rand() % 26);
+        word[len] = '\0';
+        vocab->words[vocab->size++] = strdup(word);
+    }
+}
+
+// Write a synthetic CSV of the given order; counts fall off with the rank like a Zipf curve
+static int write_synthetic_csv(const char *path, const word_list *vocab, int order, long long rows) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Could not open file");
+        return -1;
+    }
+    for (long long r = 0; r < rows; r++) {
+        for (int n = 0; n < order; n++) {
+            int index = order == 1 ? (int)(r % vocab->size) : skewed_index(vocab->size);
+            fprintf(file, "%s%s", n > 0 ? " " : "", vocab->words[index]);
+        }
+        fprintf(file, ",%lld\n", 1000000LL / (r + 1) + 1);
+    }
+    fclose(file);
+    return 0;
+}
+
+// A slightly misspelled copy of a word: one substitution, deletion or transposition
+static void misspell(const char *word, char *out) {
+    strcpy(out, word);
+    int len = (int)strlen(out);
+    if (len < 3) return;
+    int pos = 1 + rand() % (len - 2);
+    switch (rand() % 3) {
+        case 0: out[pos] = (char)('a' + rand() % 26); break;
+        case 1: memmove(out + pos, out + pos + 1, len - pos); break;
+        default: { char t = out[pos]; out[pos] = out[pos + 1]; out[pos + 1] = t; } break;
+    }
+}
+
+// Time a query stage: fn is called ops times, each call timed on its own
+typedef void (*bench_op)(void *ctx, int i);
+static void run_stage(const char *stage, int ops, bench_op fn, void *ctx) {
+    double *lat = (double *)malloc(sizeof(double) * ops);
+    start_hw_counters();
+    double start = now_ns();
+    for (int i = 0; i < ops; i++) {
+        double t0 = now_ns();
+        fn(ctx, i);
+        lat[i] = now_ns() - t0;
+    }
+    double total = now_ns() - start;
+    stop_hw_counters();
+    report(stage, ops, total, lat, ops);
+    free(lat);
+}
+
+typedef struct {
+    ngram_model *model;
+    wp_engine *engine;
+    char (*queries)[BENCH_QUERY_LEN];       // Per-op inputs prepared before timing
+    const char *(*contexts)[2];
+    wp_session session;
+} bench_ctx;
+
+static void op_trie_lookup(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    priority_Q pq;
+    init_priority_Q(&pq);
+    is_unigram(c->model->unigrams, c->queries[i], &pq);
+}
+
+static void op_prefix(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    priority_Q pq;
+    init_priority_Q(&pq);
+    is_prefix(c->model->unigrams, c->queries[i], &pq);
+}
+
+static void op_fuzzy(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    priority_Q pq;
+    init_priority_Q(&pq);
+    is_fuzzymatch(c->model->unigrams, c->queries[i], &pq);
+}
+
+static void op_btree_search(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    bt_priority_q q;
+    init_bt_pq(&q);
+    searchNGramsContext(c->model->tables[3], c->contexts[i], 2, &q);
+    free_bt_q(&q);
+}
+
+// Trigram -> bigram backoff on a context that is usually not in the trigram table
+static void op_backoff(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    bt_priority_q q;
+    init_bt_pq(&q);
+    predict_ngrams(c->model, c->contexts[i], 2, &q);
+    free_bt_q(&q);
+}
+
+// The interactive pipeline through the engine API: predict from the last words, correct the rest
+static void op_end_to_end(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    wp_suggestion suggestions[WP_MAX_SUGGESTIONS];
+    wp_context context;
+    char corrected[BENCH_QUERY_LEN * 2];
+    if (wp_predict(c->engine, c->queries[i], suggestions, WP_MAX_SUGGESTIONS, &context) >= 0) {
+        wp_correct(c->engine, c->queries[i], (size_t)context.offset, corrected, sizeof(corrected));
+    }
+}
+
+// One keystroke of a phrase being typed: the whole input so far, completed from scratch
+static void op_keystroke(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    wp_suggestion suggestions[WP_MAX_SUGGESTIONS];
+    wp_complete(c->engine, c->queries[i], suggestions, WP_MAX_SUGGESTIONS, NULL);
+}
+
+// The same keystrokes through a session that keeps the work of the previous one
+static void op_keystroke_session(void *p, int i) {
+    bench_ctx *c = (bench_ctx *)p;
+    wp_suggestion suggestions[WP_MAX_SUGGESTIONS];
+    wp_session_complete(&c->session, c->queries[i], suggestions, WP_MAX_SUGGESTIONS, NULL);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--scale N] [--ngrams N] [--ops N] [--seed N] [--workdir dir] [--stage name] [--trace] [--no-compact] [--no-pack]\n"
+           "          [--filter-fpr rate] [--numa off|replicate|interleave]\n"
+           "Stages: load_unigrams load_ngrams trie_lookup prefix fuzzy btree_search btree_scan backoff end_to_end keystrokes\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    bench_config cfg = { 1, 0, BENCH_DEFAULT_OPS, 42, "/tmp", NULL, 0, 1, 1, NGRAM_FILTER_FPR, 0, WP_NUMA_OFF };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) cfg.scale = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ngrams") == 0 && i + 1 < argc) cfg.ngrams = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) cfg.ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) cfg.seed = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--workdir") == 0 && i + 1 < argc) cfg.workdir = argv[++i];
+        else if (strcmp(argv[i], "--stage") == 0 && i + 1 < argc) cfg.only = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0) cfg.trace = 1;
+        else if (strcmp(argv[i], "--no-compact") == 0) cfg.compact = 0;
+        else if (strcmp(argv[i], "--no-pack") == 0) cfg.pack = 0;
+        else if (strcmp(argv[i], "--filter-fpr") == 0 && i + 1 < argc) cfg.filter_fpr = atof(argv[++i]);
+        else if (strcmp(argv[i], "--numa") == 0 && i + 1 < argc && wp_parse_numa_mode(argv[i + 1], &cfg.numa) == 0) {
+            cfg.per_node = 1;
+            i++;
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.scale < 1) cfg.scale = 1;
+    if (cfg.ops < 1) cfg.ops = 1;
+    srand(cfg.seed);
+
+    // Build the synthetic corpus from the shipped vocabulary
+    word_list vocab;
+    if (load_vocab(&vocab, "./dataset/unigrams_4000.csv") != 0) return 1;
+    extend_vocab(&vocab, vocab.size * cfg.scale);
+    long long bigrams = cfg.ngrams > 0 ? cfg.ngrams * 2 / 3 : 2000LL * cfg.scale;
+    long long trigrams = cfg.ngrams > 0 ? cfg.ngrams - bigrams : 1000LL * cfg.scale;
+
+    char uni_path[512], bi_path[512], tri_path[512];
+    snprintf(uni_path, sizeof(uni_path), "%s/bench_unigrams.csv", cfg.workdir);
+    snprintf(bi_path, sizeof(bi_path), "%s/bench_bigrams.csv", cfg.workdir);
+    snprintf(tri_path, sizeof(tri_path), "%s/bench_trigrams.csv", cfg.workdir);
+    if (write_synthetic_csv(uni_path, &vocab, 1, vocab.size) != 0
+        || write_synthetic_csv(bi_path, &vocab, 2, bigrams) != 0
+        || write_synthetic_csv(tri_path, &vocab, 3, trigrams) != 0) {
+        return 1;
+    }
+
+    // Stage: CSV loading through the original loaders
+    ngram_model *model = (ngram_model *)malloc(sizeof(ngram_model));
+    init_ngram_model(model, 3);
+    set_ngram_filter(model, cfg.filter_fpr, 0);
+    double t0 = now_ns();
+    process_csv_file(uni_path, &model->unigrams);
+    if (stage_enabled(&cfg, "load_unigrams")) report("load_unigrams", vocab.size, now_ns() - t0, NULL, 0);
+
+    model->tables[2] = createBPlusTree();
+    model->tables[3] = createBPlusTree();
+    t0 = now_ns();
+    readCSVAndInsert(model->tables[2], bi_path);
+    readCSVAndInsert(model->tables[3], tri_path);
+    if (cfg.compact && cfg.pack) {
+        compact_ngram_model(model);
+    } else if (cfg.compact) {
+        compactBPlusTree(model->tables[2]);
+        compactBPlusTree(model->tables[3]);
+    }
+    if (stage_enabled(&cfg, "load_ngrams")) {
+        report("load_ngrams", bigrams + trigrams, now_ns() - t0, NULL, 0);
+        printf("{\"stage\":\"table_memory\",\"bytes\":%lld,\"filter_bytes\":%zu}\n",
+               bPlusTreeMemoryUsage(model->tables[2]) + bPlusTreeMemoryUsage(model->tables[3]),
+               ngram_filter_memory_usage(model));
+    }
+    open_hw_counters();
+
+    // Per-op inputs are prepared up front so only the measured call is timed
+    wp_options opts;
+    wp_default_options(&opts);
+    opts.cache_capacity = 1 << 16;
+    opts.numa = cfg.numa;
+    bench_ctx ctx;
+    ctx.engine = wp_open_model(model, &opts);
+    if (ctx.engine == NULL) {
+        return 1;
+    }
+    ctx.model = model = wp_current_model(ctx.engine);                                   // Interleaving replaces the model
+    ctx.queries = malloc(sizeof(*ctx.queries) * cfg.ops);
+    ctx.contexts = malloc(sizeof(*ctx.contexts) * cfg.ops);
+
+    if (stage_enabled(&cfg, "trie_lookup")) {
+        for (int i = 0; i < cfg.ops; i++) strcpy(ctx.queries[i], vocab.words[skewed_index(vocab.size)]);
+        run_stage("trie_lookup", cfg.ops, op_trie_lookup, &ctx);
+    }
+    if (stage_enabled(&cfg, "prefix")) {
+        for (int i = 0; i < cfg.ops; i++) {
+            const char *w = vocab.words[skewed_index(vocab.size)];
+            int len = (int)strlen(w);
+            snprintf(ctx.queries[i], MAX_TOKEN_LEN, "%.*s", len > 2 ? len - 2 : len, w);
+        }
+        run_stage("prefix", cfg.ops, op_prefix, &ctx);
+    }
+    if (stage_enabled(&cfg, "fuzzy")) {
+        int fuzzy_ops = cfg.ops / 20 > 0 ? cfg.ops / 20 : 1;                           // Each call walks the whole trie
+        for (int i = 0; i < fuzzy_ops; i++) misspell(vocab.words[skewed_index(vocab.size)], ctx.queries[i]);
+        run_stage("fuzzy", fuzzy_ops, op_fuzzy, &ctx);
+    }
+    if (stage_enabled(&cfg, "btree_search")) {
+        for (int i = 0; i < cfg.ops; i++) {
+            ctx.contexts[i][0] = vocab.words[skewed_index(vocab.size)];
+            ctx.contexts[i][1] = vocab.words[skewed_index(vocab.size)];
+        }
+        run_stage("btree_search", cfg.ops, op_btree_search, &ctx);
+    }
+    if (stage_enabled(&cfg, "btree_scan")) {
+        // Sequential read bandwidth: walk every trigram in key order
+        long long keys = 0, sum = 0;
+        BTreeCursor cursor;
+        t0 = now_ns();
+        for (int more = bPlusTreeFirst(model->tables[3], &cursor); more; more = bPlusTreeNext(&cursor)) {
+            sum += cursor.count;
+            keys++;
+        }
+        double elapsed = now_ns() - t0;
+        volatile long long sink = sum;                                                  // Keep the reads
+        (void)sink;
+        report("btree_scan", keys, elapsed, NULL, 0);
+    }
+    if (stage_enabled(&cfg, "backoff")) {
+        for (int i = 0; i < cfg.ops; i++) {
+            ctx.contexts[i][0] = vocab.words[rand() % vocab.size];                      // Uniform pairs: mostly unseen contexts
+            ctx.contexts[i][1] = vocab.words[rand() % vocab.size];
+        }
+        run_stage("backoff", cfg.ops, op_backoff, &ctx);
+    }
+    if (stage_enabled(&cfg, "end_to_end")) {
+        for (int i = 0; i < cfg.ops; i++) {
+            char typo[MAX_TOKEN_LEN];
+            misspell(vocab.words[skewed_index(vocab.size)], typo);
+            snprintf(ctx.queries[i], BENCH_QUERY_LEN, "%s %s %s",
+                     typo, vocab.words[skewed_index(vocab.size)], vocab.words[skewed_index(vocab.size)]);
+        }
+        run_stage("end_to_end", cfg.ops, op_end_to_end, &ctx);
+
+        // Same queries from every socket: with replicas each node reads its own copy, without them
+        // every node but the loader's pays remote latency
+        if (cfg.per_node) {
+            numa_topology topo;
+            numa_discover(&topo);
+            for (int node = 0; node < topo.num_nodes; node++) {
+                char stage[32];
+                snprintf(stage, sizeof(stage), "end_to_end_node%d", node);
+                numa_pin_to_node(&topo, node);
+                for (int i = 0; i < cfg.ops; i++) op_end_to_end(&ctx, i);                   // Warm this node's spell cache
+                run_stage(stage, cfg.ops, op_end_to_end, &ctx);
+            }
+            numa_pin_to_node(&topo, NUMA_ANY_NODE);
+        }
+    }
+
+    if (stage_enabled(&cfg, "keystrokes")) {
+        // Phrases typed one character at a time: every op is the input after one more key press
+        int filled = 0;
+        while (filled < cfg.ops) {
+            char phrase[BENCH_QUERY_LEN];
+            int len = snprintf(phrase, sizeof(phrase), "%s %s %s", vocab.words[skewed_index(vocab.size)],
+                               vocab.words[skewed_index(vocab.size)], vocab.words[skewed_index(vocab.size)]);
+            for (int j = 1; j <= len && j < BENCH_QUERY_LEN && filled < cfg.ops; j++) {
+                memcpy(ctx.queries[filled], phrase, (size_t)j);
+                ctx.queries[filled++][j] = '\0';
+            }
+        }
+        run_stage("keystrokes", cfg.ops, op_keystroke, &ctx);
+        wp_session_init(&ctx.session, ctx.engine);
+        run_stage("keystrokes_session", cfg.ops, op_keystroke_session, &ctx);
+        printf("{\"stage\":\"keystrokes_session_state\",\"reuses\":%lld,\"rebuilds\":%lld}\n",
+               ctx.session.reuses, ctx.session.rebuilds);
+        wp_session_free(&ctx.session);
+    }
+
+    if (cfg.trace) trace_dump(stdout);
+
+    free(ctx.queries);
+    free(ctx.contexts);
+    wp_close(ctx.engine);
+    for (int i = 0; i < vocab.size; i++) free(vocab.words[i]);
+    free(vocab.words);
+    return 0;
+}
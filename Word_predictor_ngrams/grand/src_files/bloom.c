@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bloom.h"
+
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+// Finaliser of MurmurHash3: spreads every input bit over the whole word
+static unsigned long long mix(unsigned long long hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Pick the block from the high bits of the mixed hash (multiply-shift, no modulo)
+static size_t block_of(const bloom_filter *filter, unsigned long long hash) {
+    return (size_t)(((unsigned __int128)mix(hash) * filter->num_blocks) >> 64);
+}
+
+// Bit positions inside the block, 9 bits per probe, independent of the block choice
+static unsigned long long probe_bits(unsigned long long hash) {
+    return mix(hash ^ 0x9e3779b97f4a7c15ULL);
+}
+
+// Size for expected_keys: m = -n ln p / ln^2 2 bits, k = m / n ln 2 probes
+int bloom_init(bloom_filter *filter, size_t expected_keys, double fpr, size_t max_bytes) {
+    filter->words = NULL;
+    filter->num_blocks = 0;
+    filter->num_probes = 0;
+    if (!(fpr > 0.0 && fpr < 1.0)) {
+        return -1;
+    }
+    if (expected_keys == 0) expected_keys = 1;
+    double bits = -(double)expected_keys * log(fpr) / (M_LN2 * M_LN2);
+    size_t blocks = (size_t)ceil(bits / BLOOM_BLOCK_BITS);
+    if (max_bytes > 0 && blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t) > max_bytes) {
+        blocks = max_bytes / (BLOOM_BLOCK_WORDS * sizeof(uint64_t));                    // Over budget: accept a higher rate
+    }
+    if (blocks == 0) blocks = 1;
+    int probes = (int)lround((double)(blocks * BLOOM_BLOCK_BITS) / (double)expected_keys * M_LN2);
+    if (probes < 1) probes = 1;
+    if (probes > BLOOM_MAX_PROBES) probes = BLOOM_MAX_PROBES;
+
+    size_t bytes = blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+    void *memory = NULL;
+    if (posix_memalign(&memory, BLOOM_BLOCK_WORDS * sizeof(uint64_t), bytes) != 0) {
+        return -1;
+    }
+    memset(memory, 0, bytes);
+    filter->words = (uint64_t *)memory;
+    filter->num_blocks = blocks;
+    filter->num_probes = probes;
+    return 0;
+}
+
+void bloom_add(bloom_filter *filter, unsigned long long hash) {
+    uint64_t *block = filter->words + block_of(filter, hash) * BLOOM_BLOCK_WORDS;
+    unsigned long long bits = probe_bits(hash);
+    for (int i = 0; i < filter->num_probes; i++, bits >>= 9) {
+        unsigned int bit = (unsigned int)(bits & (BLOOM_BLOCK_BITS - 1));
+        block[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+int bloom_may_contain(const bloom_filter *filter, unsigned long long hash) {
+    const uint64_t *block = filter->words + block_of(filter, hash) * BLOOM_BLOCK_WORDS;
+    unsigned long long bits = probe_bits(hash);
+    for (int i = 0; i < filter->num_probes; i++, bits >>= 9) {
+        unsigned int bit = (unsigned int)(bits & (BLOOM_BLOCK_BITS - 1));
+        if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) return 0;
+    }
+    return 1;
+}
+
+size_t bloom_memory_usage(const bloom_filter *filter) {
+    return filter->num_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+void bloom_free(bloom_filter *filter) {
+    free(filter->words);
+    filter->words = NULL;
+    filter->num_blocks = 0;
+    filter->num_probes = 0;
+}
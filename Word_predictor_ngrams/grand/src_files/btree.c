@@ -1,7 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "../header_files/btree.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include "btree.h"
+#include "log.h"
+#include "trace.h"
 
 
 void init_bt_pq(bt_priority_q *bt_q) {
@@ -71,12 +77,175 @@ BPlusTree* createBPlusTree() {
     BPlusTree *tree = (BPlusTree*)malloc(sizeof(BPlusTree));
     tree->root = NULL;
     tree->totalNgramsCount = 0;
+    tree->arena = NULL;
+    tree->arenaNodes = 0;
+    tree->packed = NULL;
     return tree;
 }
 
-// Create a new B+ tree node (leaf or internal)
+// Pack the first 8 bytes of a key big-endian (zero padded past the NUL), so comparing two
+// prefixes as integers gives the same order as strcmp on those bytes
+static inline unsigned long long packKeyPrefix(const char* key) {
+    unsigned long long prefix = 0;
+    int i = 0;
+    for (; i < 8 && key[i] != '\0'; i++) {
+        prefix = (prefix << 8) | (unsigned char)key[i];
+    }
+    return i == 8 || i == 0 ? prefix : prefix << (8 * (8 - i));
+}
+
+// Store a key in slot i together with its packed prefix
+static inline void setKey(BTreeNode* node, int i, const char* key) {
+    strcpy(node->keys[i], key);
+    node->keyPrefix[i] = packKeyPrefix(key);
+}
+
+// Copy slot si of src into slot di of dst
+static inline void copyKey(BTreeNode* dst, int di, const BTreeNode* src, int si) {
+    strcpy(dst->keys[di], src->keys[si]);
+    dst->keyPrefix[di] = src->keyPrefix[si];
+}
+
+// Compare a query with key i of a node; the full strings are only read when the prefixes tie
+static inline int compareKey(const char* query, unsigned long long queryPrefix, const BTreeNode* node, int i) {
+    if (queryPrefix != node->keyPrefix[i]) {
+        return queryPrefix < node->keyPrefix[i] ? -1 : 1;
+    }
+    return strcmp(query, node->keys[i]);
+}
+
+// Binary search: index of the first key that is >= query (numKeys if there is none)
+static int lowerBound(const BTreeNode* node, const char* query, unsigned long long queryPrefix) {
+    int lo = 0, hi = node->numKeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compareKey(query, queryPrefix, node, mid) > 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Prefetch the lines a search reads first: the header and the whole keyPrefix array
+static inline void prefetchNode(const BTreeNode* node) {
+    const char* base = (const char*)node;
+    size_t hot = offsetof(BTreeNode, counts);
+    for (size_t offset = 0; offset < hot; offset += 64) {
+        __builtin_prefetch(base + offset);
+    }
+}
+
+// Block b of a packed table
+static inline const unsigned char* packedBlock(const BTreePacked* packed, long b) {
+    return packed->blocks + (size_t)b * BTREE_BLOCK_BYTES;
+}
+
+// Native u16 at p (block header fields and restart offsets)
+static inline int readU16(const unsigned char* p) {
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Key bytes of a restart entry (it shares nothing, so the suffix is the whole key)
+static inline const unsigned char* restartKey(const unsigned char* entry, int* length) {
+    const unsigned char* p = entry + 2;
+    while (*p & 0x80) p++;                                                              // Skip the count
+    *length = entry[1];
+    return p + 1;
+}
+
+// Decode one entry on top of the previous key held in key; returns the next entry
+static inline const unsigned char* decodeEntry(const unsigned char* p, char* key, int* length, int* count) {
+    int shared = p[0], suffix = p[1];
+    unsigned int value = 0;
+    int shift = 0;
+    p += 2;
+    while (*p & 0x80) {
+        value |= (unsigned int)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    value |= (unsigned int)*p++ << shift;
+    memcpy(key + shared, p, (size_t)suffix);
+    key[shared + suffix] = '\0';
+    *length = shared + suffix;
+    *count = (int)value;
+    return p + suffix;
+}
+
+// strcmp order between a query and length-delimited key bytes
+static inline int compareBytes(const char* query, int queryLength, const unsigned char* key, int length) {
+    int cmp = memcmp(query, key, (size_t)(queryLength < length ? queryLength : length));
+    return cmp != 0 ? cmp : queryLength - length;
+}
+
+// Position the cursor of a packed table on the first key >= query. Returns 0 if every key is smaller
+static int packedSeek(const BPlusTree* tree, const char* query, BTreeCursor* cursor) {
+    const BTreePacked* packed = tree->packed;
+    int queryLength = (int)strlen(query);
+    unsigned long long queryPrefix = packKeyPrefix(query);
+
+    // Last block whose first key is <= query (the first block if the query sorts before everything)
+    long lo = 0, hi = packed->numBlocks;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        int cmp;
+        if (queryPrefix != packed->firstPrefix[mid]) {
+            cmp = queryPrefix < packed->firstPrefix[mid] ? -1 : 1;
+        } else {
+            const unsigned char* block = packedBlock(packed, mid);
+            int length;
+            const unsigned char* key = restartKey(block + readU16(block + 4), &length);
+            cmp = compareBytes(query, queryLength, key, length);
+        }
+        if (cmp >= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    long b = lo > 0 ? lo - 1 : 0;
+    const unsigned char* block = packedBlock(packed, b);
+
+    // Last restart point whose key is <= query
+    int numRestarts = readU16(block + 2);
+    int rlo = 0, rhi = numRestarts;
+    while (rlo < rhi) {
+        int mid = (rlo + rhi) / 2;
+        int length;
+        const unsigned char* key = restartKey(block + readU16(block + 4 + 2 * mid), &length);
+        if (compareBytes(query, queryLength, key, length) >= 0) {
+            rlo = mid + 1;
+        } else {
+            rhi = mid;
+        }
+    }
+    int r = rlo > 0 ? rlo - 1 : 0;
+
+    // Decode forward from there; the answer is at most one block boundary away
+    cursor->tree = tree;
+    cursor->leaf = NULL;
+    cursor->block = b;
+    cursor->pos = block + readU16(block + 4 + 2 * r);
+    cursor->left = readU16(block) - r * BTREE_RESTART_INTERVAL;
+    while (bPlusTreeNext(cursor)) {
+        if (compareBytes(query, queryLength, (const unsigned char*)cursor->key, cursor->length) <= 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Create a new B+ tree node (leaf or internal), page aligned and BTREE_NODE_BYTES long
 BTreeNode* createNode(int isLeaf) {
-    BTreeNode* node = (BTreeNode*)malloc(sizeof(BTreeNode));
+    void* memory = NULL;
+    if (posix_memalign(&memory, 4096, BTREE_NODE_BYTES) != 0) {
+        printf("Memory allocation failed!\n");
+        return NULL;
+    }
+    BTreeNode* node = (BTreeNode*)memory;
     node->isLeaf = isLeaf; // Specify if this is a leaf node
     node->numKeys = 0;     // No keys initially
     node->next = NULL;     // No link to the next node yet
@@ -88,31 +257,31 @@ BTreeNode* createNode(int isLeaf) {
 
 // Insert an n-gram into a leaf node
 void insertIntoLeaf(BTreeNode* node, const char* ngram, int count) {
-    int i;
+    unsigned long long prefix = packKeyPrefix(ngram);
+    int i = lowerBound(node, ngram, prefix);
 
     // Check if the n-gram already exists in the node
-    for (i = 0; i < node->numKeys; i++) {
-        if (strcmp(node->keys[i], ngram) == 0) {
-            node->counts[i] += count; // If found, update its count
-            return;
-        }
+    if (i < node->numKeys && compareKey(ngram, prefix, node, i) == 0) {
+        node->counts[i] += count; // If found, update its count
+        return;
     }
 
-    // Insert the new n-gram in sorted order
-    for (i = node->numKeys - 1; i >= 0 && strcmp(node->keys[i], ngram) > 0; i--) {
-        strcpy(node->keys[i + 1], node->keys[i]); // Shift keys to make space
-        node->counts[i + 1] = node->counts[i];
-    }
+    // Insert the new n-gram in sorted order, shifting the larger keys one slot right
+    int tail = node->numKeys - i;
+    memmove(node->keys[i + 1], node->keys[i], (size_t)tail * MAX_KEY_LEN);
+    memmove(&node->keyPrefix[i + 1], &node->keyPrefix[i], (size_t)tail * sizeof(node->keyPrefix[0]));
+    memmove(&node->counts[i + 1], &node->counts[i], (size_t)tail * sizeof(node->counts[0]));
 
-    strcpy(node->keys[i + 1], ngram); // Insert the new n-gram
-    node->counts[i + 1] = count;
+    strcpy(node->keys[i], ngram); // Insert the new n-gram
+    node->keyPrefix[i] = prefix;
+    node->counts[i] = count;
     node->numKeys++; // Increase the key count
 }
 
 // function to Split a leaf node when it overflows
 BTreeNode* splitLeaf(BTreeNode* leaf, const char* ngram, int count) {
     BTreeNode* newLeaf = createNode(1); // Create a new leaf node
-    char tempKeys[MAX_KEYS + 1][200];   // Temporary array for keys
+    char tempKeys[MAX_KEYS + 1][MAX_KEY_LEN];   // Temporary array for keys
     int tempCounts[MAX_KEYS + 1];       // Temporary array for counts
 
     int i, j;
@@ -138,11 +307,11 @@ BTreeNode* splitLeaf(BTreeNode* leaf, const char* ngram, int count) {
     newLeaf->numKeys = MAX_KEYS + 1 - splitIndex;
 
     for (i = 0; i < leaf->numKeys; i++) {
-        strcpy(leaf->keys[i], tempKeys[i]);
+        setKey(leaf, i, tempKeys[i]);
         leaf->counts[i] = tempCounts[i];
     }
     for (j = 0; j < newLeaf->numKeys; j++) {
-        strcpy(newLeaf->keys[j], tempKeys[splitIndex + j]);
+        setKey(newLeaf, j, tempKeys[splitIndex + j]);
         newLeaf->counts[j] = tempCounts[splitIndex + j];
     }
 
@@ -161,7 +330,7 @@ BTreeNode* splitInternal(BTreeNode* node, int* promotedIndex) {
     // Transfer the second half of keys and children to the new internal node
     newInternal->numKeys = MAX_KEYS - midIndex - 1;
     for (int i = 0; i < newInternal->numKeys; i++) {
-        strcpy(newInternal->keys[i], node->keys[midIndex + 1 + i]);
+        copyKey(newInternal, i, node, midIndex + 1 + i);
         newInternal->children[i] = node->children[midIndex + 1 + i];
     }
     newInternal->children[newInternal->numKeys] = node->children[MAX_KEYS];
@@ -171,14 +340,34 @@ BTreeNode* splitInternal(BTreeNode* node, int* promotedIndex) {
 }
 
 
-BTreeNode* insertRecursive(BTreeNode* root, const char* ngram, int count, char* promotedKey, int* promotedCount, BTreeNode** newChild) {
+// Index of the child to descend into: separators are the first key of their right subtree,
+// so a key equal to a separator belongs to the right
+static int childIndex(const BTreeNode* node, const char* query, unsigned long long queryPrefix) {
+    int lo = 0, hi = node->numKeys;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (compareKey(query, queryPrefix, node, mid) >= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+BTreeNode* insertRecursive(BTreeNode* root, const char* ngram, int count, char* promotedKey, BTreeNode** newChild) {
     if (root->isLeaf) {
-        // Insert the n-gram into the leaf node
-        insertIntoLeaf(root, ngram, count);
+        unsigned long long prefix = packKeyPrefix(ngram);
+        int i = lowerBound(root, ngram, prefix);
+        if (i < root->numKeys && compareKey(ngram, prefix, root, i) == 0) {
+            root->counts[i] += count; // Existing n-gram: only the count changes
+            return root;
+        }
 
-        // Check if the leaf node exceeds the maximum allowed keys
-        if (root->numKeys == MAX_KEYS) {
-            // Split the leaf node and promote a key to the parent
+        if (root->numKeys < MAX_KEYS) {
+            insertIntoLeaf(root, ngram, count);
+        } else {
+            // The leaf is full: split it around the new n-gram and promote the right half's first key
             BTreeNode* newLeaf = splitLeaf(root, ngram, count);
             strcpy(promotedKey, newLeaf->keys[0]);
             *newChild = newLeaf;
@@ -186,21 +375,20 @@ BTreeNode* insertRecursive(BTreeNode* root, const char* ngram, int count, char*
         }
     } else {
         // Traverse to the appropriate child node
-        int i = 0;
-        while (i < root->numKeys && strcmp(ngram, root->keys[i]) > 0) i++;
+        int i = childIndex(root, ngram, packKeyPrefix(ngram));
 
         // Recursively insert into the selected child
         BTreeNode* tempNewChild = NULL;
-        char tempPromotedKey[200];
-        BTreeNode* result = insertRecursive(root->children[i], ngram, count, tempPromotedKey, promotedCount, &tempNewChild);
+        char tempPromotedKey[MAX_KEY_LEN];
+        insertRecursive(root->children[i], ngram, count, tempPromotedKey, &tempNewChild);
 
         if (tempNewChild != NULL) {
             // If a child split occurred, adjust the current node
             for (int j = root->numKeys; j > i; j--) {
-                strcpy(root->keys[j], root->keys[j - 1]);
+                copyKey(root, j, root, j - 1);
                 root->children[j + 1] = root->children[j];
             }
-            strcpy(root->keys[i], tempPromotedKey);
+            setKey(root, i, tempPromotedKey);
             root->children[i + 1] = tempNewChild;
             root->numKeys++;
 
@@ -219,23 +407,24 @@ BTreeNode* insertRecursive(BTreeNode* root, const char* ngram, int count, char*
 
 // Function to insert an n-gram into the B+ Tree
 void insertBPlusTree(BPlusTree* tree, const char* ngram, int count) {
+    if (tree->packed != NULL) {
+        unpackBPlusTree(tree);
+    }
     if (tree->root == NULL) {
         // Create a root node if the tree is empty
         tree->root = createNode(1);
     }
 
-    char promotedKey[200];
-    int promotedCount = 0;
+    char promotedKey[MAX_KEY_LEN];
     BTreeNode* newChild = NULL;
 
     // Call the recursive insert function
-    BTreeNode* newRoot = insertRecursive(tree->root, ngram, count, promotedKey, &promotedCount, &newChild);
+    insertRecursive(tree->root, ngram, count, promotedKey, &newChild);
 
     if (newChild != NULL) {
         // If the root was split, create a new root node
-        newRoot = createNode(0);
-        strcpy(newRoot->keys[0], promotedKey);
-        newRoot->counts[0] = promotedCount;
+        BTreeNode* newRoot = createNode(0);
+        setKey(newRoot, 0, promotedKey);
         newRoot->children[0] = tree->root;
         newRoot->children[1] = newChild;
         newRoot->numKeys = 1;
@@ -246,6 +435,280 @@ void insertBPlusTree(BPlusTree* tree, const char* ngram, int count) {
     tree->totalNgramsCount += count;
 }
 
+// Nodes inside the arena are freed with it, everything else was allocated on its own
+static int inArena(const BPlusTree* tree, const BTreeNode* node) {
+    const char* base = (const char*)tree->arena;
+    const char* p = (const char*)node;
+    return base != NULL && p >= base && p < base + tree->arenaNodes * BTREE_NODE_BYTES;
+}
+
+// Drop a node that was unlinked from the tree (arena slots are reclaimed by the next compaction)
+static void releaseNode(BPlusTree* tree, BTreeNode* node) {
+    if (!inArena(tree, node)) {
+        free(node);
+    }
+}
+
+// Minimum occupancy outside the root; a split leaves at least this many keys on both sides
+static int minKeys(const BTreeNode* node) {
+    return node->isLeaf ? MAX_KEYS / 2 : (MAX_KEYS - 1) / 2;
+}
+
+// Remove key i (and, for internal nodes, the child to its right) by shifting the tail left
+static void removeKeyAt(BTreeNode* node, int i) {
+    int tail = node->numKeys - i - 1;
+    memmove(node->keys[i], node->keys[i + 1], (size_t)tail * MAX_KEY_LEN);
+    memmove(&node->keyPrefix[i], &node->keyPrefix[i + 1], (size_t)tail * sizeof(node->keyPrefix[0]));
+    if (node->isLeaf) {
+        memmove(&node->counts[i], &node->counts[i + 1], (size_t)tail * sizeof(node->counts[0]));
+    } else {
+        memmove(&node->children[i + 1], &node->children[i + 2], (size_t)tail * sizeof(node->children[0]));
+    }
+    node->numKeys--;
+}
+
+// Move the first key of right to the end of left (through the parent separator for internal nodes)
+static void borrowFromRight(BTreeNode* parent, int sep, BTreeNode* left, BTreeNode* right) {
+    if (left->isLeaf) {
+        copyKey(left, left->numKeys, right, 0);
+        left->counts[left->numKeys] = right->counts[0];
+        left->numKeys++;
+        removeKeyAt(right, 0);
+        copyKey(parent, sep, right, 0);
+    } else {
+        copyKey(left, left->numKeys, parent, sep);
+        left->children[left->numKeys + 1] = right->children[0];
+        left->numKeys++;
+        copyKey(parent, sep, right, 0);
+        memmove(&right->children[0], &right->children[1], sizeof(right->children[0]));
+        removeKeyAt(right, 0);
+    }
+}
+
+// Move the last key of left to the front of right (through the parent separator for internal nodes)
+static void borrowFromLeft(BTreeNode* parent, int sep, BTreeNode* left, BTreeNode* right) {
+    int n = right->numKeys;
+    memmove(right->keys[1], right->keys[0], (size_t)n * MAX_KEY_LEN);
+    memmove(&right->keyPrefix[1], &right->keyPrefix[0], (size_t)n * sizeof(right->keyPrefix[0]));
+    if (right->isLeaf) {
+        memmove(&right->counts[1], &right->counts[0], (size_t)n * sizeof(right->counts[0]));
+        copyKey(right, 0, left, left->numKeys - 1);
+        right->counts[0] = left->counts[left->numKeys - 1];
+        copyKey(parent, sep, right, 0);
+    } else {
+        memmove(&right->children[1], &right->children[0], (size_t)(n + 1) * sizeof(right->children[0]));
+        copyKey(right, 0, parent, sep);
+        right->children[0] = left->children[left->numKeys];
+        copyKey(parent, sep, left, left->numKeys - 1);
+    }
+    right->numKeys++;
+    left->numKeys--;
+}
+
+// Append right to left, drop separator sep from the parent and release right
+static void mergeNodes(BPlusTree* tree, BTreeNode* parent, int sep, BTreeNode* left, BTreeNode* right) {
+    if (left->isLeaf) {
+        for (int i = 0; i < right->numKeys; i++) {
+            copyKey(left, left->numKeys + i, right, i);
+            left->counts[left->numKeys + i] = right->counts[i];
+        }
+        left->numKeys += right->numKeys;
+        left->next = right->next;
+    } else {
+        copyKey(left, left->numKeys, parent, sep);
+        for (int i = 0; i < right->numKeys; i++) {
+            copyKey(left, left->numKeys + 1 + i, right, i);
+        }
+        for (int i = 0; i <= right->numKeys; i++) {
+            left->children[left->numKeys + 1 + i] = right->children[i];
+        }
+        left->numKeys += right->numKeys + 1;
+    }
+    removeKeyAt(parent, sep);
+    releaseNode(tree, right);
+}
+
+// Bring child c of parent back to minimum occupancy: merge with a sibling when both fit in one
+// node, otherwise borrow keys from the fuller sibling. Handles any deficit, not just one key
+static void fixChild(BPlusTree* tree, BTreeNode* parent, int c) {
+    BTreeNode* child = parent->children[c];
+    while (child->numKeys < minKeys(child) && parent->numKeys > 0) {
+        int sep = c > 0 ? c - 1 : c;                                                    // Separator between the pair
+        BTreeNode* left = parent->children[sep];
+        BTreeNode* right = parent->children[sep + 1];
+        int combined = left->numKeys + right->numKeys + (left->isLeaf ? 0 : 1);
+        if (combined <= MAX_KEYS) {
+            mergeNodes(tree, parent, sep, left, right);
+            return;
+        }
+        if (child == left) {
+            borrowFromRight(parent, sep, left, right);
+        } else {
+            borrowFromLeft(parent, sep, left, right);
+        }
+    }
+}
+
+// Collapse a root that lost all of its keys
+static void shrinkRoot(BPlusTree* tree) {
+    BTreeNode* root = tree->root;
+    if (root == NULL || root->numKeys > 0) return;
+    tree->root = root->isLeaf ? NULL : root->children[0];
+    releaseNode(tree, root);
+}
+
+// Recursive helper: lowers the count of ngram by amount and removes it when nothing is left,
+// rebalancing every underfull child on the way back up. Returns 1 if the n-gram was found
+static int decrementRecursive(BPlusTree* tree, BTreeNode* node, const char* ngram, unsigned long long prefix, int amount, int* remaining) {
+    if (node->isLeaf) {
+        int i = lowerBound(node, ngram, prefix);
+        if (i >= node->numKeys || compareKey(ngram, prefix, node, i) != 0) {
+            return 0;
+        }
+        if (node->counts[i] > amount) {
+            node->counts[i] -= amount;
+            tree->totalNgramsCount -= amount;
+            *remaining = node->counts[i];
+        } else {
+            tree->totalNgramsCount -= node->counts[i];
+            removeKeyAt(node, i);
+            *remaining = 0;
+        }
+        return 1;
+    }
+    int c = childIndex(node, ngram, prefix);
+    int found = decrementRecursive(tree, node->children[c], ngram, prefix, amount, remaining);
+    if (found && node->children[c]->numKeys < minKeys(node->children[c])) {
+        fixChild(tree, node, c);
+    }
+    return found;
+}
+
+// Lower the count of one n-gram, removing it once the count reaches zero
+int decrementNGram(BPlusTree* tree, const char* ngram, int amount) {
+    if (tree != NULL && tree->packed != NULL && amount > 0) {
+        unpackBPlusTree(tree);
+    }
+    if (tree == NULL || tree->root == NULL || amount <= 0) {
+        return tree != NULL && amount <= 0 ? searchExactNGram(tree, ngram) : 0;
+    }
+    int remaining = 0;
+    decrementRecursive(tree, tree->root, ngram, packKeyPrefix(ngram), amount, &remaining);
+    shrinkRoot(tree);
+    return remaining;
+}
+
+// Remove one n-gram whatever its count
+int deleteNGram(BPlusTree* tree, const char* ngram) {
+    int count = searchExactNGram(tree, ngram);
+    if (count > 0) {
+        decrementNGram(tree, ngram, count);
+    }
+    return count;
+}
+
+// Post-order pass that fixes the underfull nodes left behind by a bulk update; returns the
+// number of repairs so the caller can run another pass when a repair exposed a new deficit
+static long rebalanceSubtree(BPlusTree* tree, BTreeNode* node) {
+    if (node->isLeaf) return 0;
+    long repairs = 0;
+    for (int c = 0; c <= node->numKeys; c++) {
+        repairs += rebalanceSubtree(tree, node->children[c]);
+    }
+    int c = 0;
+    while (c <= node->numKeys && node->numKeys > 0) {
+        if (node->children[c]->numKeys < minKeys(node->children[c])) {
+            int before = node->numKeys;
+            fixChild(tree, node, c);
+            repairs++;
+            if (node->numKeys < before) {
+                if (c > 0) c--;                                                         // Recheck the merged node
+                continue;
+            }
+        }
+        c++;
+    }
+    return repairs;
+}
+
+// Order deltas by key; equal keys keep their input order
+static int compareDeltas(const void* a, const void* b) {
+    const ngram_delta* x = (const ngram_delta*)a;
+    const ngram_delta* y = (const ngram_delta*)b;
+    int cmp = strcmp(x->ngram, y->ngram);
+    return cmp != 0 ? cmp : (x < y ? -1 : x > y);
+}
+
+// Apply a batch of count changes with one walk along the leaf chain
+long applyNGramDeltas(BPlusTree* tree, ngram_delta* deltas, int numDeltas) {
+    if (tree == NULL || numDeltas <= 0) return 0;
+    if (tree->packed != NULL && unpackBPlusTree(tree) != 0) return -1;
+    qsort(deltas, (size_t)numDeltas, sizeof(ngram_delta), compareDeltas);
+
+    int* inserts = (int*)malloc(sizeof(int) * (size_t)numDeltas);                       // New n-grams, placed afterwards
+    if (inserts == NULL) return -1;
+    int numInserts = 0, underfull = 0;
+    long changed = 0;
+
+    BTreeNode* leaf = tree->root;
+    if (leaf != NULL) {
+        unsigned long long prefix = packKeyPrefix(deltas[0].ngram);
+        while (!leaf->isLeaf) {
+            leaf = leaf->children[childIndex(leaf, deltas[0].ngram, prefix)];
+        }
+    }
+
+    for (int d = 0; d < numDeltas; d++) {
+        const char* key = deltas[d].ngram;
+        if (strlen(key) >= MAX_KEY_LEN) continue;                                       // Cannot be stored
+        unsigned long long prefix = packKeyPrefix(key);
+
+        // Several updates of one n-gram collapse into their sum, kept in the last of them
+        while (d + 1 < numDeltas && strcmp(deltas[d + 1].ngram, key) == 0) {
+            deltas[d + 1].delta += deltas[d].delta;
+            key = deltas[++d].ngram;
+        }
+
+        // Keys are unique and both sequences sorted, so a leaf whose last key is smaller never matches again
+        while (leaf != NULL && (leaf->numKeys == 0 || compareKey(key, prefix, leaf, leaf->numKeys - 1) > 0)) {
+            if (leaf->next != NULL) prefetchNode(leaf->next);
+            leaf = leaf->next;
+        }
+        int i = leaf != NULL ? lowerBound(leaf, key, prefix) : 0;
+        if (leaf == NULL || compareKey(key, prefix, leaf, i) != 0) {
+            if (deltas[d].delta > 0) inserts[numInserts++] = d;
+            continue;
+        }
+
+        long long updated = (long long)leaf->counts[i] + deltas[d].delta;
+        if (updated > 0) {
+            if (updated > INT_MAX) updated = INT_MAX;
+            tree->totalNgramsCount += updated - leaf->counts[i];
+            leaf->counts[i] = (int)updated;
+        } else {
+            tree->totalNgramsCount -= leaf->counts[i];
+            removeKeyAt(leaf, i);
+            if (leaf->numKeys < minKeys(leaf)) underfull = 1;
+        }
+        changed++;
+    }
+
+    long repairs = underfull;
+    while (repairs > 0 && tree->root != NULL) {
+        repairs = rebalanceSubtree(tree, tree->root);
+        while (tree->root != NULL && tree->root->numKeys == 0) {
+            shrinkRoot(tree);
+        }
+    }
+    for (int k = 0; k < numInserts; k++) {
+        const ngram_delta* delta = &deltas[inserts[k]];
+        insertBPlusTree(tree, delta->ngram, delta->delta > INT_MAX ? INT_MAX : (int)delta->delta);
+        changed++;
+    }
+    free(inserts);
+    return changed;
+}
+
 // Function to read n-grams and counts from a CSV file and insert them into the B+ Tree
 void readCSVAndInsert(BPlusTree* tree, const char* filename) {
     FILE* file = fopen(filename, "r");
@@ -270,87 +733,592 @@ void readCSVAndInsert(BPlusTree* tree, const char* filename) {
 
 // Function to list all n-grams in the B+ Tree in ascending order
 void listAllNgrams(BPlusTree* tree) {
-    if (tree->root == NULL) return;
+    BTreeCursor cursor;
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        printf("%s: %d\n", cursor.key, cursor.count);
+    }
+}
+
+// Function to search for bigrams or trigrams in the B+ Tree
+void searchNGrams(BPlusTree* tree, const char* firstWord, const char* secondWord, bt_priority_q* result) {
+    if (tree->root == NULL && tree->packed == NULL) {
+        printf("The tree is empty.\n");
+        return;
+    }
+
+    // A bigram search has a one-word context, a trigram search a two-word context
+    const char* context[2] = { firstWord, secondWord };
+    searchNGramsContext(tree, context, secondWord == NULL ? 1 : 2, result);
+}
 
-    // Navigate to the leftmost leaf node
+// Collect every key that starts with prefix: one seek to the lower bound, then one bounded scan
+static void scanKeyPrefix(BPlusTree* tree, const char* prefix, size_t prefixLen, bt_priority_q* result) {
+    TRACE_BEGIN(start);
+    unsigned long long nodesVisited = 0, leavesScanned = 0;
+
+    // Packed table: seek to the first key >= prefix, then decode while the keys still match
+    if (tree->packed != NULL) {
+        BTreeCursor cursor;
+        int more = packedSeek(tree, prefix, &cursor);
+        long firstBlock = cursor.block;
+        for (; more; more = bPlusTreeNext(&cursor)) {
+            if ((size_t)cursor.length < prefixLen || memcmp(cursor.key, prefix, prefixLen) != 0) {
+                break; // Past the end of the matching run
+            }
+            insert_bt_pq(result, cursor.key, cursor.count);
+        }
+        leavesScanned = (unsigned long long)(cursor.block - firstBlock + 1);
+        TRACE_COUNT(TRACE_BTREE_LEAVES, leavesScanned);
+        TRACE_END(TRACE_SEARCH, start);
+        (void)leavesScanned;
+        return;
+    }
+
+    unsigned long long queryPrefix = packKeyPrefix(prefix);
+
+    // Navigate to the leftmost leaf that can hold the prefix, fetching each child's hot lines
+    // as soon as it is chosen
     BTreeNode* current = tree->root;
     while (!current->isLeaf) {
-        current = current->children[0];
+        current = current->children[childIndex(current, prefix, queryPrefix)];
+        prefetchNode(current);
+        nodesVisited++;
     }
 
-    // Traverse the leaf nodes and print their contents
-    while (current != NULL) {
-        for (int i = 0; i < current->numKeys; i++) {
-            printf("%s: %d\n", current->keys[i], current->counts[i]);
+    // Keys are sorted, so the matches form one contiguous run of the leaf chain starting at the
+    // lower bound; the next leaf is prefetched while the current one is scanned
+    int i = lowerBound(current, prefix, queryPrefix);
+    int done = 0;
+    while (current != NULL && !done) {
+        leavesScanned++;
+        if (current->next != NULL) {
+            prefetchNode(current->next);
         }
-        current = current->next;  // Move to the next leaf node
+        for (; i < current->numKeys; i++) {
+            if (strncmp(current->keys[i], prefix, prefixLen) != 0) {
+                done = 1; // Past the end of the matching run
+                break;
+            }
+            insert_bt_pq(result, current->keys[i], current->counts[i]);
+        }
+        current = current->next; // Move to the next leaf node
+        i = 0;
     }
+
+    TRACE_COUNT(TRACE_BTREE_NODES, nodesVisited);
+    TRACE_COUNT(TRACE_BTREE_LEAVES, leavesScanned);
+    TRACE_END(TRACE_SEARCH, start);
+    (void)nodesVisited;
+    (void)leavesScanned;
 }
 
-// Function to search for bigrams or trigrams in the B+ Tree
-void searchNGrams(BPlusTree* tree, const char* firstWord, const char* secondWord, bt_priority_q* result) {
-    if (tree->root == NULL) {
-        printf("The tree is empty.\n");
+// Build "w1 w2 ... wk " + word into key; returns its length, or 0 if no key of the tree can be that long
+static size_t contextKey(const char* context[], int contextLen, const char* word, char* key) {
+    size_t keyLen = 0;
+    for (int i = 0; i < contextLen; i++) {
+        size_t wordLen = strlen(context[i]);
+        if (keyLen + wordLen + 2 > MAX_KEY_LEN) {
+            return 0;
+        }
+        memcpy(key + keyLen, context[i], wordLen);
+        keyLen += wordLen;
+        key[keyLen++] = ' ';
+    }
+    size_t wordLen = strlen(word);
+    if (keyLen + wordLen + 1 > MAX_KEY_LEN) {
+        return 0;
+    }
+    memcpy(key + keyLen, word, wordLen + 1);
+    return keyLen + wordLen;
+}
+
+// Function to search for all n-grams that continue the given context words
+void searchNGramsContext(BPlusTree* tree, const char* context[], int contextLen, bt_priority_q* result) {
+    if ((tree->root == NULL && tree->packed == NULL) || contextLen <= 0) {
         return;
     }
 
+    // The key prefix "w1 w2 ... wk " shared by every matching n-gram
+    char prefix[MAX_KEY_LEN];
+    size_t prefixLen = contextKey(context, contextLen, "", prefix);
+    if (prefixLen == 0) {
+        return; // Context is longer than any key the tree can hold
+    }
+    scanKeyPrefix(tree, prefix, prefixLen, result);
+}
+
+// Function to search for the n-grams that continue the context with a word starting with wordPrefix
+void searchNGramsCompletion(BPlusTree* tree, const char* context[], int contextLen, const char* wordPrefix, bt_priority_q* result) {
+    if ((tree->root == NULL && tree->packed == NULL) || contextLen <= 0) {
+        return;
+    }
+
+    // "w1 w2 ... wk pre" bounds the run on both sides: it starts at the first continuation with the
+    // prefix and ends at the first key that no longer shares it
+    char prefix[MAX_KEY_LEN];
+    size_t prefixLen = contextKey(context, contextLen, wordPrefix, prefix);
+    if (prefixLen == 0) {
+        return;
+    }
+    scanKeyPrefix(tree, prefix, prefixLen, result);
+}
+
+// Function to look up the count of one exact n-gram (0 if it is not stored)
+int searchExactNGram(BPlusTree* tree, const char* ngram) {
+    if (tree == NULL) {
+        return 0;
+    }
+    if (tree->packed != NULL) {
+        BTreeCursor cursor;
+        return packedSeek(tree, ngram, &cursor) && strcmp(cursor.key, ngram) == 0 ? cursor.count : 0;
+    }
+    if (tree->root == NULL) {
+        return 0;
+    }
+
+    unsigned long long queryPrefix = packKeyPrefix(ngram);
     BTreeNode* current = tree->root;
+    while (!current->isLeaf) {
+        current = current->children[childIndex(current, ngram, queryPrefix)];
+        prefetchNode(current);
+    }
+
+    // Separators are never larger than the first key of their right subtree, so the key is in this
+    // leaf; the loop only moves on when the leaf is empty
+    while (current != NULL) {
+        int i = lowerBound(current, ngram, queryPrefix);
+        if (i < current->numKeys) {
+            return compareKey(ngram, queryPrefix, current, i) == 0 ? current->counts[i] : 0;
+        }
+        current = current->next;
+    }
+    return 0;
+}
+
+// Count the nodes below (and including) the given node
+static long long countNodes(const BTreeNode* node) {
+    if (node == NULL) return 0;
+    long long nodes = 1;
+    if (!node->isLeaf) {
+        for (int i = 0; i <= node->numKeys; i++) {
+            nodes += countNodes(node->children[i]);
+        }
+    }
+    return nodes;
+}
+
+// Bytes held by the tree: every node plus the tree header
+long long bPlusTreeMemoryUsage(const BPlusTree* tree) {
+    if (tree == NULL) return 0;
+    if (tree->packed != NULL) {
+        return (long long)(sizeof(BPlusTree) + sizeof(BTreePacked))
+             + (long long)tree->packed->numBlocks * (BTREE_BLOCK_BYTES + (long long)sizeof(unsigned long long));
+    }
+    return (long long)sizeof(BPlusTree) + countNodes(tree->root) * (long long)BTREE_NODE_BYTES;
+}
+
+// Recursively free a node and all of its children
+static void freeNode(BPlusTree* tree, BTreeNode* node) {
+    if (node == NULL) return;
+    if (!node->isLeaf) {
+        for (int i = 0; i <= node->numKeys; i++) {
+            freeNode(tree, node->children[i]);
+        }
+    }
+    releaseNode(tree, node);
+}
+
+// The arena slot of the k-th node in layout order
+static BTreeNode* arenaNode(BTreeNode* arena, long long k) {
+    return (BTreeNode*)((char*)arena + k * BTREE_NODE_BYTES);
+}
 
-    // Navigate to the appropriate leaf node
+// Copy the tree into one region in breadth-first order. The tree is balanced, so the last
+// level of the BFS is exactly the leaf chain in key order
+int compactBPlusTree(BPlusTree* tree) {
+    if (tree == NULL || tree->root == NULL) return 0;                                   // Empty or packed
+    long long n = countNodes(tree->root);
+    size_t bytes = (size_t)n * BTREE_NODE_BYTES;
+    size_t alignment = bytes >= (2u << 20) ? (2u << 20) : 4096;                         // Let large tables use huge pages
+    void* memory = NULL;
+    BTreeNode** order = (BTreeNode**)malloc(sizeof(BTreeNode*) * (size_t)n);
+    if (order == NULL || posix_memalign(&memory, alignment, bytes) != 0) {
+        free(order);
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    if (alignment > 4096) madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+    BTreeNode* arena = (BTreeNode*)memory;
+
+    // order[] doubles as the BFS queue: a node's children get the next free positions
+    long long tail = 0;
+    order[tail++] = tree->root;
+    for (long long k = 0; k < n; k++) {
+        BTreeNode* old = order[k];
+        BTreeNode* copy = arenaNode(arena, k);
+        size_t used = offsetof(BTreeNode, keys) + (size_t)old->numKeys * MAX_KEY_LEN;   // Unused key slots are not copied
+        memcpy(copy, old, used);
+        if (!old->isLeaf) {
+            for (int i = 0; i <= old->numKeys; i++) {
+                copy->children[i] = arenaNode(arena, tail);
+                order[tail++] = old->children[i];
+            }
+        } else {
+            copy->next = k + 1 < n ? arenaNode(arena, k + 1) : NULL;
+        }
+    }
+
+    // Release the old nodes (and an older arena) now that nothing points to them
+    for (long long k = 0; k < n; k++) {
+        if (!inArena(tree, order[k])) free(order[k]);
+    }
+    free(order);
+    free(tree->arena);
+    tree->arena = arena;
+    tree->arenaNodes = n;
+    tree->root = arena;
+    return 0;
+}
+
+// Block being filled by packBPlusTree
+typedef struct {
+    unsigned char entries[BTREE_BLOCK_BYTES];
+    int used;                             // Bytes of entries written.
+    int numKeys;
+    int numRestarts;
+    uint16_t restarts[BTREE_BLOCK_BYTES / 4];// Entry offsets of the restart points.
+    char last[MAX_KEY_LEN];               // Previous key, the base of the next entry's front coding.
+    int lastLength;
+    unsigned long long firstPrefix;
+} BlockBuilder;
+
+// Bytes of a count as a varint
+static int varintLength(unsigned int value) {
+    int length = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        length++;
+    }
+    return length;
+}
+
+// Write the block out (when out is set) and start an empty one
+static void flushBlock(BlockBuilder* b, unsigned char* out, unsigned long long* firstPrefix, long index) {
+    if (out != NULL) {
+        unsigned char* block = out + (size_t)index * BTREE_BLOCK_BYTES;
+        int header = 4 + 2 * b->numRestarts;
+        uint16_t fields[2] = { (uint16_t)b->numKeys, (uint16_t)b->numRestarts };
+        memcpy(block, fields, sizeof(fields));
+        for (int r = 0; r < b->numRestarts; r++) {
+            uint16_t offset = (uint16_t)(header + b->restarts[r]);
+            memcpy(block + 4 + 2 * r, &offset, sizeof(offset));
+        }
+        memcpy(block + header, b->entries, (size_t)b->used);
+        memset(block + header + b->used, 0, (size_t)(BTREE_BLOCK_BYTES - header - b->used));
+        firstPrefix[index] = b->firstPrefix;
+    }
+    b->used = 0;
+    b->numKeys = 0;
+    b->numRestarts = 0;
+    b->lastLength = 0;
+}
+
+// Append one key to the block; returns 0 if it does not fit (the caller flushes and retries)
+static int appendEntry(BlockBuilder* b, const char* key, int length, int count) {
+    int restart = b->numKeys % BTREE_RESTART_INTERVAL == 0;
+    int shared = 0;
+    if (!restart) {
+        while (shared < length && shared < b->lastLength && key[shared] == b->last[shared]) shared++;
+    }
+    unsigned int value = (unsigned int)count;
+    int size = 2 + varintLength(value) + (length - shared);
+    if (b->numKeys > 0 && 4 + 2 * (b->numRestarts + restart) + b->used + size > BTREE_BLOCK_BYTES) {
+        return 0;
+    }
+
+    if (restart) b->restarts[b->numRestarts++] = (uint16_t)b->used;
+    if (b->numKeys == 0) b->firstPrefix = packKeyPrefix(key);
+    unsigned char* p = b->entries + b->used;
+    *p++ = (unsigned char)shared;
+    *p++ = (unsigned char)(length - shared);
+    while (value >= 0x80) {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    memcpy(p, key + shared, (size_t)(length - shared));
+    b->used += size;
+    b->numKeys++;
+    memcpy(b->last, key, (size_t)length);
+    b->lastLength = length;
+    return 1;
+}
+
+// Encode every key of a node-form tree; with out == NULL only the blocks are counted
+static long encodeBlocks(const BPlusTree* tree, BlockBuilder* b, unsigned char* out, unsigned long long* firstPrefix) {
+    long numBlocks = 0;
+    BTreeCursor cursor;
+    flushBlock(b, NULL, NULL, 0);
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        if (!appendEntry(b, cursor.key, cursor.length, cursor.count)) {
+            flushBlock(b, out, firstPrefix, numBlocks++);
+            appendEntry(b, cursor.key, cursor.length, cursor.count);
+        }
+    }
+    if (b->numKeys > 0) {
+        flushBlock(b, out, firstPrefix, numBlocks++);
+    }
+    return numBlocks;
+}
+
+// Free a packed form
+static void freePacked(BTreePacked* packed) {
+    if (packed == NULL) return;
+    free(packed->blocks);
+    free(packed->firstPrefix);
+    free(packed);
+}
+
+// Encode the table into blocks, then drop the nodes
+int packBPlusTree(BPlusTree* tree) {
+    if (tree == NULL || tree->root == NULL) return 0;                                   // Empty or already packed
+    BlockBuilder* builder = (BlockBuilder*)malloc(sizeof(BlockBuilder));
+    BTreePacked* packed = (BTreePacked*)calloc(1, sizeof(BTreePacked));
+    if (builder == NULL || packed == NULL) {
+        free(builder);
+        free(packed);
+        return -1;
+    }
+    long numBlocks = encodeBlocks(tree, builder, NULL, NULL);
+    void* memory = NULL;
+    packed->firstPrefix = (unsigned long long*)malloc(sizeof(unsigned long long) * (size_t)(numBlocks > 0 ? numBlocks : 1));
+    if (packed->firstPrefix == NULL || posix_memalign(&memory, 4096, (size_t)(numBlocks > 0 ? numBlocks : 1) * BTREE_BLOCK_BYTES) != 0) {
+        free(builder);
+        freePacked(packed);
+        return -1;
+    }
+    packed->blocks = (unsigned char*)memory;
+    packed->numBlocks = encodeBlocks(tree, builder, packed->blocks, packed->firstPrefix);
+    free(builder);
+
+    BTreeCursor cursor;
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        packed->numKeys++;
+    }
+    freeNode(tree, tree->root);
+    free(tree->arena);
+    tree->root = NULL;
+    tree->arena = NULL;
+    tree->arenaNodes = 0;
+    tree->packed = packed;
+    return 0;
+}
+
+// Re-insert the packed keys in order, then lay the new nodes out contiguously
+int unpackBPlusTree(BPlusTree* tree) {
+    if (tree == NULL || tree->packed == NULL) return 0;
+    BTreePacked* packed = tree->packed;
+    BPlusTree view = { .packed = packed };                                              // Reads the blocks while the nodes are rebuilt
+    long long total = tree->totalNgramsCount;
+    tree->packed = NULL;
+
+    BTreeCursor cursor;
+    for (int more = bPlusTreeFirst(&view, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        insertBPlusTree(tree, cursor.key, cursor.count);
+    }
+    tree->totalNgramsCount = total;
+    freePacked(packed);
+    compactBPlusTree(tree);
+    return 0;
+}
+
+// Start a walk over the keys in order
+int bPlusTreeFirst(const BPlusTree* tree, BTreeCursor* cursor) {
+    cursor->tree = tree;
+    cursor->leaf = NULL;
+    cursor->index = -1;
+    cursor->block = -1;
+    cursor->left = 0;
+    if (tree == NULL) return 0;
+    if (tree->packed == NULL && tree->root != NULL) {
+        const BTreeNode* current = tree->root;
+        while (!current->isLeaf) {
+            current = current->children[0];
+        }
+        cursor->leaf = current;
+    }
+    return bPlusTreeNext(cursor);
+}
+
+// Start a walk at the first key >= key
+int bPlusTreeSeek(const BPlusTree* tree, const char* key, BTreeCursor* cursor) {
+    cursor->tree = tree;
+    cursor->leaf = NULL;
+    cursor->index = -1;
+    cursor->block = -1;
+    cursor->left = 0;
+    if (tree == NULL) return 0;
+    if (tree->packed != NULL) {
+        return packedSeek(tree, key, cursor);
+    }
+    if (tree->root == NULL) return 0;
+    unsigned long long keyPrefix = packKeyPrefix(key);
+    const BTreeNode* current = tree->root;
     while (!current->isLeaf) {
-        int i = 0;
-        while (i < current->numKeys && strcmp(firstWord, current->keys[i]) > 0) {
-            i++;
+        current = current->children[childIndex(current, key, keyPrefix)];
+    }
+    cursor->leaf = current;
+    cursor->index = lowerBound(current, key, keyPrefix) - 1;                            // bPlusTreeNext steps onto it
+    return bPlusTreeNext(cursor);
+}
+
+// Step to the next key: decode the next entry, or move to the next leaf slot
+int bPlusTreeNext(BTreeCursor* cursor) {
+    const BTreePacked* packed = cursor->tree->packed;
+    if (packed != NULL) {
+        if (cursor->left == 0) {
+            if (cursor->block + 1 >= packed->numBlocks) return 0;
+            const unsigned char* block = packedBlock(packed, ++cursor->block);
+            cursor->pos = block + 4 + 2 * readU16(block + 2);
+            cursor->left = readU16(block);
         }
-        current = current->children[i];
+        cursor->pos = decodeEntry(cursor->pos, cursor->key, &cursor->length, &cursor->count);
+        cursor->left--;
+        return 1;
     }
 
-    // Search for matching n-grams
-    while (current != NULL) {
-        for (int i = 0; i < current->numKeys; i++) {
-            char keyCopy[200];
-            strcpy(keyCopy, current->keys[i]);
+    cursor->index++;
+    while (cursor->leaf != NULL && cursor->index >= cursor->leaf->numKeys) {
+        cursor->leaf = cursor->leaf->next;
+        cursor->index = 0;
+    }
+    if (cursor->leaf == NULL) return 0;
+    cursor->length = (int)strlen(cursor->leaf->keys[cursor->index]);
+    memcpy(cursor->key, cursor->leaf->keys[cursor->index], (size_t)cursor->length + 1);
+    cursor->count = cursor->leaf->counts[cursor->index];
+    return 1;
+}
 
-            if (secondWord == NULL) { // Bigram search
-                if (strncmp(keyCopy, firstWord, strlen(firstWord)) == 0) {
-                    insert_bt_pq(result, current->keys[i], current->counts[i]);
-                }
-            } else { // Trigram search
-                char* token = strtok(keyCopy, " ");
-                char first[200], second[200];
-
-                if (token != NULL) {
-                    strcpy(first, token);
-                    token = strtok(NULL, " ");
-                    if (token != NULL) {
-                        strcpy(second, token);
-                        if (strcmp(first, firstWord) == 0 && strcmp(second, secondWord) == 0) {
-                            insert_bt_pq(result, current->keys[i], current->counts[i]);
-                        }
-                    }
-                }
+// Account one key in walk order: length histogram, count checks, strict ordering against the previous key
+static void statKey(BTreeStats* stats, char* prev, int* prevLength, const char* key, int length, int count) {
+    int bucket = 0;
+    while (bucket < BTREE_KEY_LEN_BUCKETS - 1 && length >= (8 << bucket)) bucket++;
+    stats->keyLengths[bucket]++;
+    if (count <= 0) stats->violations |= BTREE_CHECK_COUNT;
+    if (count > stats->maxCount) stats->maxCount = count;
+    stats->totalCount += count;
+    if (stats->keys > 0 && compareBytes(key, length, (const unsigned char*)prev, *prevLength) <= 0) {
+        stats->violations |= BTREE_CHECK_UNSORTED;
+    }
+    memcpy(prev, key, (size_t)length);
+    *prevLength = length;
+    stats->keys++;
+}
+
+// Check a subtree against the separators around it: every key k satisfies low <= k < high (NULL: unbounded)
+static void statNode(const BTreeNode* node, const char* low, const char* high, int depth, BTreeStats* stats) {
+    stats->nodes++;
+    stats->fill += node->numKeys;
+    for (int i = 0; i < node->numKeys; i++) {
+        if ((low != NULL && strcmp(node->keys[i], low) < 0) || (high != NULL && strcmp(node->keys[i], high) >= 0)
+            || node->keyPrefix[i] != packKeyPrefix(node->keys[i])) {
+            stats->violations |= BTREE_CHECK_SEPARATOR;
+        }
+        if (i > 0 && strcmp(node->keys[i - 1], node->keys[i]) >= 0) {
+            stats->violations |= BTREE_CHECK_UNSORTED;
+        }
+    }
+    if (node->isLeaf) {
+        if (stats->height == 0) stats->height = depth;
+        else if (stats->height != depth) stats->violations |= BTREE_CHECK_SHAPE;
+        return;
+    }
+    for (int i = 0; i <= node->numKeys; i++) {
+        statNode(node->children[i], i > 0 ? node->keys[i - 1] : low, i < node->numKeys ? node->keys[i] : high, depth + 1, stats);
+    }
+}
+
+// Node form: the recursive walk checks the separators, the leaf chain checks the global order
+static void statNodes(const BPlusTree* tree, BTreeStats* stats, char* prev, int* prevLength) {
+    if (tree->root == NULL) return;
+    statNode(tree->root, NULL, NULL, 1, stats);
+    stats->fill /= (double)stats->nodes * MAX_KEYS;
+    BTreeCursor cursor;
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        statKey(stats, prev, prevLength, cursor.key, cursor.length, cursor.count);
+    }
+}
+
+// Packed form: decode every block, checking its header and its index entry
+static void statBlocks(const BPlusTree* tree, BTreeStats* stats, char* prev, int* prevLength) {
+    const BTreePacked* packed = tree->packed;
+    char key[MAX_KEY_LEN];
+    long long used = 0;
+    for (long b = 0; b < packed->numBlocks; b++) {
+        const unsigned char* block = packedBlock(packed, b);
+        int numKeys = readU16(block), numRestarts = readU16(block + 2);
+        if (numKeys == 0 || numRestarts != (numKeys + BTREE_RESTART_INTERVAL - 1) / BTREE_RESTART_INTERVAL
+            || readU16(block + 4) != 4 + 2 * numRestarts) {
+            stats->violations |= BTREE_CHECK_SHAPE;
+            continue;                                                                   // Offsets cannot be trusted
+        }
+        const unsigned char* p = block + 4 + 2 * numRestarts;
+        for (int i = 0; i < numKeys && p < block + BTREE_BLOCK_BYTES; i++) {
+            int length, count;
+            p = decodeEntry(p, key, &length, &count);
+            if (i == 0 && packed->firstPrefix[b] != packKeyPrefix(key)) {
+                stats->violations |= BTREE_CHECK_SEPARATOR;
             }
+            statKey(stats, prev, prevLength, key, length, count);
         }
-        current = current->next; // Move to the next leaf node
+        used += p - block;
     }
+    stats->nodes = packed->numBlocks;
+    stats->fill = packed->numBlocks > 0 ? (double)used / ((double)packed->numBlocks * BTREE_BLOCK_BYTES) : 0.0;
+    if (stats->keys != packed->numKeys) stats->violations |= BTREE_CHECK_SHAPE;
+}
+
+// One pass over whichever form the tree is in
+void statBPlusTree(const BPlusTree* tree, BTreeStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (tree == NULL) return;
+    char prev[MAX_KEY_LEN];
+    int prevLength = 0;
+    if (tree->packed != NULL) {
+        statBlocks(tree, stats, prev, &prevLength);
+    } else {
+        statNodes(tree, stats, prev, &prevLength);
+    }
+    stats->bytes = bPlusTreeMemoryUsage(tree);
+}
+
+// Free every node of the B+ Tree and the tree itself
+void freeBPlusTree(BPlusTree* tree) {
+    if (tree == NULL) return;
+    freeNode(tree, tree->root);
+    free(tree->arena);
+    freePacked(tree->packed);
+    free(tree);
 }
 
 // Function to display unique suggestions with their context
 void display_unique_bt_q(bt_priority_q* bt_q, char* corrected_string) {
-    printf("\n[DEBUG] Displaying suggestions with context:\n");
+    TRACE_BEGIN(start);
+    LOG_DEBUG("Displaying suggestions with context");
     int printed[MAX_KEYS] = {0};  // Array to track printed n-grams
 
-    for (int i = 0; i < bt_q->top; i++) {
+    for (int i = 0; i <= bt_q->top; i++) {
         if (!printed[i]) {
             // Print the suggestion with the corrected context
             printf("\n-----------------------------------------------------\n");
-            printf("[DEBUG] Suggested n-gram: %s\n", bt_q->ngram[i]);
-            printf("[DEBUG] Count: %d\n", bt_q->count[i]);
-            printf("[DEBUG] Full Context: %s%s\n", corrected_string, bt_q->ngram[i]);
+            printf("Suggested n-gram: %s\n", bt_q->ngram[i]);
+            printf("Count: %d\n", bt_q->count[i]);
+            printf("Full Context: %s%s\n", corrected_string, bt_q->ngram[i]);
             printf("-----------------------------------------------------\n");
 
             // Mark duplicates as printed
-            for (int j = i + 1; j < bt_q->top; j++) {
+            for (int j = i + 1; j <= bt_q->top; j++) {
                 if (strcmp(bt_q->ngram[i], bt_q->ngram[j]) == 0) {
                     printed[j] = 1;
                 }
@@ -358,7 +1326,8 @@ void display_unique_bt_q(bt_priority_q* bt_q, char* corrected_string) {
         }
     }
 
-    if (bt_q->top == 0) {
-        printf("\n[DEBUG] No suggestions found.\n");
+    if (bt_q->top < 0) {
+        printf("\nNo suggestions found.\n");
     }
-}
\ No newline at end of file
+    TRACE_END(TRACE_DISPLAY, start);
+}
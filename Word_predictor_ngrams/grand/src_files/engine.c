@@ -0,0 +1,713 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "engine.h"
+#include "tokenizer.h"
+#include "ranking.h"
+#include "log.h"
+
+#define ENGINE_STACK_INPUT 512      // Inputs shorter than this are copied to the stack
+
+// Default CSV dataset for every order (orders without a shipped dataset are NULL)
+static const char *default_ngram_files[MAX_NGRAM_ORDER + 1] = {
+    NULL,
+    "./dataset/unigrams_4000.csv",
+    "./dataset/bigrams_2000.csv",
+    "./dataset/trigrams_1000.csv",
+    NULL,
+    NULL
+};
+
+void wp_default_options(wp_options *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->source.order = 3;
+    opts->source.snapshot = NULL;
+    memcpy(opts->source.files, default_ngram_files, sizeof(opts->source.files));
+    opts->source.filter_fpr = NGRAM_FILTER_FPR;
+    opts->cache_capacity = 4096;
+    opts->noisy_channel = 1;
+}
+
+wp_engine *wp_open(const wp_options *opts) {
+    ngram_source source = opts->source;
+    if (opts->num_shards > 0) {
+        source.shard = NGRAM_SHARD_NONE;                                               // The shards hold the n-grams
+        source.num_shards = opts->num_shards;
+    }
+    ngram_model *model = load_ngram_model(&source);
+    if (model == NULL) {
+        return NULL;
+    }
+    wp_engine *engine = wp_open_model(model, opts);
+    if (engine == NULL) {
+        free_ngram_model(model);
+        free(model);
+    }
+    return engine;
+}
+
+// Spell cache and noisy channel ranker over a model, allocated by the calling thread. The ranker's
+// vocabulary hangs off the model's trie, so it is freed with the model
+static int init_local_state(ngram_model *model, const wp_options *opts, spell_cache *cache, int *has_cache) {
+    *has_cache = 0;
+    if (opts->cache_capacity <= 0) {
+        return 0;
+    }
+    if (spell_cache_init(cache, opts->cache_capacity) != 0) {
+        return -1;
+    }
+    *has_cache = 1;
+    if (opts->noisy_channel) {
+        attach_ranking_vocab(&model->unigrams);                                         // Without one the fuzzy step ranks by probability
+    }
+    return 0;
+}
+
+typedef struct {
+    wp_engine *engine;
+    const wp_options *opts;
+    int node;
+    wp_replica *replica;                            // Result (NULL if it could not be built).
+} replica_job;
+
+// Build one node's replica on a thread pinned to that node, so first touch places every page locally
+static void *build_replica(void *arg) {
+    replica_job *job = (replica_job *)arg;
+    job->replica = NULL;
+    if (numa_pin_to_node(&job->engine->numa, job->node) != 0) {
+        return NULL;
+    }
+    wp_replica *replica = (wp_replica *)calloc(1, sizeof(wp_replica));
+    if (replica == NULL) return NULL;
+    replica->model = clone_ngram_model(wp_current_model(job->engine));
+    if (replica->model == NULL || init_local_state(replica->model, job->opts, &replica->cache, &replica->has_cache) != 0) {
+        if (replica->model != NULL) {
+            free_ngram_model(replica->model);
+            free(replica->model);
+        }
+        free(replica);
+        return NULL;
+    }
+    job->replica = replica;
+    return NULL;
+}
+
+// One replica per node other than the home node, built in parallel. A node whose replica fails
+// keeps reading the home copy
+static void build_replicas(wp_engine *engine, const wp_options *opts) {
+    pthread_t threads[NUMA_MAX_NODES];
+    replica_job jobs[NUMA_MAX_NODES];
+    int started[NUMA_MAX_NODES] = {0};
+    for (int node = 0; node < engine->numa.num_nodes; node++) {
+        if (node == engine->home_node) continue;
+        jobs[node].engine = engine;
+        jobs[node].opts = opts;
+        jobs[node].node = node;
+        started[node] = pthread_create(&threads[node], NULL, build_replica, &jobs[node]) == 0;
+    }
+    for (int node = 0; node < engine->numa.num_nodes; node++) {
+        if (!started[node]) continue;
+        pthread_join(threads[node], NULL);
+        engine->replicas[node] = jobs[node].replica;
+        if (jobs[node].replica == NULL) LOG_WARN("No model replica on NUMA node %d", node);
+    }
+}
+
+// Whether some node reads a replica instead of the published generations
+static int has_replicas(const wp_engine *engine) {
+    for (int node = 0; node < NUMA_MAX_NODES; node++) {
+        if (engine->replicas[node] != NULL) return 1;
+    }
+    return 0;
+}
+
+wp_engine *wp_open_model(ngram_model *model, const wp_options *opts) {
+    wp_engine *engine = (wp_engine *)calloc(1, sizeof(wp_engine));
+    if (engine == NULL) {
+        return NULL;
+    }
+    engine->numa_mode = opts->numa;
+    if (engine->numa_mode != WP_NUMA_OFF) {
+        numa_discover(&engine->numa);
+        engine->home_node = numa_current_node(&engine->numa);
+    } else {
+        engine->numa.num_nodes = 1;
+    }
+    if (opts->num_shards > 0) {
+        engine->router = (shard_router *)malloc(sizeof(shard_router));
+        if (engine->router == NULL || shard_router_open(engine->router, opts->shards, opts->num_shards) != 0) {
+            free(engine->router);
+            free(engine);
+            return NULL;
+        }
+    }
+
+    // Interleave: copy the model under an interleaving policy; the caller's model is only released
+    // once nothing can fail any more
+    ngram_model *spread = NULL;
+    if (engine->numa_mode == WP_NUMA_INTERLEAVE && engine->numa.num_nodes > 1
+        && numa_interleave_begin(&engine->numa) == 0) {
+        spread = clone_ngram_model(model);
+        numa_interleave_end();
+    }
+    ngram_model *first = spread != NULL ? spread : model;
+    if (init_local_state(first, opts, &engine->cache, &engine->has_cache) != 0
+        || model_store_init(&engine->store, first) != 0) {
+        if (engine->has_cache) spell_cache_destroy(&engine->cache);
+        if (engine->router != NULL) shard_router_close(engine->router);
+        free(engine->router);
+        if (spread != NULL) {
+            free_ngram_model(spread);
+            free(spread);
+        }
+        free(engine);
+        return NULL;
+    }
+    if (spread != NULL) {
+        free_ngram_model(model);
+        free(model);
+    }
+    engine->source = opts->source;
+    if (opts->num_shards > 0) {
+        engine->source.shard = NGRAM_SHARD_NONE;                                       // Same dictionary-only source as wp_open
+        engine->source.num_shards = opts->num_shards;
+    }
+    if (engine->numa_mode == WP_NUMA_REPLICATE && engine->numa.num_nodes > 1) {
+        build_replicas(engine, opts);
+    }
+
+    // Learning publishes generations of the local model only: replicas and shards would not see them
+    engine->learning = opts->learn_interval_ms > 0 && engine->router == NULL && !has_replicas(engine);
+    if (engine->learning && model_store_start_merger(&engine->store, opts->learn_interval_ms) != 0) {
+        LOG_WARN("No background merges; learned counts wait for wp_merge");
+    }
+    return engine;
+}
+
+ngram_model *wp_current_model(wp_engine *engine) {
+    return atomic_load(&engine->store.current);
+}
+
+// What one call reads: the model and spell cache of the calling thread's node
+typedef struct {
+    ngram_model *model;
+    spell_cache *cache;
+    int slot;                                       // The thread's reader slot holding the generation (-1: a replica, nothing held).
+} engine_view;
+
+// Enter a call: its node's replica when there is one, otherwise the current generation, held
+// through the calling thread's reader slot until leave_engine so a reload cannot free it midway.
+// Returns -1 when more than MAX_READER_SLOTS threads read the engine
+static int enter_engine(wp_engine *engine, engine_view *view) {
+    wp_replica *replica = engine->numa_mode == WP_NUMA_REPLICATE ? engine->replicas[numa_current_node(&engine->numa)] : NULL;
+    if (replica != NULL) {
+        view->model = replica->model;
+        view->cache = replica->has_cache ? &replica->cache : NULL;
+        view->slot = -1;
+        return 0;
+    }
+    view->slot = model_store_thread_slot(&engine->store);                              // Claimed on the thread's first call, then kept
+    if (view->slot < 0) {
+        LOG_ERROR("More than %d threads read the engine", MAX_READER_SLOTS);
+        return -1;
+    }
+    view->model = (ngram_model *)model_store_acquire(&engine->store, view->slot);      // Published generations are never written
+    view->cache = engine->has_cache ? &engine->cache : NULL;
+    return 0;
+}
+
+// Leave a call: the generation may be freed from here on
+static void leave_engine(wp_engine *engine, engine_view *view) {
+    if (view->slot < 0) return;
+    model_store_release(&engine->store, view->slot);
+}
+
+int wp_parse_numa_mode(const char *name, wp_numa_mode *mode) {
+    static const char *names[] = { "off", "replicate", "interleave" };
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *mode = (wp_numa_mode)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int wp_pin_thread(wp_engine *engine, int index) {
+    if (engine->numa_mode == WP_NUMA_OFF || engine->numa.num_nodes <= 1) {
+        return -1;
+    }
+    int node = (index < 0 ? -index : index) % engine->numa.num_nodes;
+    return numa_pin_to_node(&engine->numa, node) == 0 ? node : -1;
+}
+
+// Private copy of the input: the tokenizer lowercases in place
+static char *copy_input(const char *text, size_t len, char *stack) {
+    char *input = len < ENGINE_STACK_INPUT ? stack : (char *)malloc(len + 1);
+    if (input != NULL) {
+        memcpy(input, text, len);
+        input[len] = '\0';
+    }
+    return input;
+}
+
+// Copy the result queue into out, best first, skipping repeated n-grams
+static int fill_suggestions(const bt_priority_q *q, int order, wp_suggestion out[], int k) {
+    int found = 0;
+    for (int i = 0; i <= q->top && found < k; i++) {
+        int duplicate = 0;
+        for (int j = 0; j < found && !duplicate; j++) {
+            duplicate = strcmp(out[j].ngram, q->ngram[i]) == 0;
+        }
+        if (duplicate) continue;
+
+        const char *last_space = strrchr(q->ngram[i], ' ');
+        const char *word = last_space != NULL ? last_space + 1 : q->ngram[i];
+
+        wp_suggestion *s = &out[found++];
+        strncpy(s->ngram, q->ngram[i], MAX_NGRAM_LEN - 1);
+        s->ngram[MAX_NGRAM_LEN - 1] = '\0';
+        strncpy(s->word, word, MAX_TOKEN_LEN - 1);
+        s->word[MAX_TOKEN_LEN - 1] = '\0';
+        s->count = q->count[i];
+        s->order = order;
+    }
+    return found;
+}
+
+// Trie node the word prefix leads to (NULL if no vocabulary word starts with it)
+static trie_node *prefix_node(const trie *unigrams, const char *prefix) {
+    trie_node *p = unigrams->root;
+    for (int i = 0; prefix[i] != '\0' && p != NULL; i++) {
+        int index = prefix[i] - 'a';
+        p = index >= 0 && index < 26 ? p->children[index] : NULL;
+    }
+    return p;
+}
+
+// Most frequent vocabulary words under the prefix's trie node, as order 1 suggestions
+static int complete_unigrams(const trie *unigrams, trie_node *node, const char *prefix, wp_suggestion out[], int k) {
+    if (node == NULL || prefix[0] == '\0') {
+        return 0;
+    }
+    priority_Q pq;
+    init_priority_Q(&pq);
+    char word[MAX_TOKEN_LEN];
+    strcpy(word, prefix);
+    collect_words(node, &pq, word, (int)strlen(prefix), unigrams->total_unigram_count);
+    int found = 0;
+    for (int i = 0; i < pq.size && found < k; i++) {
+        wp_suggestion *s = &out[found++];
+        strncpy(s->word, pq.words_collection[i].word, MAX_TOKEN_LEN - 1);
+        s->word[MAX_TOKEN_LEN - 1] = '\0';
+        strcpy(s->ngram, s->word);
+        s->count = (int)(pq.words_collection[i].prob * (double)unigrams->total_unigram_count + 0.5);
+        s->order = 1;
+    }
+    return found;
+}
+
+// Tokenize text and correct its context words into ctx. When completing and text does not end in a
+// delimiter, its last word is the partly typed prefix: it is kept as typed (not spell corrected) and
+// every word before it is context. Otherwise every word is context. Returns 0, or -1 on error
+static int read_context(const char *text, int complete, ngram_model *model, spell_cache *cache, wp_context *ctx) {
+    size_t len = strlen(text);
+    char stack[ENGINE_STACK_INPUT];
+    char *input = copy_input(text, len, stack);
+    if (input == NULL) {
+        return -1;
+    }
+
+    // The last (order - 1) words, oldest first, plus the prefix when completing
+    int max_context = model->order - 1;
+    if (max_context < 1) max_context = 1;
+    if (max_context > WP_MAX_CONTEXT_WORDS) max_context = WP_MAX_CONTEXT_WORDS;
+    int wanted = complete ? max_context + 1 : max_context;
+    token_span spans[WP_MAX_CONTEXT_WORDS + 1];
+    int words = last_word_spans(input, len, spans, wanted);
+    token_span *first = spans;
+    ctx->prefix[0] = '\0';
+    if (complete && words > 0 && (size_t)(first[words - 1].offset + first[words - 1].length) == len) {
+        span_to_string(input, &first[--words], ctx->prefix, sizeof(ctx->prefix));
+    }
+    if (words > max_context) {
+        first += words - max_context;                                                   // Ended in a delimiter: drop the extra word
+        words = max_context;
+    }
+
+    // Each context word is corrected with the previous one as context
+    char token[MAX_TOKEN_LEN];
+    ctx->num_words = words;
+    ctx->offset = words > 0 ? first[0].offset : (int)len;
+    ctx->order = 0;
+    for (int i = 0; i < words; i++) {
+        span_to_string(input, &first[i], token, sizeof(token));
+        word_element best = spell_cache_validate_context(cache, model, i > 0 ? ctx->words[i - 1] : NULL, token);
+        strcpy(ctx->words[i], best.word[0] != '\0' ? best.word : token);
+    }
+    if (input != stack) free(input);
+    return 0;
+}
+
+// Read the context, back off from the highest order, then complete a prefix nothing continued from
+// the vocabulary alone
+static int suggest_from(wp_engine *engine, const engine_view *view, const char *text, int complete, wp_suggestion out[],
+                        int k, wp_context *ctx) {
+    ngram_model *model = view->model;
+    if (read_context(text, complete, model, view->cache, ctx) != 0) {
+        return -1;
+    }
+    const char *context[WP_MAX_CONTEXT_WORDS];
+    for (int i = 0; i < ctx->num_words; i++) {
+        context[i] = ctx->words[i];
+    }
+
+    int found = 0;
+    if (ctx->num_words > 0) {
+        // The result queue is sorted by count
+        bt_priority_q q;
+        init_bt_pq(&q);
+        if (engine->router != NULL && complete) {
+            ctx->order = shard_router_complete(engine->router, model->order, context, ctx->num_words, ctx->prefix, &q);
+        } else if (engine->router != NULL) {
+            ctx->order = shard_router_predict(engine->router, model->order, context, ctx->num_words, &q);
+        } else if (complete) {
+            ctx->order = complete_ngrams(model, context, ctx->num_words, ctx->prefix, &q);
+        } else {
+            ctx->order = predict_ngrams(model, context, ctx->num_words, &q);
+        }
+        if (ctx->order < 0) {
+            ctx->order = 0;
+            free_bt_q(&q);
+            return -1;
+        }
+        found = fill_suggestions(&q, ctx->order, out, k);
+        free_bt_q(&q);
+    }
+
+    // No n-gram continues the context with this prefix: complete the word on its own
+    if (found == 0 && ctx->prefix[0] != '\0') {
+        found = complete_unigrams(&model->unigrams, prefix_node(&model->unigrams, ctx->prefix), ctx->prefix, out, k);
+        ctx->order = found > 0 ? 1 : 0;
+    }
+    return found;
+}
+
+// Shared by wp_predict and wp_complete: one generation from the first lookup to the last
+static int suggest(wp_engine *engine, const char *text, int complete, wp_suggestion out[], int k, wp_context *ctx) {
+    if (engine == NULL || text == NULL || k < 0) {
+        return -1;
+    }
+    wp_context local;
+    if (ctx == NULL) ctx = &local;
+    engine_view view;
+    if (enter_engine(engine, &view) != 0) {
+        return -1;
+    }
+    int found = suggest_from(engine, &view, text, complete, out, k, ctx);
+    leave_engine(engine, &view);
+    return found;
+}
+
+int wp_predict(wp_engine *engine, const char *text, wp_suggestion out[], int k, wp_context *ctx) {
+    return suggest(engine, text, 0, out, k, ctx);
+}
+
+int wp_complete(wp_engine *engine, const char *text, wp_suggestion out[], int k, wp_context *ctx) {
+    return suggest(engine, text, 1, out, k, ctx);
+}
+
+void wp_session_init(wp_session *session, wp_engine *engine) {
+    memset(session, 0, sizeof(*session));
+    session->engine = engine;
+}
+
+// Letters extend the partial word without changing how anything before them was tokenized
+static int is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Remember text as the input the session state describes
+static int session_store_text(wp_session *session, const char *text, size_t len) {
+    if (len + 1 > session->cap) {
+        size_t cap = session->cap > 0 ? session->cap : 64;
+        while (cap < len + 1) cap *= 2;
+        char *grown = (char *)realloc(session->text, cap);
+        if (grown == NULL) {
+            return -1;
+        }
+        session->text = grown;
+        session->cap = cap;
+    }
+    memcpy(session->text, text, len + 1);
+    session->len = len;
+    return 0;
+}
+
+// Full pass: tokenize and correct the whole input again and drop every range
+static int session_rebuild(wp_session *session, const engine_view *view, const char *text, size_t len) {
+    session->model = view->model;
+    session->generation = view->model->generation;
+    if (session_store_text(session, text, len) != 0 || read_context(text, 1, session->model, view->cache, &session->ctx) != 0) {
+        session->len = 0;
+        session->growable = 0;
+        return -1;
+    }
+    const wp_context *ctx = &session->ctx;
+    size_t prefix_len = strlen(ctx->prefix);
+    int letters = 1;
+    for (size_t i = 0; i < prefix_len && letters; i++) {
+        letters = ctx->prefix[i] >= 'a' && ctx->prefix[i] <= 'z';
+    }
+    // The partial word can only grow in place when it is all letters and ends the input, or when the
+    // input ends in whitespace (the next letter starts a new word)
+    session->growable = prefix_len > 0 ? letters && len > 0 && is_letter(text[len - 1])
+                                       : len == 0 || text[len - 1] == ' ' || text[len - 1] == '\t' || text[len - 1] == '\n';
+    session->node = prefix_node(&session->model->unigrams, ctx->prefix);
+    const char *context[WP_MAX_CONTEXT_WORDS];
+    for (int i = 0; i < ctx->num_words; i++) {
+        context[i] = ctx->words[i];
+    }
+    for (int n = 0; n <= MAX_NGRAM_ORDER; n++) {
+        session->range_state[n] = WP_RANGE_UNSET;
+        if (n >= 2 && n - 1 <= ctx->num_words && !ngram_context_may_exist(session->model, n, context + ctx->num_words - (n - 1))) {
+            session->range_state[n] = WP_RANGE_ABSENT;
+        }
+    }
+    session->rebuilds++;
+    return 0;
+}
+
+// Move the range of order n to the first key >= key. The key only grows, so the range only moves
+// forward: a short walk from where it stands, or a fresh seek once the walk gets long
+static void session_narrow(wp_session *session, int n, const char *key) {
+    BTreeCursor *cursor = &session->range[n];
+    if (session->range_state[n] == WP_RANGE_SET) {
+        int steps = 0;
+        while (strcmp(cursor->key, key) < 0) {
+            if (++steps > WP_SESSION_SKIP_LIMIT) {
+                session->range_state[n] = WP_RANGE_UNSET;
+                break;
+            }
+            if (!bPlusTreeNext(cursor)) {
+                session->range_state[n] = WP_RANGE_END;
+                return;
+            }
+        }
+    }
+    if (session->range_state[n] == WP_RANGE_UNSET) {
+        session->range_state[n] = bPlusTreeSeek(session->model->tables[n], key, cursor) ? WP_RANGE_SET : WP_RANGE_END;
+    }
+}
+
+// Back off over the session's ranges: for every order, the keys from its range start that still
+// carry "context prefix"
+static int session_search(wp_session *session, wp_suggestion out[], int k) {
+    wp_context *ctx = &session->ctx;
+    ngram_model *model = session->model;
+    ctx->order = 0;
+    int found = 0;
+    if (ctx->num_words > 0) {
+        int n = ctx->num_words + 1 < model->order ? ctx->num_words + 1 : model->order;
+        bt_priority_q q;
+        init_bt_pq(&q);
+        for (; n >= 2; n--) {
+            if (model->tables[n] == NULL || session->range_state[n] == WP_RANGE_ABSENT) {
+                continue;
+            }
+            char key[MAX_KEY_LEN];
+            size_t key_len = 0;
+            int fits = 1;
+            for (int i = ctx->num_words - (n - 1); i <= ctx->num_words && fits; i++) {
+                const char *word = i < ctx->num_words ? ctx->words[i] : ctx->prefix;
+                size_t word_len = strlen(word);
+                fits = key_len + word_len + 2 <= MAX_KEY_LEN;
+                if (fits) {
+                    memcpy(key + key_len, word, word_len);
+                    key_len += word_len;
+                    key[key_len++] = ' ';
+                }
+            }
+            if (!fits) {
+                continue;
+            }
+            key[--key_len] = '\0';                                                      // No space after the prefix
+            session_narrow(session, n, key);
+            if (session->range_state[n] == WP_RANGE_SET) {
+                BTreeCursor scan = session->range[n];
+                int more = 1;
+                while (more && (size_t)scan.length >= key_len && memcmp(scan.key, key, key_len) == 0) {
+                    insert_bt_pq(&q, scan.key, scan.count);
+                    more = bPlusTreeNext(&scan);
+                }
+            }
+            if (q.top >= 0) {
+                break;
+            }
+        }
+        ctx->order = n >= 2 ? n : 0;
+        found = fill_suggestions(&q, ctx->order, out, k);
+        free_bt_q(&q);
+    }
+    if (found == 0 && ctx->prefix[0] != '\0') {
+        found = complete_unigrams(&model->unigrams, session->node, ctx->prefix, out, k);
+        ctx->order = found > 0 ? 1 : 0;
+    }
+    return found;
+}
+
+int wp_session_complete(wp_session *session, const char *text, wp_suggestion out[], int k, wp_context *ctx) {
+    if (session == NULL || session->engine == NULL || text == NULL || k < 0) {
+        return -1;
+    }
+    if (session->engine->router != NULL) {
+        return wp_complete(session->engine, text, out, k, ctx);                         // The tables live in the shards
+    }
+
+    // Typed letters: one trie step and one narrowed range per letter, nothing read again. The kept
+    // cursors and trie node only hold while the call reads the generation they point into
+    engine_view view;
+    if (enter_engine(session->engine, &view) != 0) {
+        return -1;
+    }
+    size_t len = strlen(text);
+    size_t prefix_len = strlen(session->ctx.prefix);
+    int grows = session->model == view.model && session->generation == view.model->generation && session->growable && len > session->len
+                && len - session->len + prefix_len < MAX_TOKEN_LEN && memcmp(text, session->text, session->len) == 0;
+    for (size_t i = session->len; i < len && grows; i++) {
+        grows = is_letter(text[i]);
+    }
+    if (grows) {
+        for (size_t i = session->len; i < len; i++) {
+            char c = (char)(text[i] | 0x20);                                            // The tokenizer lowercases
+            session->ctx.prefix[prefix_len++] = c;
+            if (session->node != NULL) session->node = session->node->children[c - 'a'];
+        }
+        session->ctx.prefix[prefix_len] = '\0';
+        if (session->ctx.num_words == 0) session->ctx.offset = (int)len;                // No context word: it points past the input
+        if (session_store_text(session, text, len) != 0) {
+            leave_engine(session->engine, &view);
+            return -1;
+        }
+        session->reuses++;
+    } else if (session_rebuild(session, &view, text, len) != 0) {
+        leave_engine(session->engine, &view);
+        return -1;
+    }
+
+    int found = session_search(session, out, k);
+    leave_engine(session->engine, &view);
+    if (ctx != NULL) *ctx = session->ctx;
+    return found;
+}
+
+void wp_session_free(wp_session *session) {
+    free(session->text);
+    session->text = NULL;
+    session->len = session->cap = 0;
+    session->model = NULL;
+}
+
+int wp_correct(wp_engine *engine, const char *text, size_t len, char *out, size_t cap) {
+    if (engine == NULL || text == NULL) {
+        return -1;
+    }
+    char stack[ENGINE_STACK_INPUT];
+    char *input = copy_input(text, len, stack);
+    token_span *spans = (token_span *)malloc(sizeof(token_span) * (len / 2 + 1));       // Every token needs a delimiter after it
+    char *corrected = NULL;
+    if (input != NULL && spans != NULL) {
+        int num_spans = tokenize_spans(input, len, spans, (int)(len / 2 + 1));
+        engine_view view;
+        if (enter_engine(engine, &view) == 0) {
+            corrected = correct_spans(&view.model->unigrams, view.cache, input, spans, num_spans);
+            leave_engine(engine, &view);
+        }
+    }
+    free(spans);
+    if (input != stack) free(input);
+    if (corrected == NULL) {
+        return -1;
+    }
+
+    size_t used = strlen(corrected);
+    if (cap > 0) {
+        size_t n = used < cap - 1 ? used : cap - 1;
+        memcpy(out, corrected, n);
+        out[n] = '\0';
+    }
+    free(corrected);
+    return (int)used;
+}
+
+int wp_reload(wp_engine *engine) {
+    if (engine == NULL || has_replicas(engine)) {
+        return -1;                                                                      // Replicas would keep serving the old generation
+    }
+    return model_store_reload_async(&engine->store, &engine->source);
+}
+
+int wp_reload_wait(wp_engine *engine) {
+    return engine != NULL ? model_store_reload_wait(&engine->store) : -1;
+}
+
+int wp_learn(wp_engine *engine, const char *text) {
+    if (engine == NULL || text == NULL || !engine->learning) {
+        return -1;
+    }
+    size_t len = strlen(text);
+    int max_spans = (int)(len / 2 + 1);                                                 // Every token needs a delimiter after it
+    char stack[ENGINE_STACK_INPUT];
+    char *input = copy_input(text, len, stack);
+    token_span *spans = (token_span *)malloc(sizeof(token_span) * max_spans);
+    char (*words)[MAX_TOKEN_LEN] = malloc(sizeof(*words) * max_spans);
+    const char **run = (const char **)malloc(sizeof(char *) * max_spans);
+    int learned = -1;
+    if (input != NULL && spans != NULL && words != NULL && run != NULL) {
+        int num_spans = tokenize_spans(input, len, spans, max_spans);
+        if (num_spans > max_spans) num_spans = max_spans;
+        int num_run = 0;
+        learned = 0;
+        for (int i = 0; i <= num_spans; i++) {
+            if (i < num_spans && spans[i].kind == TOKEN_WORD) {
+                span_to_string(input, &spans[i], words[i], MAX_TOKEN_LEN);
+                run[num_run++] = words[i];
+                continue;
+            }
+            model_store_learn_words(&engine->store, run, num_run);                      // A number, a hashtag or the end closes the run
+            learned += num_run;
+            num_run = 0;
+        }
+    }
+    free(run);
+    free(words);
+    free(spans);
+    if (input != stack) free(input);
+    return learned;
+}
+
+long wp_merge(wp_engine *engine) {
+    if (engine == NULL || !engine->learning) {
+        return -1;
+    }
+    return model_store_merge(&engine->store);
+}
+
+void wp_close(wp_engine *engine) {
+    if (engine == NULL) return;
+    for (int node = 0; node < NUMA_MAX_NODES; node++) {
+        wp_replica *replica = engine->replicas[node];
+        if (replica == NULL) continue;
+        if (replica->has_cache) spell_cache_destroy(&replica->cache);
+        free_ngram_model(replica->model);
+        free(replica->model);
+        free(replica);
+    }
+    if (engine->has_cache) spell_cache_destroy(&engine->cache);
+    if (engine->router != NULL) {
+        shard_router_close(engine->router);
+        free(engine->router);
+    }
+    model_store_destroy(&engine->store);                                               // Waits for a running reload, stops the merger
+    free(engine);
+}
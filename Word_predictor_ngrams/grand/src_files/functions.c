@@ -4,7 +4,12 @@
 #include <ctype.h>
 #include <math.h>
 #include <stdbool.h>
-#include "../header_files/functions.h"
+#include <stdatomic.h>
+#include "functions.h"
+#include "spell_cache.h"
+#include "levenshtein.h"
+#include "log.h"
+#include "trace.h"
 
 // Initialize the priority queue to an empty state
 void init_priority_Q(priority_Q * pq) {
@@ -12,6 +17,8 @@ void init_priority_Q(priority_Q * pq) {
     return;
 }
 
+static atomic_ullong next_trie_serial = 1;                                                      // Serial of the next trie initialised
+
 // Initialize the trie structure for storing words
 void init_trie(trie * T) {
     T->root = (trie_node *)malloc(sizeof(trie_node));                                           // Create root node
@@ -21,6 +28,8 @@ void init_trie(trie * T) {
         T->root->children[i] = NULL;                                                            // Initialize all child pointers to NULL
     }
     T->total_unigram_count = 0;
+    T->serial = atomic_fetch_add(&next_trie_serial, 1);
+    T->vocab = NULL;
 }
 
 // Create a new trie node
@@ -36,6 +45,24 @@ trie_node * get_node() {
     return nn;
 }
 
+// Recursively free a trie node and all of its children
+void free_trie_node(trie_node * p) {
+    if (p == NULL) {
+        return;
+    }
+    for (int i = 0; i < 26; i++) {
+        free_trie_node(p->children[i]);
+    }
+    free(p);
+}
+
+// Free every node of the trie and reset it to an empty state
+void free_trie(trie * T) {
+    free_trie_node(T->root);
+    T->root = NULL;
+    T->total_unigram_count = 0;
+}
+
 // Insert a word into the trie with its occurrence count
 void insert_word(trie * T, const char * word, int count) {
     trie_node * p = T->root;
@@ -52,6 +79,30 @@ void insert_word(trie * T, const char * word, int count) {
     T->total_unigram_count += count;                                                            // Increment the total word count
 }
 
+// Lower a word's count; a word whose count reaches zero stops being a word (its nodes stay)
+int decrement_word(trie * T, const char * word, int amount) {
+    trie_node * p = T->root;
+    for (int i = 0; word[i] != '\0'; i++) {
+        int index = word[i] - 'a';
+        if (index < 0 || index >= 26 || p->children[index] == NULL) {
+            return 0;
+        }
+        p = p->children[index];
+    }
+    if (!p->isEndOfWord) {
+        return 0;
+    }
+    if (p->count > amount) {
+        p->count -= amount;
+        T->total_unigram_count -= amount;
+        return p->count;
+    }
+    T->total_unigram_count -= p->count;
+    p->count = 0;
+    p->isEndOfWord = false;
+    return 0;
+}
+
 // Process a CSV file to populate the trie with words and their counts
 //**
 void process_csv_file(const char *filename, trie *T) {
@@ -87,7 +138,7 @@ double is_unigram(trie T, const char *token, priority_Q *pq) {
     int i = 0, index;
     while (token[i] != '\0') {
         index = token[i] - 'a';
-        if (p->children[index] == NULL) {                                                   // If the path doesn't exist, return 0
+        if (index < 0 || index >= 26 || p->children[index] == NULL) {                       // If the path doesn't exist, return 0
             return 0.0;
         }
         p = p->children[index];                                                             // Move to the next character
@@ -110,7 +161,7 @@ int is_prefix(trie T, const char * token, priority_Q * result) {
     int i = 0, index;
     while (token[i] != '\0') {
         index = token[i] - 'a';
-        if (p->children[index] == NULL) {                                                   // If path doesn't exist, return 0
+        if (index < 0 || index >= 26 || p->children[index] == NULL) {                       // If path doesn't exist, return 0
             return 0;
         }
         p = p->children[index];                                                             // Move to the next character
@@ -197,9 +248,15 @@ int min3(int a, int b, int c) {
 
 //****************************************************************************
 // Calculate the normalized edit distance (Levenshtein ratio) between two words
+// with the bit-parallel kernel: time complexity is n * ceil(m / 64), no allocation for m <= 64
+float edit_distance(const char* word1, const char* word2) {
+    return levenshtein_ratio(word1, word2);
+}
+
+// Reference implementation with the full DP matrix, kept to cross-check the kernel
 //time complexity is n * m
 //space complexity is also n * m
-float edit_distance(const char* word1, const char* word2) {
+float edit_distance_reference(const char* word1, const char* word2) {
     int len1 = strlen(word1);
     int len2 = strlen(word2);
 
@@ -257,6 +314,7 @@ void collect_fuzzy(trie_node * p, priority_Q *pq, const char * token, char * cur
     if(p == NULL){
         return;
     }
+    TRACE_COUNT(TRACE_TRIE_NODES, 1);
     if(p -> isEndOfWord){
         curr_word[level] = '\0';
         float edits = edit_distance(token, curr_word);
@@ -311,7 +369,7 @@ void backoff(trie T, const char *token1, const char *token2, word_element search
 
 
 word_element validate(trie T, const char * token, priority_Q * result){
-    printf("*********************\n");
+    LOG_DEBUG("validate: %s", token);
     if(is_unigram(T, token, result)){
         return result -> words_collection[0];
     }else if(is_prefix(T, token, result)){
@@ -473,11 +531,32 @@ void tokenize_user_string(char *user_string, stack *s) {
     }
 }
 
+// Correct a single token: exact match first, then the best prefix completion, then the best fuzzy match.
+// Returns the best candidate in pq, or the token itself when nothing matched
+const char *correct_word(trie *T, const char *token, priority_Q *pq) {
+    init_priority_Q(pq);
+    double unigram_result = is_unigram(*T, token, pq);                                  // Try unigram matching
+
+    if (unigram_result == 0.0) {
+        int prefix_result = is_prefix(*T, token, pq);                                   // Try prefix matching if unigram fails
+
+        if (prefix_result == 0) {
+            is_fuzzymatch(*T, token, pq);                                               // Try fuzzy matching if prefix matching also fails
+        }
+    }
+
+    if (pq->size > 0) {                                                                 // If suggestions exist, use the best match
+        return pq->words_collection[0].word;
+    }
+    return token;                                                                       // Otherwise, keep the original token
+}
+
 // Process the stack of tokens, correct them, and concatenate into a string
 char* word_processor(stack *s1, stack *s2, trie *T) {
     char *token;
     priority_Q pq;
-    char *result = (char*)malloc(MAX_TOKEN_LEN * 100 * sizeof(char));                   // Allocate memory for the result string
+    int slots = s1->size > 100 ? s1->size : 100;                                        // Every token fits in MAX_TOKEN_LEN, plus room for the caller
+    char *result = (char*)malloc((size_t)slots * MAX_TOKEN_LEN * sizeof(char));         // Allocate memory for the result string
     if (result == NULL) {
         printf("Memory allocation failed!\n");
         return NULL;
@@ -487,7 +566,6 @@ char* word_processor(stack *s1, stack *s2, trie *T) {
 // Process each token in the input stack
     while (!is_empty(*s1)) {
         token = pop(s1);
-        init_priority_Q(&pq);
 
         to_lower(token);
 
@@ -497,39 +575,50 @@ char* word_processor(stack *s1, stack *s2, trie *T) {
             continue;
         }
 
-        
-        double unigram_result = is_unigram(*T, token, &pq);                             // Try unigram matching
-
-        if (unigram_result == 0.0) {
-                                                                                        
-            int prefix_result = is_prefix(*T, token, &pq);                              // Try prefix matching if unigram fails
-
-            if (prefix_result == 0) {
-                
-                is_fuzzymatch(*T, token, &pq);                                          // Try fuzzy matching if prefix matching also fails
-            }
-        }
-
-        if (pq.size > 0) {                                                              // If suggestions exist, use the best match
-            push(s2, pq.words_collection[0].word);
-        } else {                                                                        // Otherwise, keep the original token
-            push(s2, token);
-        }
+        push(s2, (char *)correct_word(T, token, &pq));
 
         free(token);                                                                    // Free the original token
     }
 
     // Concatenate tokens from the second stack into the result string
+    size_t used = 0;
     while (!is_empty(*s2)) {
         token = pop(s2);
-        strcat(result, token);
-        strcat(result, " ");                                                            // Add space between tokens
+        size_t len = strlen(token);
+        memcpy(result + used, token, len);
+        used += len;
+        result[used++] = ' ';                                                           // Add space between tokens
         free(token);
     }
+    result[used] = '\0';
 
     return result; // Return the corrected string
 }
 
+// Spell check the word spans of the input and join every token with a space.
+// Tokens are already lowercase; only the token being corrected is copied out of the input
+char *correct_spans(trie *T, spell_cache *cache, const char *input, const token_span *spans, int num_spans) {
+    int slots = num_spans > 100 ? num_spans : 100;                                      // Leaves room for the caller to append context words
+    char *result = (char *)malloc((size_t)slots * MAX_TOKEN_LEN);
+    if (result == NULL) {
+        printf("Memory allocation failed!\n");
+        return NULL;
+    }
 
-
-
+    size_t used = 0;
+    char token[MAX_TOKEN_LEN], corrected[MAX_TOKEN_LEN];
+    for (int i = 0; i < num_spans; i++) {
+        span_to_string(input, &spans[i], token, sizeof(token));
+        const char *out = token;
+        if (spans[i].kind == TOKEN_WORD) {
+            spell_cache_correct(cache, T, token, corrected);
+            out = corrected;
+        }
+        size_t len = strlen(out);
+        memcpy(result + used, out, len);
+        used += len;
+        result[used++] = ' ';
+    }
+    result[used] = '\0';
+    return result;
+}
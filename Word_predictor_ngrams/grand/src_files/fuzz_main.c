@@ -0,0 +1,1001 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "btree.h"
+#include "functions.h"
+#include "levenshtein.h"
+#include "spell_cache.h"
+#include "engine.h"
+
+// Differential harness: every round builds a random model and random queries, runs each optimized
+// path next to the reference it replaced and reports any difference in top-k results, counts or
+// corrections. Checks:
+//   distance  levenshtein kernels (single word, blocked and batch) vs the edit_distance_reference matrix
+//   tables    node, compacted and packed B+ trees vs a sorted array: exact counts, context and
+//             completion searches, seeks and cursor walks, again after decrements, deletes and deltas
+//   spelling  the trie cascade behind spell_cache vs validate / correct_word done by brute force, and
+//             cached noisy channel corrections after varying previous words vs the uncached ranking
+//   model     predict_ngrams / complete_ngrams on a packed, filtered model and on a node form model
+//             vs back-off over the sorted arrays
+//   engine    wp_predict / wp_complete on a packed engine vs a node form engine, and
+//             wp_session_complete vs wp_complete on typed, edited input
+//   store     wp_predict / wp_complete on reader threads while wp_learn and merges publish new
+//             generations (every count must lie between the old and the final reference), then the
+//             merged tables, trie and back-off vs the reference with the learned counts added
+// Round r draws everything from seed + r, so a divergence is replayed with --seed S+r --rounds 1.
+// Build with PROFILE=asan to run every comparison under AddressSanitizer and UBSan.
+
+#define FUZZ_MAX_REPORTS 20             // Divergences printed per check (all are counted)
+#define FUZZ_ALPHABET 8                 // Words use the first letters only, so prefixes and contexts collide
+#define FUZZ_TEXT_LEN 256
+
+typedef struct {
+    int rounds;
+    unsigned int seed;
+    int keys;                       // N-grams per table.
+    int vocabulary;                 // Words in the unigram trie.
+    int queries;                    // Queries per check and round.
+    const char *only;               // Run a single check when set.
+} fuzz_config;
+
+typedef enum { CHECK_DISTANCE, CHECK_TABLES, CHECK_SPELLING, CHECK_MODEL, CHECK_ENGINE, CHECK_STORE, NUM_CHECKS } fuzz_check;
+
+static const char *check_names[NUM_CHECKS] = { "distance", "tables", "spelling", "model", "engine", "store" };
+static long long comparisons[NUM_CHECKS];
+static long long divergences[NUM_CHECKS];
+static int current_round;
+
+static void compared(fuzz_check check) {
+    comparisons[check]++;
+}
+
+static void diverged(fuzz_check check, const char *fmt, ...) {
+    if (divergences[check]++ >= FUZZ_MAX_REPORTS) return;
+    va_list args;
+    va_start(args, fmt);
+    printf("DIVERGENCE %s round %d: ", check_names[check], current_round);
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+}
+
+// A random word over the first FUZZ_ALPHABET letters; now and then a long one
+static void random_word(char *out) {
+    int len = rand() % 50 == 0 ? 20 + rand() % 40 : 1 + rand() % 8;
+    for (int i = 0; i < len; i++) out[i] = (char)('a' + rand() % FUZZ_ALPHABET);
+    out[len] = '\0';
+}
+
+// A slightly misspelled copy of a word: one substitution, insertion, deletion or transposition
+static void misspell(const char *word, char *out) {
+    strcpy(out, word);
+    int len = (int)strlen(out);
+    int pos = len > 0 ? rand() % len : 0;
+    switch (rand() % 4) {
+        case 0: if (len > 0) out[pos] = (char)('a' + rand() % 26); break;
+        case 1: memmove(out + pos + 1, out + pos, (size_t)(len - pos + 1)); out[pos] = (char)('a' + rand() % 26); break;
+        case 2: if (len > 1) memmove(out + pos, out + pos + 1, (size_t)(len - pos)); break;
+        default: if (pos + 1 < len) { char t = out[pos]; out[pos] = out[pos + 1]; out[pos + 1] = t; } break;
+    }
+}
+
+//
+// Reference model: sorted arrays searched by brute force
+//
+
+typedef struct {
+    char key[MAX_KEY_LEN];
+    int count;
+} ref_entry;
+
+// Unique keys in strcmp order: a table of n-grams, or the vocabulary
+typedef struct {
+    ref_entry *entries;
+    int size;
+    int cap;
+} ref_table;
+
+static int ref_lower_bound(const ref_table *t, const char *key) {
+    int lo = 0, hi = t->size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(t->entries[mid].key, key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int ref_count(const ref_table *t, const char *key) {
+    int i = ref_lower_bound(t, key);
+    return i < t->size && strcmp(t->entries[i].key, key) == 0 ? t->entries[i].count : 0;
+}
+
+// Add delta to a key like applyNGramDeltas: stored counts that drop to zero or below are removed,
+// absent keys are inserted when delta is positive
+static void ref_add(ref_table *t, const char *key, long long delta) {
+    int i = ref_lower_bound(t, key);
+    if (i < t->size && strcmp(t->entries[i].key, key) == 0) {
+        long long count = t->entries[i].count + delta;
+        if (count > 0) {
+            t->entries[i].count = (int)count;
+        } else {
+            memmove(&t->entries[i], &t->entries[i + 1], sizeof(ref_entry) * (size_t)(t->size - i - 1));
+            t->size--;
+        }
+        return;
+    }
+    if (delta <= 0) return;
+    if (t->size == t->cap) {
+        t->cap = t->cap > 0 ? t->cap * 2 : 256;
+        t->entries = (ref_entry *)realloc(t->entries, sizeof(ref_entry) * (size_t)t->cap);
+    }
+    memmove(&t->entries[i + 1], &t->entries[i], sizeof(ref_entry) * (size_t)(t->size - i));
+    strcpy(t->entries[i].key, key);
+    t->entries[i].count = (int)delta;
+    t->size++;
+}
+
+// Every key starting with prefix, fed to the queue in key order like a tree scan
+static void ref_search(const ref_table *t, const char *prefix, bt_priority_q *q) {
+    size_t len = strlen(prefix);
+    for (int i = ref_lower_bound(t, prefix); i < t->size && strncmp(t->entries[i].key, prefix, len) == 0; i++) {
+        insert_bt_pq(q, t->entries[i].key, t->entries[i].count);
+    }
+}
+
+// Random n-grams of the given order over the vocabulary (a few words from outside it)
+static void ref_fill(ref_table *t, const ref_table *vocab, int order, int keys) {
+    for (int k = 0; k < keys; k++) {
+        char key[MAX_KEY_LEN] = "";
+        for (int n = 0; n < order; n++) {
+            char word[MAX_TOKEN_LEN];
+            if (rand() % 20 == 0) random_word(word);
+            else strcpy(word, vocab->entries[rand() % vocab->size].key);
+            if (n > 0) strcat(key, " ");
+            strcat(key, word);
+        }
+        ref_add(t, key, 1 + rand() % (rand() % 4 == 0 ? 5000 : 50));
+    }
+}
+
+static void ref_copy(ref_table *dst, const ref_table *src) {
+    dst->size = dst->cap = src->size;
+    dst->entries = (ref_entry *)malloc(sizeof(ref_entry) * (size_t)(src->size > 0 ? src->size : 1));
+    memcpy(dst->entries, src->entries, sizeof(ref_entry) * (size_t)src->size);
+}
+
+static void ref_free(ref_table *t) {
+    free(t->entries);
+    t->entries = NULL;
+    t->size = t->cap = 0;
+}
+
+static void compare_queues(fuzz_check check, const char *what, const char *query, const bt_priority_q *expected, const bt_priority_q *got) {
+    compared(check);
+    int same = expected->top == got->top;
+    for (int i = 0; same && i <= expected->top; i++) {
+        same = expected->count[i] == got->count[i] && strcmp(expected->ngram[i], got->ngram[i]) == 0;
+    }
+    if (!same) {
+        diverged(check, "%s \"%s\": expected %d results (first \"%s\" %d), got %d (first \"%s\" %d)", what, query,
+                 expected->top + 1, expected->top >= 0 ? expected->ngram[0] : "", expected->top >= 0 ? expected->count[0] : 0,
+                 got->top + 1, got->top >= 0 ? got->ngram[0] : "", got->top >= 0 ? got->count[0] : 0);
+    }
+}
+
+// A query context: the leading words of a stored key (usually) or random words
+static int pick_context(const ref_table *t, const ref_table *vocab, int words, char out[][MAX_TOKEN_LEN]) {
+    if (t->size > 0 && rand() % 4 != 0) {
+        char key[MAX_KEY_LEN];
+        strcpy(key, t->entries[rand() % t->size].key);
+        int n = 0;
+        for (char *word = strtok(key, " "); word != NULL && n < words; word = strtok(NULL, " ")) strcpy(out[n++], word);
+        return n;
+    }
+    for (int n = 0; n < words; n++) {
+        if (rand() % 3 == 0) random_word(out[n]);
+        else strcpy(out[n], vocab->entries[rand() % vocab->size].key);
+    }
+    return words;
+}
+
+// Join words into "w1 w2 ... " (trailing space) followed by tail
+static void join_key(char out[][MAX_TOKEN_LEN], int words, const char *tail, char *key) {
+    key[0] = '\0';
+    for (int i = 0; i < words; i++) {
+        strcat(key, out[i]);
+        strcat(key, " ");
+    }
+    strcat(key, tail);
+}
+
+//
+// distance: bit-parallel kernels against the DP matrix
+//
+
+static void random_text(char *out, int max_len) {
+    int len = rand() % (max_len + 1);
+    int bytes = rand() % 4 == 0;                                                        // Arbitrary bytes, not only letters
+    for (int i = 0; i < len; i++) out[i] = bytes ? (char)(1 + rand() % 255) : (char)('a' + rand() % 4);
+    out[len] = '\0';
+}
+
+// The reference divides by the average length, so two empty strings give 0/0; the kernels define it as 0
+static float reference_ratio(const char *a, const char *b) {
+    return a[0] == '\0' && b[0] == '\0' ? 0.0f : edit_distance_reference(a, b);
+}
+
+// Printable copy of a string with arbitrary bytes, \xNN escaped
+static const char *escaped(const char *text, char out[4 * 160]) {
+    char *p = out;
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+        if (*c >= 0x20 && *c < 0x7f && *c != '\\' && *c != '"') *p++ = (char)*c;
+        else p += sprintf(p, "\\x%02x", *c);
+    }
+    *p = '\0';
+    return out;
+}
+
+static void check_distance(const fuzz_config *cfg) {
+    char quoted_a[4 * 160], quoted_b[4 * 160];
+    char a[160], b[160];
+    for (int q = 0; q < cfg->queries; q++) {
+        random_text(a, rand() % 2 ? 12 : 150);                                          // Short words and multi-word patterns
+        if (rand() % 2) {
+            strcpy(b, a);
+            for (int e = rand() % 4; e > 0; e--) {
+                char edited[200];
+                misspell(b, edited);
+                edited[150] = '\0';
+                strcpy(b, edited);
+            }
+        } else {
+            random_text(b, rand() % 2 ? 12 : 150);
+        }
+        float expected = reference_ratio(a, b);
+        float got = edit_distance(a, b);
+        compared(CHECK_DISTANCE);
+        if (expected != got) {
+            diverged(CHECK_DISTANCE, "edit_distance(\"%s\", \"%s\") = %f, reference %f", escaped(a, quoted_a), escaped(b, quoted_b), got, expected);
+        }
+    }
+
+    // Batches: the vector lanes must agree with the scalar reference, whatever the mix of lengths
+    for (int q = 0; q < cfg->queries / 8 + 1; q++) {
+        char query[160], candidates[13][160];
+        const char *pointers[13];
+        float ratios[13];
+        random_text(query, rand() % 2 ? 12 : 80);
+        int num = 1 + rand() % 13;
+        for (int i = 0; i < num; i++) {
+            if (rand() % 2) misspell(query, candidates[i]);
+            else random_text(candidates[i], rand() % 2 ? 12 : 80);
+            candidates[i][150] = '\0';
+            pointers[i] = candidates[i];
+        }
+        levenshtein_ratio_batch(query, pointers, num, ratios);
+        for (int i = 0; i < num; i++) {
+            float expected = reference_ratio(query, candidates[i]);
+            compared(CHECK_DISTANCE);
+            if (expected != ratios[i]) {
+                diverged(CHECK_DISTANCE, "levenshtein_ratio_batch(\"%s\", \"%s\") = %f, reference %f", escaped(query, quoted_a),
+                         escaped(candidates[i], quoted_b), ratios[i], expected);
+            }
+        }
+    }
+}
+
+//
+// tables: every B+ tree form against the sorted array
+//
+
+#define NUM_FORMS 3
+static const char *form_names[NUM_FORMS] = { "node", "compact", "packed" };
+
+// Reorganize each tree into its form (an update may have turned a packed tree back into nodes)
+static void shape_forms(BPlusTree *trees[NUM_FORMS]) {
+    compactBPlusTree(trees[1]);
+    packBPlusTree(trees[2]);
+}
+
+static void compare_table(fuzz_check check, const char *form, BPlusTree *tree, const ref_table *ref) {
+    BTreeStats stats;
+    statBPlusTree(tree, &stats);
+    compared(check);
+    if (stats.violations != 0 || stats.keys != ref->size) {
+        diverged(check, "%s tree: %lld keys (reference %d), invariant violations %#x", form, stats.keys, ref->size, stats.violations);
+    }
+    BTreeCursor cursor;
+    int i = 0;
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor), i++) {
+        compared(check);
+        if (i >= ref->size || strcmp(cursor.key, ref->entries[i].key) != 0 || cursor.count != ref->entries[i].count) {
+            diverged(check, "%s tree walk, key %d: \"%s\" %d, reference \"%s\" %d", form, i, cursor.key, cursor.count,
+                     i < ref->size ? ref->entries[i].key : "(end)", i < ref->size ? ref->entries[i].count : 0);
+            return;
+        }
+    }
+    compared(check);
+    if (i != ref->size) diverged(check, "%s tree walk stopped after %d keys, reference has %d", form, i, ref->size);
+}
+
+static void query_tables(const fuzz_config *cfg, BPlusTree *trees[NUM_FORMS], const ref_table *ref, const ref_table *vocab) {
+    for (int q = 0; q < cfg->queries; q++) {
+        char words[3][MAX_TOKEN_LEN], key[MAX_KEY_LEN];
+        int kind = rand() % 4;
+        int num = pick_context(ref, vocab, kind == 0 ? 3 : 1 + rand() % 2, words);
+        if (kind == 0) {
+            // Exact count of a stored or made up n-gram
+            join_key(words, num - 1, words[num - 1], key);
+            int expected = ref_count(ref, key);
+            for (int f = 0; f < NUM_FORMS; f++) {
+                int got = searchExactNGram(trees[f], key);
+                compared(CHECK_TABLES);
+                if (got != expected) diverged(CHECK_TABLES, "%s searchExactNGram \"%s\" = %d, reference %d", form_names[f], key, got, expected);
+            }
+        } else if (kind == 1) {
+            // Every continuation of a context
+            join_key(words, num, "", key);
+            bt_priority_q expected;
+            init_bt_pq(&expected);
+            ref_search(ref, key, &expected);
+            for (int f = 0; f < NUM_FORMS; f++) {
+                bt_priority_q got;
+                init_bt_pq(&got);
+                const char *context[2] = { words[0], words[1] };
+                if (rand() % 2) searchNGramsContext(trees[f], context, num, &got);
+                else searchNGrams(trees[f], words[0], num == 2 ? words[1] : NULL, &got);
+                compare_queues(CHECK_TABLES, form_names[f], key, &expected, &got);
+                free_bt_q(&got);
+            }
+            free_bt_q(&expected);
+        } else if (kind == 2) {
+            // Continuations of a context starting with a partial word
+            char prefix[MAX_TOKEN_LEN];
+            char next[1][MAX_TOKEN_LEN];
+            if (pick_context(ref, vocab, 1, next) == 1) {
+                strcpy(prefix, next[0]);
+                prefix[rand() % (strlen(prefix) + 1)] = '\0';
+            } else {
+                prefix[0] = '\0';
+            }
+            join_key(words, num, prefix, key);
+            bt_priority_q expected;
+            init_bt_pq(&expected);
+            ref_search(ref, key, &expected);
+            for (int f = 0; f < NUM_FORMS; f++) {
+                bt_priority_q got;
+                init_bt_pq(&got);
+                const char *context[2] = { words[0], words[1] };
+                searchNGramsCompletion(trees[f], context, num, prefix, &got);
+                compare_queues(CHECK_TABLES, form_names[f], key, &expected, &got);
+                free_bt_q(&got);
+            }
+            free_bt_q(&expected);
+        } else {
+            // Lower bound of an arbitrary key
+            join_key(words, num, "", key);
+            key[strlen(key) - (size_t)(rand() % 2)] = '\0';
+            int i = ref_lower_bound(ref, key);
+            for (int f = 0; f < NUM_FORMS; f++) {
+                BTreeCursor cursor;
+                int more = bPlusTreeSeek(trees[f], key, &cursor);
+                compared(CHECK_TABLES);
+                if (more != (i < ref->size) || (more && (strcmp(cursor.key, ref->entries[i].key) != 0 || cursor.count != ref->entries[i].count))) {
+                    diverged(CHECK_TABLES, "%s bPlusTreeSeek \"%s\" = \"%s\", reference \"%s\"", form_names[f], key,
+                             more ? cursor.key : "(end)", i < ref->size ? ref->entries[i].key : "(end)");
+                }
+            }
+        }
+    }
+}
+
+// Decrements, deletes and a batch of deltas, applied to every form and to the reference
+static void mutate_tables(const fuzz_config *cfg, BPlusTree *trees[NUM_FORMS], ref_table *ref, const ref_table *vocab) {
+    for (int m = 0; m < cfg->queries / 4 && ref->size > 0; m++) {
+        char key[MAX_KEY_LEN];
+        strcpy(key, ref->entries[rand() % ref->size].key);
+        if (rand() % 5 == 0) random_word(key + strlen(key) / 2);                        // Absent, now and then
+        int stored = ref_count(ref, key);
+        if (rand() % 3 == 0) {
+            for (int f = 0; f < NUM_FORMS; f++) {
+                int got = deleteNGram(trees[f], key);
+                compared(CHECK_TABLES);
+                if (got != stored) diverged(CHECK_TABLES, "%s deleteNGram \"%s\" = %d, reference %d", form_names[f], key, got, stored);
+            }
+            ref_add(ref, key, -(long long)stored);
+        } else {
+            int amount = 1 + rand() % (stored > 0 && stored < 100 ? stored + 2 : 10);
+            int expected = stored > amount ? stored - amount : 0;
+            for (int f = 0; f < NUM_FORMS; f++) {
+                int got = decrementNGram(trees[f], key, amount);
+                compared(CHECK_TABLES);
+                if (got != expected) diverged(CHECK_TABLES, "%s decrementNGram \"%s\" by %d = %d, reference %d", form_names[f], key, amount, got, expected);
+            }
+            if (stored > 0) ref_add(ref, key, -(long long)amount);
+        }
+    }
+
+    // One batch of deltas: repeated keys, decays below zero and new n-grams
+    int num = cfg->queries / 4 + 1;
+    char (*keys)[MAX_KEY_LEN] = malloc(sizeof(*keys) * (size_t)num);
+    ngram_delta *deltas = (ngram_delta *)malloc(sizeof(ngram_delta) * (size_t)num);
+    ngram_delta *copy = (ngram_delta *)malloc(sizeof(ngram_delta) * (size_t)num);
+    for (int i = 0; i < num; i++) {
+        if (i > 0 && rand() % 8 == 0) {
+            strcpy(keys[i], keys[rand() % i]);
+        } else if (ref->size > 0 && rand() % 3 != 0) {
+            strcpy(keys[i], ref->entries[rand() % ref->size].key);
+        } else {
+            char words[3][MAX_TOKEN_LEN];
+            int n = pick_context(ref, vocab, 3, words);
+            join_key(words, n - 1, words[n - 1], keys[i]);
+        }
+        deltas[i].ngram = keys[i];
+        deltas[i].delta = rand() % 11 - 5;
+    }
+    for (int f = 0; f < NUM_FORMS; f++) {
+        memcpy(copy, deltas, sizeof(ngram_delta) * (size_t)num);                        // Sorted in place
+        applyNGramDeltas(trees[f], copy, num);
+    }
+    // The reference applies the sum of every key's deltas at once, as the tree does
+    for (int i = 0; i < num; i++) {
+        int first = 1;
+        for (int d = 0; d < i && first; d++) first = strcmp(keys[d], keys[i]) != 0;
+        if (!first) continue;
+        long long sum = 0;
+        for (int d = i; d < num; d++) {
+            if (strcmp(keys[d], keys[i]) == 0) sum += deltas[d].delta;
+        }
+        if (sum != 0) ref_add(ref, keys[i], sum);
+    }
+    free(keys);
+    free(deltas);
+    free(copy);
+}
+
+static void check_tables(const fuzz_config *cfg, const ref_table *vocab) {
+    ref_table ref = { NULL, 0, 0 };
+    ref_fill(&ref, vocab, 2 + rand() % 2, cfg->keys);
+
+    // Inserted in a random order, so splits happen everywhere
+    int *order = (int *)malloc(sizeof(int) * (size_t)ref.size);
+    for (int i = 0; i < ref.size; i++) order[i] = i;
+    for (int i = ref.size - 1; i > 0; i--) {
+        int j = rand() % (i + 1), t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    BPlusTree *trees[NUM_FORMS];
+    for (int f = 0; f < NUM_FORMS; f++) {
+        trees[f] = createBPlusTree();
+        for (int i = 0; i < ref.size; i++) insertBPlusTree(trees[f], ref.entries[order[i]].key, ref.entries[order[i]].count);
+    }
+    free(order);
+    shape_forms(trees);
+
+    for (int f = 0; f < NUM_FORMS; f++) compare_table(CHECK_TABLES, form_names[f], trees[f], &ref);
+    query_tables(cfg, trees, &ref, vocab);
+    mutate_tables(cfg, trees, &ref, vocab);
+    for (int f = 0; f < NUM_FORMS; f++) compare_table(CHECK_TABLES, form_names[f], trees[f], &ref);
+    query_tables(cfg, trees, &ref, vocab);
+    shape_forms(trees);                                                                 // Back to their forms after the updates
+    for (int f = 0; f < NUM_FORMS; f++) compare_table(CHECK_TABLES, form_names[f], trees[f], &ref);
+    query_tables(cfg, trees, &ref, vocab);
+
+    for (int f = 0; f < NUM_FORMS; f++) freeBPlusTree(trees[f]);
+    ref_free(&ref);
+}
+
+//
+// spelling: the trie cascade and its cache against brute force over the word list
+//
+
+// validate done by brute force: exact word, then every word with the token as prefix, then every word
+// within MAX_EDIT_DISTANCE, each fed to the queue in alphabetical order like the trie walks
+static word_element ref_validate(const ref_table *vocab, long long total, const char *token, priority_Q *pq) {
+    init_priority_Q(pq);
+    int i = ref_lower_bound(vocab, token);
+    if (i < vocab->size && strcmp(vocab->entries[i].key, token) == 0) {
+        insert_pq(pq, token, unigram_prob(vocab->entries[i].count, (int)total), 0);
+        return pq->words_collection[0];
+    }
+    size_t len = strlen(token);
+    for (; i < vocab->size && strncmp(vocab->entries[i].key, token, len) == 0; i++) {
+        insert_pq(pq, vocab->entries[i].key, unigram_prob(vocab->entries[i].count, (int)total), 0.0);
+    }
+    if (pq->size > 0) {
+        return pq->words_collection[0];
+    }
+    for (i = 0; i < vocab->size; i++) {
+        float edits = edit_distance_reference(token, vocab->entries[i].key);
+        if (edits <= MAX_EDIT_DISTANCE) {
+            insert_pq(pq, vocab->entries[i].key, unigram_prob(vocab->entries[i].count, (int)total), edits);
+        }
+    }
+    if (pq->size > 0) {
+        return pq->words_collection[0];
+    }
+    word_element empty = {"", 0.0, 0};
+    return empty;
+}
+
+static void compare_words(const char *what, const char *token, word_element expected, word_element got) {
+    compared(CHECK_SPELLING);
+    if (strcmp(expected.word, got.word) != 0 || expected.prob != got.prob || expected.distance != got.distance) {
+        diverged(CHECK_SPELLING, "%s \"%s\" = \"%s\" (%g, %g), reference \"%s\" (%g, %g)", what, token,
+                 got.word, got.prob, got.distance, expected.word, expected.prob, expected.distance);
+    }
+}
+
+static void check_spelling(const fuzz_config *cfg, const ref_table *vocab, trie *T) {
+    long long total = 0;
+    for (int i = 0; i < vocab->size; i++) total += vocab->entries[i].count;
+    compared(CHECK_SPELLING);
+    if (total != T->total_unigram_count) diverged(CHECK_SPELLING, "trie total %lld, reference %lld", T->total_unigram_count, total);
+
+    spell_cache cache;
+    if (spell_cache_init(&cache, 64) != 0) return;                                      // Small: lookups also exercise eviction
+    int num = cfg->queries / 4 + 1;
+    char (*tokens)[MAX_TOKEN_LEN] = malloc(sizeof(*tokens) * (size_t)num);
+    for (int i = 0; i < num; i++) {
+        const char *word = vocab->entries[rand() % vocab->size].key;
+        switch (rand() % 4) {
+            case 0: strcpy(tokens[i], word); break;
+            case 1: strcpy(tokens[i], word); tokens[i][rand() % (strlen(word) + 1)] = '\0'; break;
+            case 2: misspell(word, tokens[i]); break;
+            default: random_word(tokens[i]); break;
+        }
+    }
+    // Every token twice, in a different order the second time: cold and warm cache entries
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k < num; k++) {
+            const char *token = tokens[pass == 0 ? k : (k * 7 + 3) % num];
+            priority_Q ref_pq, pq;
+            word_element expected = ref_validate(vocab, total, token, &ref_pq);
+            init_priority_Q(&pq);
+            compare_words("validate", token, expected, validate(*T, token, &pq));
+            compare_words("spell_cache_validate", token, expected, spell_cache_validate(&cache, T, token));
+
+            char corrected[MAX_TOKEN_LEN];
+            spell_cache_correct(&cache, T, token, corrected);
+            const char *plain = correct_word(T, token, &pq);
+            const char *reference = ref_pq.size > 0 ? ref_pq.words_collection[0].word : token;
+            compared(CHECK_SPELLING);
+            if (strcmp(corrected, reference) != 0 || strcmp(plain, reference) != 0) {
+                diverged(CHECK_SPELLING, "correction of \"%s\": spell_cache_correct \"%s\", correct_word \"%s\", reference \"%s\"",
+                         token, corrected, plain, reference);
+            }
+        }
+    }
+    free(tokens);
+    spell_cache_destroy(&cache);
+}
+
+//
+// model and engine: back-off over every table layout
+//
+
+// A model of order 3 over the vocabulary and the reference tables; packed with context filters, or
+// left in node form without filters
+static ngram_model *build_model(const ref_table *vocab, const ref_table refs[], int packed) {
+    ngram_model *model = (ngram_model *)malloc(sizeof(ngram_model));
+    init_ngram_model(model, 3);
+    for (int i = 0; i < vocab->size; i++) insert_word(&model->unigrams, vocab->entries[i].key, vocab->entries[i].count);
+    for (int n = 2; n <= 3; n++) {
+        model->tables[n] = createBPlusTree();
+        for (int i = 0; i < refs[n].size; i++) insertBPlusTree(model->tables[n], refs[n].entries[i].key, refs[n].entries[i].count);
+    }
+    if (packed) {
+        set_ngram_filter(model, NGRAM_FILTER_FPR, 0);
+        compact_ngram_model(model);
+    }
+    return model;
+}
+
+// Cached corrections ranked with a previous word against the same call without a cache: a decision
+// must only be reused after the words it holds for
+static void check_context_spelling(const fuzz_config *cfg, const ref_table *vocab, const ref_table refs[]) {
+    ngram_model *model = build_model(vocab, refs, 1);
+    spell_cache cache;
+    if (attach_ranking_vocab(&model->unigrams) != 0 || spell_cache_init(&cache, 64) != 0) {
+        free_ngram_model(model);
+        free(model);
+        return;
+    }
+    const char *prevs[5] = { NULL };                                                    // Few previous words, so they repeat
+    for (int i = 1; i < 5; i++) prevs[i] = vocab->entries[rand() % vocab->size].key;
+    int num = cfg->queries / 8 + 1;
+    char (*tokens)[MAX_TOKEN_LEN] = malloc(sizeof(*tokens) * (size_t)num);
+    for (int i = 0; i < num; i++) {
+        const char *word = vocab->entries[rand() % vocab->size].key;
+        if (rand() % 2) strcpy(tokens[i], word);
+        else misspell(word, tokens[i]);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k < num; k++) {
+            const char *token = tokens[pass == 0 ? k : (k * 7 + 3) % num];
+            const char *prev = prevs[rand() % 5];
+            word_element expected = spell_cache_validate_context(NULL, model, prev, token);
+            compare_words(prev != NULL ? "cached context correction" : "cached correction", token, expected,
+                          spell_cache_validate_context(&cache, model, prev, token));
+        }
+    }
+    free(tokens);
+    spell_cache_destroy(&cache);
+    free_ngram_model(model);
+    free(model);
+}
+
+// predict_ngrams / complete_ngrams done by brute force
+static int ref_backoff(const ref_table refs[], char words[][MAX_TOKEN_LEN], int num, const char *prefix, bt_priority_q *q) {
+    int n = num + 1 < 3 ? num + 1 : 3;
+    for (; n >= 2; n--) {
+        char key[MAX_KEY_LEN];
+        join_key(words + num - (n - 1), n - 1, prefix != NULL ? prefix : "", key);
+        ref_search(&refs[n], key, q);
+        if (q->top >= 0) break;
+    }
+    return n >= 2 ? n : 0;
+}
+
+static void check_model(const fuzz_config *cfg, const ref_table *vocab, const ref_table refs[]) {
+    ngram_model *models[2] = { build_model(vocab, refs, 1), build_model(vocab, refs, 0) };
+    static const char *model_names[2] = { "packed", "node" };
+    for (int q = 0; q < cfg->queries; q++) {
+        char words[3][MAX_TOKEN_LEN], prefix[MAX_TOKEN_LEN];
+        int num = pick_context(&refs[3], vocab, 1 + rand() % 3, words);
+        const char *context[3] = { words[0], words[1], words[2] };
+        int complete = rand() % 2;
+        if (complete) {
+            strcpy(prefix, vocab->entries[rand() % vocab->size].key);
+            prefix[rand() % (strlen(prefix) + 1)] = '\0';
+        }
+        char query[MAX_KEY_LEN];
+        join_key(words, num, complete ? prefix : "", query);
+
+        bt_priority_q expected;
+        init_bt_pq(&expected);
+        int expected_order = ref_backoff(refs, words, num, complete ? prefix : NULL, &expected);
+        for (int m = 0; m < 2; m++) {
+            bt_priority_q got;
+            init_bt_pq(&got);
+            int order = complete ? complete_ngrams(models[m], context, num, prefix, &got)
+                                 : predict_ngrams(models[m], context, num, &got);
+            compared(CHECK_MODEL);
+            if (order != expected_order) {
+                diverged(CHECK_MODEL, "%s %s \"%s\" answered from order %d, reference %d", model_names[m],
+                         complete ? "complete_ngrams" : "predict_ngrams", query, order, expected_order);
+            }
+            compare_queues(CHECK_MODEL, model_names[m], query, &expected, &got);
+            free_bt_q(&got);
+        }
+        free_bt_q(&expected);
+    }
+    for (int m = 0; m < 2; m++) {
+        free_ngram_model(models[m]);
+        free(models[m]);
+    }
+}
+
+// Random input text: vocabulary words, misspellings and punctuation
+static void random_input(const ref_table *vocab, char *text) {
+    static const char *separators[] = { " ", " ", " ", "  ", ", ", ". ", " - " };
+    int words = rand() % 5;
+    text[0] = '\0';
+    for (int i = 0; i < words; i++) {
+        char word[MAX_TOKEN_LEN * 2];
+        const char *base = vocab->entries[rand() % vocab->size].key;
+        if (rand() % 4 == 0) misspell(base, word);
+        else strcpy(word, base);
+        if (rand() % 10 == 0) word[0] = (char)(word[0] - 'a' + 'A');
+        if (strlen(text) + strlen(word) + 4 >= FUZZ_TEXT_LEN) break;
+        if (i > 0) strcat(text, separators[rand() % 7]);
+        strcat(text, word);
+    }
+    if (rand() % 3 == 0) strcat(text, " ");
+}
+
+static void compare_suggestions(const char *what, const char *text, const wp_suggestion *expected, int num_expected,
+                                const wp_context *expected_ctx, const wp_suggestion *got, int num_got, const wp_context *got_ctx) {
+    compared(CHECK_ENGINE);
+    int same = num_expected == num_got && expected_ctx->order == got_ctx->order && expected_ctx->num_words == got_ctx->num_words
+               && expected_ctx->offset == got_ctx->offset && strcmp(expected_ctx->prefix, got_ctx->prefix) == 0;
+    for (int i = 0; same && i < expected_ctx->num_words; i++) same = strcmp(expected_ctx->words[i], got_ctx->words[i]) == 0;
+    for (int i = 0; same && i < num_expected; i++) {
+        same = strcmp(expected[i].ngram, got[i].ngram) == 0 && strcmp(expected[i].word, got[i].word) == 0
+               && expected[i].count == got[i].count && expected[i].order == got[i].order;
+    }
+    if (!same) {
+        diverged(CHECK_ENGINE, "%s \"%s\": %d suggestions (first \"%s\") from order %d, reference %d (first \"%s\") from order %d",
+                 what, text, num_got, num_got > 0 ? got[0].ngram : "", got_ctx->order,
+                 num_expected, num_expected > 0 ? expected[0].ngram : "", expected_ctx->order);
+    }
+}
+
+static void check_engine(const fuzz_config *cfg, const ref_table *vocab, const ref_table refs[]) {
+    wp_options opts;
+    wp_default_options(&opts);
+    opts.cache_capacity = 64;
+    wp_engine *packed = wp_open_model(build_model(vocab, refs, 1), &opts);
+    wp_engine *node = wp_open_model(build_model(vocab, refs, 0), &opts);
+    if (packed == NULL || node == NULL) {
+        if (packed != NULL) wp_close(packed);
+        if (node != NULL) wp_close(node);
+        return;
+    }
+
+    // Whole inputs on both layouts
+    for (int q = 0; q < cfg->queries / 2; q++) {
+        char text[FUZZ_TEXT_LEN];
+        random_input(vocab, text);
+        wp_suggestion expected[WP_MAX_SUGGESTIONS], got[WP_MAX_SUGGESTIONS];
+        wp_context expected_ctx, got_ctx;
+        int complete = rand() % 2;
+        int num_expected = complete ? wp_complete(node, text, expected, WP_MAX_SUGGESTIONS, &expected_ctx)
+                                    : wp_predict(node, text, expected, WP_MAX_SUGGESTIONS, &expected_ctx);
+        int num_got = complete ? wp_complete(packed, text, got, WP_MAX_SUGGESTIONS, &got_ctx)
+                               : wp_predict(packed, text, got, WP_MAX_SUGGESTIONS, &got_ctx);
+        if (!complete) expected_ctx.prefix[0] = got_ctx.prefix[0] = '\0';              // Only wp_complete sets it
+        compare_suggestions(complete ? "wp_complete" : "wp_predict", text, expected, num_expected, &expected_ctx, got, num_got, &got_ctx);
+    }
+
+    // Keystrokes: inputs typed a character at a time, with backspaces and retyped endings
+    wp_session session;
+    wp_session_init(&session, packed);
+    for (int q = 0; q < cfg->queries / 16 + 1; q++) {
+        char target[FUZZ_TEXT_LEN], text[FUZZ_TEXT_LEN];
+        random_input(vocab, target);
+        size_t len = strlen(target);
+        for (size_t typed = 0; typed <= len; typed++) {
+            memcpy(text, target, typed);
+            text[typed] = '\0';
+            if (typed > 2 && rand() % 10 == 0) text[typed - 1 - rand() % 2] = '\0';     // Backspaces
+            wp_suggestion expected[WP_MAX_SUGGESTIONS], got[WP_MAX_SUGGESTIONS];
+            wp_context expected_ctx, got_ctx;
+            int num_expected = wp_complete(packed, text, expected, WP_MAX_SUGGESTIONS, &expected_ctx);
+            int num_got = wp_session_complete(&session, text, got, WP_MAX_SUGGESTIONS, &got_ctx);
+            compare_suggestions("wp_session_complete", text, expected, num_expected, &expected_ctx, got, num_got, &got_ctx);
+        }
+    }
+    wp_session_free(&session);
+    wp_close(packed);
+    wp_close(node);
+}
+
+//
+// store: readers running while learned counts are merged and published
+//
+
+#define FUZZ_READERS 4
+
+// One reader thread: replays its inputs until told to stop (twice at most) and checks every suggestion
+// against the counts before and after learning. Divergences are counted here and reported by the
+// main thread
+typedef struct {
+    wp_engine *engine;
+    char (*texts)[FUZZ_TEXT_LEN];
+    int num_texts;
+    const ref_table *before;        // refs[n] of the round, before learning
+    const ref_table *after;         // The same plus every learned count
+    atomic_int *stop;
+    long long comparisons;
+    long long divergences;
+    char first[4 * FUZZ_TEXT_LEN];  // First divergence seen.
+} store_reader;
+
+static void *store_reader_main(void *arg) {
+    store_reader *r = (store_reader *)arg;
+    for (int i = 0; i < 2 * r->num_texts && (i < r->num_texts || !atomic_load(r->stop)); i++) {
+        const char *text = r->texts[i % r->num_texts];
+        wp_suggestion got[WP_MAX_SUGGESTIONS];
+        int complete = i % 2;
+        int num = complete ? wp_complete(r->engine, text, got, WP_MAX_SUGGESTIONS, NULL)
+                           : wp_predict(r->engine, text, got, WP_MAX_SUGGESTIONS, NULL);
+        for (int j = 0; j < num; j++) {
+            int order = got[j].order, bad = 0;
+            r->comparisons++;
+            if (j > 0 && got[j].count > got[j - 1].count) {
+                bad = 1;                                                                // Suggestions come best first
+            } else if (order >= 2 && order <= 3) {
+                int low = ref_count(&r->before[order], got[j].ngram), high = ref_count(&r->after[order], got[j].ngram);
+                bad = high == 0 || got[j].count < low || got[j].count > high;
+            }
+            if (bad && r->divergences++ == 0) {
+                snprintf(r->first, sizeof(r->first), "%s \"%s\": \"%s\" %d from order %d, reference %d..%d",
+                         complete ? "wp_complete" : "wp_predict", text, got[j].ngram, got[j].count, order,
+                         order >= 2 && order <= 3 ? ref_count(&r->before[order], got[j].ngram) : 0,
+                         order >= 2 && order <= 3 ? ref_count(&r->after[order], got[j].ngram) : 0);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Count of a word in the trie (0 when absent)
+static int trie_word_count(const trie *T, const char *word) {
+    const trie_node *p = T->root;
+    for (int i = 0; word[i] != '\0' && p != NULL; i++) p = p->children[word[i] - 'a'];
+    return p != NULL && p->isEndOfWord ? p->count : 0;
+}
+
+// Text to learn: runs of vocabulary words, sometimes broken by a number. The reference gets +1 for
+// every n-gram of every run, as model_store_learn_words counts them
+static void learn_text(const ref_table *vocab, ref_table after[], char *text) {
+    char run[8][MAX_TOKEN_LEN];
+    int words = 2 + rand() % 6, num_run = 0;
+    text[0] = '\0';
+    for (int i = 0; i <= words; i++) {
+        if (i < words && rand() % 8 != 0) {
+            strcpy(run[num_run], vocab->entries[rand() % vocab->size].key);
+            if (strlen(text) + strlen(run[num_run]) + 2 >= FUZZ_TEXT_LEN) break;
+            strcat(text, run[num_run++]);
+            strcat(text, " ");
+            continue;
+        }
+        for (int start = 0; start < num_run; start++) {
+            for (int n = 1; n <= 3 && start + n <= num_run; n++) {
+                char key[MAX_KEY_LEN];
+                join_key(run + start, n - 1, run[start + n - 1], key);
+                ref_add(&after[n], key, 1);
+            }
+        }
+        num_run = 0;
+        if (i < words) strcat(text, "42 ");                                            // A number ends the run
+    }
+}
+
+static void check_store(const fuzz_config *cfg, const ref_table *vocab, const ref_table refs[]) {
+    wp_options opts;
+    wp_default_options(&opts);
+    opts.cache_capacity = 64;
+    opts.learn_interval_ms = 20;                                                        // Background merges race the explicit ones
+    wp_engine *engine = wp_open_model(build_model(vocab, refs, 1), &opts);
+    if (engine == NULL) return;
+
+    // Everything random is drawn up front, so the round replays whatever the threads interleave
+    ref_table after[4] = { { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 } };
+    ref_copy(&after[1], vocab);
+    for (int n = 2; n <= 3; n++) ref_copy(&after[n], &refs[n]);
+    int num_learn = cfg->queries / 32 + 1, num_texts = cfg->queries / FUZZ_READERS + 1;
+    char (*learn)[FUZZ_TEXT_LEN] = malloc(sizeof(*learn) * (size_t)num_learn);
+    char (*texts)[FUZZ_TEXT_LEN] = malloc(sizeof(*texts) * (size_t)num_texts * FUZZ_READERS);
+    for (int i = 0; i < num_learn; i++) learn_text(vocab, after, learn[i]);
+    for (int i = 0; i < num_texts * FUZZ_READERS; i++) random_input(vocab, texts[i]);
+
+    atomic_int stop;
+    atomic_init(&stop, 0);
+    store_reader readers[FUZZ_READERS];
+    pthread_t threads[FUZZ_READERS];
+    int started[FUZZ_READERS];
+    for (int t = 0; t < FUZZ_READERS; t++) {
+        store_reader *r = &readers[t];
+        r->engine = engine;
+        r->texts = texts + t * num_texts;
+        r->num_texts = num_texts;
+        r->before = refs;
+        r->after = after;
+        r->stop = &stop;
+        r->comparisons = r->divergences = 0;
+        r->first[0] = '\0';
+        started[t] = pthread_create(&threads[t], NULL, store_reader_main, r) == 0;
+    }
+    for (int i = 0; i < num_learn; i++) {
+        compared(CHECK_STORE);
+        if (wp_learn(engine, learn[i]) < 0) diverged(CHECK_STORE, "wp_learn \"%s\" failed", learn[i]);
+        if (i % 4 == 3) wp_merge(engine);
+    }
+    atomic_store(&stop, 1);
+    for (int t = 0; t < FUZZ_READERS; t++) {
+        if (!started[t]) continue;
+        pthread_join(threads[t], NULL);
+        comparisons[CHECK_STORE] += readers[t].comparisons;
+        if (readers[t].divergences > 0) {
+            diverged(CHECK_STORE, "reader %d: %lld suggestions outside the reference counts, first %s", t,
+                     readers[t].divergences, readers[t].first);
+            divergences[CHECK_STORE] += readers[t].divergences - 1;
+        }
+    }
+
+    // Every count merged: the published generation matches the reference exactly
+    wp_merge(engine);
+    ngram_model *model = wp_current_model(engine);
+    for (int n = 2; n <= 3; n++) compare_table(CHECK_STORE, n == 2 ? "merged bigram" : "merged trigram", model->tables[n], &after[n]);
+    for (int i = 0; i < after[1].size; i++) {
+        compared(CHECK_STORE);
+        int count = trie_word_count(&model->unigrams, after[1].entries[i].key);
+        if (count != after[1].entries[i].count) {
+            diverged(CHECK_STORE, "merged trie: \"%s\" %d, reference %d", after[1].entries[i].key, count, after[1].entries[i].count);
+        }
+    }
+    for (int q = 0; q < cfg->queries / 4; q++) {
+        char words[3][MAX_TOKEN_LEN], query[MAX_KEY_LEN];
+        int num = pick_context(&after[3], vocab, 1 + rand() % 3, words);
+        const char *context[3] = { words[0], words[1], words[2] };
+        join_key(words, num, "", query);
+        bt_priority_q expected, got;
+        init_bt_pq(&expected);
+        init_bt_pq(&got);
+        ref_backoff(after, words, num, NULL, &expected);
+        predict_ngrams(model, context, num, &got);
+        compare_queues(CHECK_STORE, "merged predict_ngrams", query, &expected, &got);
+        free_bt_q(&expected);
+        free_bt_q(&got);
+    }
+
+    wp_close(engine);
+    free(learn);
+    free(texts);
+    for (int n = 1; n <= 3; n++) ref_free(&after[n]);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--rounds N] [--seed N] [--keys N] [--vocabulary N] [--queries N] [--check name]\n"
+           "Checks: distance tables spelling model engine store\n", prog);
+}
+
+static int check_enabled(const fuzz_config *cfg, fuzz_check check) {
+    return cfg->only == NULL || strcmp(cfg->only, check_names[check]) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    fuzz_config cfg = { 20, 1, 3000, 600, 2000, NULL };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) cfg.rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) cfg.seed = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) cfg.keys = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--vocabulary") == 0 && i + 1 < argc) cfg.vocabulary = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) cfg.queries = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) cfg.only = argv[++i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.vocabulary < 1) cfg.vocabulary = 1;
+    if (cfg.keys < 1) cfg.keys = 1;
+
+    for (int round = 0; round < cfg.rounds; round++) {
+        current_round = round;
+        srand(cfg.seed + (unsigned int)round);
+
+        // The round's vocabulary and n-gram tables
+        ref_table vocab = { NULL, 0, 0 };
+        ref_table refs[4] = { { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 }, { NULL, 0, 0 } };
+        while (vocab.size < cfg.vocabulary) {
+            char word[MAX_TOKEN_LEN];
+            random_word(word);
+            if (ref_count(&vocab, word) == 0) ref_add(&vocab, word, 1 + rand() % (rand() % 8 == 0 ? 100000 : 500));
+        }
+        ref_fill(&refs[2], &vocab, 2, cfg.keys);
+        ref_fill(&refs[3], &vocab, 3, cfg.keys);
+        trie T;
+        init_trie(&T);
+        for (int i = 0; i < vocab.size; i++) insert_word(&T, vocab.entries[i].key, vocab.entries[i].count);
+
+        if (check_enabled(&cfg, CHECK_DISTANCE)) check_distance(&cfg);
+        if (check_enabled(&cfg, CHECK_TABLES)) check_tables(&cfg, &vocab);
+        if (check_enabled(&cfg, CHECK_SPELLING)) {
+            check_spelling(&cfg, &vocab, &T);
+            check_context_spelling(&cfg, &vocab, refs);
+        }
+        if (check_enabled(&cfg, CHECK_MODEL)) check_model(&cfg, &vocab, refs);
+        if (check_enabled(&cfg, CHECK_ENGINE)) check_engine(&cfg, &vocab, refs);
+        if (check_enabled(&cfg, CHECK_STORE)) check_store(&cfg, &vocab, refs);
+
+        free_trie(&T);
+        ref_free(&vocab);
+        for (int n = 2; n <= 3; n++) ref_free(&refs[n]);
+    }
+
+    long long total = 0;
+    for (int c = 0; c < NUM_CHECKS; c++) {
+        if (!check_enabled(&cfg, (fuzz_check)c)) continue;
+        printf("{\"check\":\"%s\",\"comparisons\":%lld,\"divergences\":%lld}\n", check_names[c], comparisons[c], divergences[c]);
+        total += divergences[c];
+    }
+    return total == 0 ? 0 : 1;
+}
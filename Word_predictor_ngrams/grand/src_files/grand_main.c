@@ -1,130 +1,264 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "../header_files/btree.h"
-#include "../header_files/functions.h"
+#include <unistd.h>
+#include "engine.h"
+#include "shard.h"
+#include "prune.h"
+#include "model_stats.h"
+#include "stream.h"
+#include "score.h"
+#include "log.h"
+#include "trace.h"
 
- // Declare word_processor
+static void usage(const char *prog) {
+    printf("Usage: %s [--order N] [--ngrams N file.csv] [--min-count N count]\n"
+           "          [--prune-count N] [--prune-entropy threshold] [--budget bytes]\n"
+           "          [--snapshot model.snap] [--save-snapshot model.snap] [--filter-fpr rate] [--filter-bytes bytes]\n"
+           "          [--stream file|-] [--score file|-] [--threads N] [-v] [--trace-dump file|-] [--stats]\n"
+           "          [--shard I N --serve socket] [--router socket]... [--numa off|replicate|interleave]\n", prog);
+}
+
+// Export the trace histograms and counters (only populated in WP_TRACE builds)
+static void dump_trace(const char *path) {
+    if (path == NULL) return;
+    FILE *out = strcmp(path, "-") == 0 ? stderr : fopen(path, "w");
+    if (out == NULL) {
+        perror("Could not open file");
+        return;
+    }
+    trace_dump(out);
+    if (out != stderr) fclose(out);
+}
+
+// Print every suggestion with the corrected context in front of it
+static void display_suggestions(const wp_suggestion *suggestions, int num, const char *corrected_string) {
+    TRACE_BEGIN(start);
+    for (int i = 0; i < num; i++) {
+        printf("\n-----------------------------------------------------\n");
+        printf("Suggested n-gram: %s\n", suggestions[i].ngram);
+        printf("Count: %d\n", suggestions[i].count);
+        printf("Full Context: %s%s\n", corrected_string, suggestions[i].ngram);
+        printf("-----------------------------------------------------\n");
+    }
+    TRACE_END(TRACE_DISPLAY, start);
+}
+
+int main(int argc, char *argv[]) {
+    wp_options opts;
+    wp_default_options(&opts);
+    const char *snapshot_out = NULL, *stream_path = NULL, *score_path = NULL, *trace_path = NULL, *serve_path = NULL;
+    int prune = 0, show_stats = 0, threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    prune_config prune_cfg;
+    init_prune_config(&prune_cfg);
 
+    // Step 0: Parse the model options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+            opts.source.order = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ngrams") == 0 && i + 2 < argc) {
+            int n = atoi(argv[++i]);
+            if (n >= 1 && n <= MAX_NGRAM_ORDER) opts.source.files[n] = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--min-count") == 0 && i + 2 < argc) {
+            int n = atoi(argv[++i]);
+            if (n >= 1 && n <= MAX_NGRAM_ORDER) opts.source.min_count[n] = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "--prune-count") == 0 && i + 1 < argc) {
+            prune_cfg.min_count = atoi(argv[++i]);
+            prune = 1;
+        } else if (strcmp(argv[i], "--prune-entropy") == 0 && i + 1 < argc) {
+            prune_cfg.method = PRUNE_BY_ENTROPY;
+            prune_cfg.entropy_threshold = atof(argv[++i]);
+            prune = 1;
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            prune_cfg.target_bytes = atoll(argv[++i]);
+            prune = 1;
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            opts.source.snapshot = argv[++i];
+        } else if (strcmp(argv[i], "--filter-fpr") == 0 && i + 1 < argc) {
+            opts.source.filter_fpr = atof(argv[++i]);                                   // 0 turns the context filters off
+        } else if (strcmp(argv[i], "--filter-bytes") == 0 && i + 1 < argc) {
+            opts.source.filter_max_bytes = (size_t)atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--save-snapshot") == 0 && i + 1 < argc) {
+            snapshot_out = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream_path = argv[++i];
+        } else if (strcmp(argv[i], "--score") == 0 && i + 1 < argc) {
+            score_path = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--numa") == 0 && i + 1 < argc && wp_parse_numa_mode(argv[i + 1], &opts.numa) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            log_level++;                                                                // -v: info, -v -v: debug
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+        } else if (strcmp(argv[i], "--trace-dump") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--shard") == 0 && i + 2 < argc) {
+            opts.source.shard = atoi(argv[++i]);
+            opts.source.num_shards = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve_path = argv[++i];
+        } else if (strcmp(argv[i], "--router") == 0 && i + 1 < argc && opts.num_shards < SHARD_MAX) {
+            opts.shards[opts.num_shards++] = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
 
+    // Router mode: this process keeps the dictionary, the shard processes hold the n-gram tables
+    if (opts.num_shards > 0) {
+        opts.source.shard = NGRAM_SHARD_NONE;
+        opts.source.num_shards = opts.num_shards;
+    }
 
-int main() {
-    // Step 1: Initialize the trie and load unigrams
-    trie T;
-    init_trie(&T);
-    process_csv_file("./dataset/unigrams_4000.csv", &T);
+    // Stats mode: a snapshot answers from its header alone, a CSV model is loaded and walked once.
+    // The exit status is 2 when an invariant check failed
+    if (show_stats) {
+        ngram_stats stats;
+        if (opts.source.snapshot != NULL) {
+            if (read_snapshot_stats(opts.source.snapshot, &stats) != 0) return 1;
+        } else {
+            ngram_model *model = load_ngram_model(&opts.source);
+            if (model == NULL) return 1;
+            compute_ngram_stats(model, &stats);
+            free_ngram_model(model);
+            free(model);
+        }
+        display_ngram_stats(&stats);
+        return stats.violations == 0 ? 0 : 2;
+    }
 
-    // Step 2: Initialize and load bigram and trigram B+ trees
-    BPlusTree* bi_B_plus_tree = createBPlusTree();
-    readCSVAndInsert(bi_B_plus_tree, "./dataset/bigrams_2000.csv");
+    // Step 1 and 2: Load the unigram trie and every n-gram table, from a snapshot or the CSV datasets
+    ngram_model *model = load_ngram_model(&opts.source);
+    if (model == NULL) {
+        return 1;
+    }
 
-    BPlusTree* tri_B_plus_tree = createBPlusTree();
-    readCSVAndInsert(tri_B_plus_tree, "./dataset/trigrams_1000.csv");
+    // Shard mode: serve this partition to a router until killed
+    if (serve_path != NULL) {
+        shard_serve(model, serve_path);
+        free_ngram_model(model);
+        free(model);
+        return 1;
+    }
+    if (prune) {
+        prune_report report;
+        if (prune_ngram_model(model, &prune_cfg, &report) == 0) {
+            display_prune_report(&report);
+        }
+    }
+
+    // Score mode: one line of scores per input sentence, then the totals (after any pruning, so
+    // builds can be compared on the same evaluation text)
+    if (score_path != NULL) {
+        FILE *in = strcmp(score_path, "-") == 0 ? stdin : fopen(score_path, "r");
+        int status = 1;
+        if (in == NULL) {
+            perror("Could not open file");
+        } else {
+            threadpool pool;
+            score_totals totals;
+            threadpool_init(&pool, threads > 1 ? threads - 1 : 0);                      // The calling thread works too
+            status = score_stream(in, stdout, model, &pool, &totals) == 0 ? 0 : 1;
+            if (status == 0) display_score_totals(stdout, &totals);
+            dump_trace(trace_path);
+            threadpool_destroy(&pool);
+        }
+        if (in != NULL && in != stdin) fclose(in);
+        free_ngram_model(model);
+        free(model);
+        return status;
+    }
+    if (snapshot_out != NULL) {
+        int status = save_ngram_snapshot(model, snapshot_out);
+        free_ngram_model(model);
+        free(model);
+        return status == 0 ? 0 : 1;
+    }
+
+    // Bulk mode: correct a whole document from a file or a pipe instead of one interactive line
+    if (stream_path != NULL) {
+        opts.cache_capacity = 1 << 16;
+    }
+    wp_engine *engine = wp_open_model(model, &opts);
+    if (engine == NULL) {
+        free_ngram_model(model);
+        free(model);
+        return 1;
+    }
+    if (stream_path != NULL) {
+        FILE *in = strcmp(stream_path, "-") == 0 ? stdin : fopen(stream_path, "r");
+        threadpool pool;
+        int status = 1;
+        if (in == NULL) {
+            perror("Could not open file");
+        } else {
+            threadpool_init(&pool, threads > 1 ? threads - 1 : 0);                      // The calling thread works too
+            status = stream_correct(in, stdout, &wp_current_model(engine)->unigrams, &engine->cache, &pool) == 0 ? 0 : 1;
+            if (log_level >= LOG_LEVEL_INFO) display_spell_cache_stats(&engine->cache);
+            dump_trace(trace_path);
+            threadpool_destroy(&pool);
+        }
+        if (in != NULL && in != stdin) fclose(in);
+        wp_close(engine);
+        return status;
+    }
 
     // Step 3: Get user input
     char user_string[500];
-    printf("\n[DEBUG] Enter a string for prediction: ");
+    printf("\nEnter a string for prediction: ");
     if (fgets(user_string, sizeof(user_string), stdin) != NULL) {
         size_t len = strlen(user_string);
         if (len > 0 && user_string[len - 1] == '\n') {
             user_string[len - 1] = '\0'; // Remove newline character
         }
+    } else {
+        user_string[0] = '\0';
     }
-    // printf("[DEBUG] User input received: %s\n", user_string);
-
-    // Step 4: Tokenize user input and initialize stacks
-    priority_Q res1, res2;
-    init_priority_Q(&res1);
-    init_priority_Q(&res2);
-    stack s, processed_stack;
-    init_stack(&s);
-    init_stack(&processed_stack);
-    tokenize_user_string(user_string, &s);
-
-    // Step 5: Extract the last two words for prediction
-    char *input_word1 = NULL, *input_word2 = NULL;
-    int word_count = 0;
-
-    for (int i = 0; i < 2; i++) {
-        char *temp = NULL;
-        while ((temp = pop(&s)) != NULL) {
-            printf("[DEBUG] Popped token: %s\n", temp);
-            if (is_word(temp)) {
-                if (i == 0) {
-                    input_word2 = temp;
-                    word_count++;
-                    // printf("[DEBUG] First word for prediction: %s\n", input_word2);
-                } else {
-                    input_word1 = temp;
-                    word_count++;
-                    // printf("[DEBUG] Second word for prediction: %s\n", input_word1);
-                }
-                break;
-            }
-            free(temp);
-        }
-    }
-
-    // Step 6: Process remaining words and get the corrected string
-    // printf("[DEBUG] Processing remaining words and correcting string...\n");
-    char *corrected_string = word_processor(&s, &processed_stack, &T);
-    // printf("[DEBUG] Corrected string: %s\n", corrected_string);
-
-    word_element search_set[2];
-    backoff(T, input_word1, input_word2, search_set,&res1, &res2);
 
-    printf("[DEBUG] Search Set contains %d words:\n", word_count);
-    for (int i = 0; i < 2; i++) {
-        printf("[DEBUG] search_set[%d]: %s\n", i, search_set[i].word);
+    // Step 4: Spell check the context words and predict, backing off one order at a time
+    wp_suggestion suggestions[WP_MAX_SUGGESTIONS];
+    wp_context ctx;
+    int found = wp_predict(engine, user_string, suggestions, WP_MAX_SUGGESTIONS, &ctx);
+    for (int i = 0; i < ctx.num_words; i++) {
+        LOG_DEBUG("Context word %d: %s", i, ctx.words[i]);
     }
-    
-    bt_priority_q bt_q;
-    init_bt_pq(&bt_q);
 
-    // // Step 7: Perform word prediction with backoff
-    if (word_count == 2) {
-        printf("[DEBUG] Two words found. Starting trigram search...\n");
-        searchNGrams(tri_B_plus_tree, search_set[0].word, search_set[1].word, &bt_q);
+    // Step 5: Correct the text in front of the context words
+    char corrected_string[(sizeof(user_string) / 2 + 1 + WP_MAX_CONTEXT_WORDS) * MAX_TOKEN_LEN];      // Every token may grow to a full word
+    if (found < 0 || wp_correct(engine, user_string, (size_t)ctx.offset, corrected_string, sizeof(corrected_string)) < 0) {
+        wp_close(engine);
+        return 1;
+    }
 
-        if (bt_q.top > 0) {
-            printf("[DEBUG] Trigram search successful. Displaying results...\n");
-            display_unique_bt_q(&bt_q, corrected_string);
-        } else {
-            printf("[DEBUG] No trigrams found. Backing off to bigram search...\n");
-            //but here concatenate search_set[0] to the corrected string
-            strcat(corrected_string, search_set[0].word);
+    // Step 6: Display the suggestions with the corrected context
+    if (found > 0) {
+        // Context words that were dropped while backing off stay in front of the suggestion
+        for (int i = 0; i < ctx.num_words - (ctx.order - 1); i++) {
+            strcat(corrected_string, ctx.words[i]);
             strcat(corrected_string, " ");
-            searchNGrams(bi_B_plus_tree, search_set[1].word, NULL, &bt_q);
-
-            if (bt_q.top > 0) {
-                printf("[DEBUG] Bigram search successful. Displaying results...\n");
-                display_unique_bt_q(&bt_q, corrected_string);
-            } else {
-                printf("[DEBUG] No suggestions found. Returning the corrected string.\n");
-                printf("Final Context: %s%s %s\n", corrected_string, input_word1, input_word2);
-            }
         }
-    } else if (word_count == 1) {
-        printf("[DEBUG] One word found. Starting bigram search...\n");
-        searchNGrams(bi_B_plus_tree, search_set[1].word, NULL, &bt_q);
-
-        if (bt_q.top > 0) {
-            printf("[DEBUG] Bigram search successful. Displaying results...\n");
-            display_unique_bt_q(&bt_q, corrected_string);
-        } else {
-            printf("[DEBUG] No suggestions found. Concatenating corrected string.\n");
-            printf("Final Context: %s%s\n", corrected_string, input_word2);
+        LOG_DEBUG("%d-gram search successful. Displaying results...", ctx.order);
+        display_suggestions(suggestions, found, corrected_string);
+    } else if (ctx.num_words > 0) {
+        LOG_DEBUG("No suggestions found. Returning the corrected string.");
+        printf("Final Context: %s", corrected_string);
+        for (int i = 0; i < ctx.num_words; i++) {
+            printf("%s%s", ctx.words[i], i + 1 < ctx.num_words ? " " : "\n");
         }
     } else {
-        printf("[DEBUG] No valid words for prediction. Returning the corrected string.\n");
+        LOG_DEBUG("No valid words for prediction. Returning the corrected string.");
         printf("Final Context: %s\n", corrected_string);
     }
 
     // Cleanup
-    free_bt_q(&bt_q);
-    free(corrected_string);
-    if (input_word1) free(input_word1);
-    if (input_word2) free(input_word2);
+    if (log_level >= LOG_LEVEL_INFO) display_spell_cache_stats(&engine->cache);
+    dump_trace(trace_path);
+    wp_close(engine);
 
     return 0;
 }
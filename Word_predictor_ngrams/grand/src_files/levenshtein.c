@@ -0,0 +1,200 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "levenshtein.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+// Match masks of the pattern: bit i of peq[c] is set when pattern[i] == c
+static void build_peq(uint64_t peq[256], const char *pattern, int m) {
+    for (int i = 0; i < m; i++) {
+        peq[(unsigned char)pattern[i]] |= 1ULL << i;
+    }
+}
+
+// Single word kernel, pattern length 1..64
+static int myers64(const uint64_t peq[256], int m, const char *text, int n) {
+    uint64_t pv = ~0ULL, mv = 0;
+    uint64_t high = 1ULL << (m - 1);
+    int score = m;
+    for (int j = 0; j < n; j++) {
+        uint64_t eq = peq[(unsigned char)text[j]];
+        uint64_t xv = eq | mv;
+        uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if (ph & high) score++;
+        else if (mh & high) score--;
+        ph = (ph << 1) | 1;                                                             // Top row grows by one per column
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+    }
+    return score;
+}
+
+// Blocked kernel for patterns longer than 64 bytes: horizontal deltas carry from block to block.
+// Patterns up to LEVENSHTEIN_STACK_BLOCKS words (every token) keep their state on the stack
+static int myers_blocked(const char *pattern, int m, const char *text, int n) {
+    int blocks = (m + LEVENSHTEIN_WORD_BITS - 1) / LEVENSHTEIN_WORD_BITS;
+    uint64_t stack_peq[256 * LEVENSHTEIN_STACK_BLOCKS], stack_pv[LEVENSHTEIN_STACK_BLOCKS], stack_mv[LEVENSHTEIN_STACK_BLOCKS];
+    int on_stack = blocks <= LEVENSHTEIN_STACK_BLOCKS;
+    uint64_t *peq = on_stack ? stack_peq : (uint64_t *)malloc(sizeof(uint64_t) * 256 * (size_t)blocks);
+    uint64_t *pv = on_stack ? stack_pv : (uint64_t *)malloc(sizeof(uint64_t) * (size_t)blocks);
+    uint64_t *mv = on_stack ? stack_mv : (uint64_t *)malloc(sizeof(uint64_t) * (size_t)blocks);
+    if (peq == NULL || pv == NULL || mv == NULL) {
+        free(peq);
+        free(pv);
+        free(mv);
+        return m + n;                                                                   // Above any real distance, so it never wins
+    }
+    memset(peq, 0, sizeof(uint64_t) * 256 * (size_t)blocks);
+    memset(mv, 0, sizeof(uint64_t) * (size_t)blocks);
+    for (int i = 0; i < m; i++) {
+        peq[(size_t)(unsigned char)pattern[i] * blocks + i / LEVENSHTEIN_WORD_BITS] |= 1ULL << (i % LEVENSHTEIN_WORD_BITS);
+    }
+    for (int b = 0; b < blocks; b++) {
+        pv[b] = ~0ULL;
+    }
+    uint64_t last_high = 1ULL << ((m - 1) % LEVENSHTEIN_WORD_BITS);
+
+    int score = m;
+    for (int j = 0; j < n; j++) {
+        const uint64_t *eq_col = &peq[(size_t)(unsigned char)text[j] * blocks];
+        int hin = 1;
+        for (int b = 0; b < blocks; b++) {
+            uint64_t eq = eq_col[b];
+            uint64_t xv = eq | mv[b];
+            if (hin < 0) eq |= 1;
+            uint64_t xh = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+            uint64_t ph = mv[b] | ~(xh | pv[b]);
+            uint64_t mh = pv[b] & xh;
+            uint64_t high = b == blocks - 1 ? last_high : 1ULL << 63;
+            int hout = (ph & high) ? 1 : (mh & high) ? -1 : 0;
+            ph <<= 1;
+            mh <<= 1;
+            if (hin < 0) mh |= 1;
+            else if (hin > 0) ph |= 1;
+            pv[b] = mh | ~(xv | ph);
+            mv[b] = ph & xv;
+            hin = hout;
+        }
+        score += hin;
+    }
+
+    if (!on_stack) {
+        free(peq);
+        free(pv);
+        free(mv);
+    }
+    return score;
+}
+
+// Raw edit distance, running the shorter string as the pattern
+int levenshtein_distance(const char *a, int len_a, const char *b, int len_b) {
+    if (len_a > len_b) {
+        const char *t = a; a = b; b = t;
+        int tl = len_a; len_a = len_b; len_b = tl;
+    }
+    if (len_a == 0) {
+        return len_b;
+    }
+    if (len_a <= LEVENSHTEIN_WORD_BITS) {
+        uint64_t peq[256] = {0};
+        build_peq(peq, a, len_a);
+        return myers64(peq, len_a, b, len_b);
+    }
+    return myers_blocked(a, len_a, b, len_b);
+}
+
+// Normalize by the average length, like edit_distance
+static float to_ratio(int distance, int len_a, int len_b) {
+    float average_len = (float)(len_a + len_b) / 2.0f;
+    return average_len > 0.0f ? (float)distance / average_len : 0.0f;
+}
+
+float levenshtein_ratio(const char *a, const char *b) {
+    int len_a = (int)strlen(a), len_b = (int)strlen(b);
+    return to_ratio(levenshtein_distance(a, len_a, b, len_b), len_a, len_b);
+}
+
+#ifdef HAVE_AVX2_KERNEL
+// Four candidates per step, one per 64-bit lane; lanes past the end of their candidate are frozen
+__attribute__((target("avx2")))
+static void myers64_x4_avx2(const uint64_t peq[256], int m, const char *const text[4], const int len[4], int out[4]) {
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256i pv = ones, mv = _mm256_setzero_si256(), score = _mm256_set1_epi64x(m);
+    int max_len = len[0];
+    for (int k = 1; k < 4; k++) {
+        if (len[k] > max_len) max_len = len[k];
+    }
+
+    for (int j = 0; j < max_len; j++) {
+        uint64_t e[4];
+        long long active[4];
+        for (int k = 0; k < 4; k++) {
+            int live = j < len[k];
+            e[k] = live ? peq[(unsigned char)text[k][j]] : 0;
+            active[k] = live ? -1 : 0;
+        }
+        __m256i eq = _mm256_set_epi64x((long long)e[3], (long long)e[2], (long long)e[1], (long long)e[0]);
+        __m256i live = _mm256_set_epi64x(active[3], active[2], active[1], active[0]);
+
+        __m256i xv = _mm256_or_si256(eq, mv);
+        __m256i sum = _mm256_add_epi64(_mm256_and_si256(eq, pv), pv);
+        __m256i xh = _mm256_or_si256(_mm256_xor_si256(sum, pv), eq);
+        __m256i ph = _mm256_or_si256(mv, _mm256_andnot_si256(_mm256_or_si256(xh, pv), ones));
+        __m256i mh = _mm256_and_si256(pv, xh);
+
+        __m256i up = _mm256_and_si256(_mm256_srli_epi64(ph, m - 1), one);
+        __m256i down = _mm256_and_si256(_mm256_srli_epi64(mh, m - 1), one);
+        score = _mm256_add_epi64(score, _mm256_and_si256(_mm256_sub_epi64(up, down), live));
+
+        ph = _mm256_or_si256(_mm256_slli_epi64(ph, 1), one);
+        mh = _mm256_slli_epi64(mh, 1);
+        __m256i next_pv = _mm256_or_si256(mh, _mm256_andnot_si256(_mm256_or_si256(xv, ph), ones));
+        __m256i next_mv = _mm256_and_si256(ph, xv);
+        pv = _mm256_blendv_epi8(pv, next_pv, live);
+        mv = _mm256_blendv_epi8(mv, next_mv, live);
+    }
+
+    long long s[4];
+    _mm256_storeu_si256((__m256i *)s, score);
+    for (int k = 0; k < 4; k++) {
+        out[k] = (int)s[k];
+    }
+}
+#endif
+
+// One query against many candidates
+void levenshtein_ratio_batch(const char *query, const char *const candidates[], int num_candidates, float out[]) {
+    int m = (int)strlen(query);
+    int i = 0;
+
+#ifdef HAVE_AVX2_KERNEL
+    // The query is the pattern in every lane; a candidate longer than the query is still fine
+    // because the recurrence is symmetric in the final distance
+    if (m > 0 && m <= LEVENSHTEIN_WORD_BITS && __builtin_cpu_supports("avx2")) {
+        uint64_t peq[256] = {0};
+        build_peq(peq, query, m);
+        for (; i + 4 <= num_candidates; i += 4) {
+            int len[4], dist[4];
+            for (int k = 0; k < 4; k++) {
+                len[k] = (int)strlen(candidates[i + k]);
+            }
+            myers64_x4_avx2(peq, m, candidates + i, len, dist);
+            for (int k = 0; k < 4; k++) {
+                out[i + k] = to_ratio(dist[k], m, len[k]);
+            }
+        }
+    }
+#endif
+
+    for (; i < num_candidates; i++) {
+        out[i] = levenshtein_ratio(query, candidates[i]);
+    }
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include "log.h"
+
+int log_level = LOG_LEVEL_WARN;
+
+static const char *level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+// One fprintf per message so lines from different threads do not interleave
+void log_write(int level, const char *fmt, ...) {
+    char message[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    fprintf(stderr, "[%s] %s\n", level_names[level], message);
+}
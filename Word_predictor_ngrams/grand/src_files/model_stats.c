@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "model_stats.h"
+
+// Count the trie nodes and words below p
+static void stat_trie(const trie_node *p, ngram_stats *stats) {
+    if (p == NULL) return;
+    stats->trie_nodes++;
+    if (p->isEndOfWord) {
+        stats->vocabulary++;
+        stats->unigram_total += p->count;
+        if (p->count <= 0) stats->violations |= STATS_CHECK_UNIGRAM_COUNT;
+    }
+    for (int i = 0; i < 26; i++) {
+        stat_trie(p->children[i], stats);
+    }
+}
+
+void compute_ngram_stats(const ngram_model *model, ngram_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->order = model->order;
+    stat_trie(model->unigrams.root, stats);
+    stats->trie_bytes = stats->trie_nodes * (long long)sizeof(trie_node);
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        statBPlusTree(model->tables[n], &stats->tables[n]);
+        stats->violations |= stats->tables[n].violations;
+    }
+    stats->filter_bytes = (long long)ngram_filter_memory_usage(model);
+}
+
+// Only the fixed header and the stats block are read (layout in save_ngram_snapshot)
+int read_snapshot_stats(const char *filename, ngram_stats *stats) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        perror("Could not open file");
+        return -1;
+    }
+    char magic[4];
+    uint32_t header[3];
+    int status = -1;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, NGRAM_SNAPSHOT_MAGIC, 4) != 0
+        || fread(header, sizeof(uint32_t), 2, file) != 2) {
+        printf("Invalid snapshot file %s\n", filename);
+    } else if (header[0] < NGRAM_SNAPSHOT_VERSION) {
+        printf("Snapshot %s has no stored statistics (version %u): save it again\n", filename, header[0]);
+    } else if (fread(&header[2], sizeof(uint32_t), 1, file) != 1 || header[2] != sizeof(ngram_stats)
+               || fread(stats, sizeof(ngram_stats), 1, file) != 1) {
+        printf("Snapshot %s holds statistics from a different build\n", filename);
+    } else {
+        status = 0;
+    }
+    fclose(file);
+    return status;
+}
+
+void display_ngram_stats(const ngram_stats *stats) {
+    static const char *bucket_names[BTREE_KEY_LEN_BUCKETS] = { "<8", "<16", "<32", "<64", "<128", ">=128" };
+    printf("Model statistics (order %d):\n", stats->order);
+    printf("  unigrams: %lld words, total count %lld, %lld trie nodes, %lld bytes\n",
+           stats->vocabulary, stats->unigram_total, stats->trie_nodes, stats->trie_bytes);
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        const BTreeStats *t = &stats->tables[n];
+        if (t->bytes == 0) continue;
+        printf("  %d-grams: %lld entries, total count %lld, max count %d, %lld bytes\n",
+               n, t->keys, t->totalCount, t->maxCount, t->bytes);
+        if (t->height > 0) {
+            printf("    tree: height %d, %lld nodes, %.1f%% full\n", t->height, t->nodes, t->fill * 100.0);
+        } else {
+            printf("    packed: %lld blocks, %.1f%% full\n", t->nodes, t->fill * 100.0);
+        }
+        printf("    key lengths:");
+        for (int b = 0; b < BTREE_KEY_LEN_BUCKETS; b++) {
+            printf(" %s:%lld", bucket_names[b], t->keyLengths[b]);
+        }
+        printf("\n");
+    }
+    printf("  context filters: %lld bytes\n", stats->filter_bytes);
+    if (stats->violations == 0) {
+        printf("  invariants: ok\n");
+        return;
+    }
+    printf("  invariants: FAILED%s%s%s%s%s\n",
+           stats->violations & BTREE_CHECK_UNSORTED ? " unsorted-keys" : "",
+           stats->violations & BTREE_CHECK_SEPARATOR ? " bad-separator" : "",
+           stats->violations & BTREE_CHECK_COUNT ? " bad-count" : "",
+           stats->violations & BTREE_CHECK_SHAPE ? " bad-shape" : "",
+           stats->violations & STATS_CHECK_UNIGRAM_COUNT ? " bad-unigram-count" : "");
+}
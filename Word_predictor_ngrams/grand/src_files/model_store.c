@@ -0,0 +1,475 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include "model_store.h"
+#include "ranking.h"
+#include "log.h"
+
+// One thread's claim on a slot of one store, kept in that thread's list until it exits
+typedef struct reader_binding {
+    _Atomic(model_store *) store;               // NULL once the store was destroyed (the binding can be reused).
+    int slot;
+    struct reader_binding *next;
+} reader_binding;
+
+static pthread_mutex_t binding_lock = PTHREAD_MUTEX_INITIALIZER;                       // Thread exit against store destroy
+static pthread_once_t binding_once = PTHREAD_ONCE_INIT;
+static pthread_key_t binding_key;                                                       // Runs unbind_thread at thread exit
+static _Thread_local reader_binding *thread_bindings;
+
+// Free a heap allocated generation
+static void free_generation(ngram_model *model) {
+    if (model == NULL) return;
+    free_ngram_model(model);
+    free(model);
+}
+
+// Initialise the store with its first generation
+int model_store_init(model_store *store, ngram_model *initial) {
+    initial->generation = 1;
+    store->published = 1;
+    atomic_init(&store->current, initial);
+    atomic_init(&store->order, initial->order);
+    atomic_init(&store->epoch, 1);
+    void *memory;
+    if (posix_memalign(&memory, READER_SLOT_BYTES, sizeof(model_store_reader) * MAX_READER_SLOTS) != 0) {
+        store->readers = NULL;
+        return -1;
+    }
+    store->readers = (model_store_reader *)memory;
+    for (int i = 0; i < MAX_READER_SLOTS; i++) {
+        atomic_init(&store->readers[i].epoch, 0);
+        atomic_init(&store->readers[i].used, 0);
+        store->readers[i].binding = NULL;
+    }
+    for (int i = 0; i < DELTA_TABLE_SIZE; i++) {
+        store->deltas[i] = NULL;
+    }
+    store->pending_deltas = 0;
+    atomic_init(&store->merger_running, 0);
+    atomic_init(&store->reload_running, 0);
+    store->reload_status = 0;
+    store->merge_interval_ms = 0;
+    if (pthread_mutex_init(&store->writer_lock, NULL) != 0) return -1;
+    if (pthread_mutex_init(&store->delta_lock, NULL) != 0) return -1;
+    if (pthread_mutex_init(&store->reload_lock, NULL) != 0) return -1;
+    if (pthread_cond_init(&store->reload_done, NULL) != 0) return -1;
+    return 0;
+}
+
+// Claim the first free reader slot
+int model_store_register_reader(model_store *store) {
+    for (int i = 0; i < MAX_READER_SLOTS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&store->readers[i].used, &expected, 1)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Give a reader slot back
+void model_store_unregister_reader(model_store *store, int slot) {
+    atomic_store(&store->readers[slot].epoch, 0);
+    atomic_store(&store->readers[slot].used, 0);
+}
+
+// Give back every slot the exiting thread kept in a store that still exists
+static void unbind_thread(void *head) {
+    pthread_mutex_lock(&binding_lock);
+    for (reader_binding *b = (reader_binding *)head, *next; b != NULL; b = next) {
+        next = b->next;
+        model_store *store = atomic_load(&b->store);
+        if (store != NULL) {
+            store->readers[b->slot].binding = NULL;
+            model_store_unregister_reader(store, b->slot);
+        }
+        free(b);
+    }
+    pthread_mutex_unlock(&binding_lock);
+}
+
+static void create_binding_key(void) {
+    pthread_key_create(&binding_key, unbind_thread);
+}
+
+// First read of the store on this thread: claim a slot and remember it, reusing a binding left
+// behind by a destroyed store
+static int bind_thread(model_store *store) {
+    pthread_once(&binding_once, create_binding_key);
+    pthread_mutex_lock(&binding_lock);
+    int slot = model_store_register_reader(store);
+    if (slot >= 0) {
+        reader_binding *b = thread_bindings;
+        while (b != NULL && atomic_load(&b->store) != NULL) b = b->next;
+        if (b == NULL && (b = (reader_binding *)malloc(sizeof(reader_binding))) != NULL) {
+            b->next = thread_bindings;
+            thread_bindings = b;
+            pthread_setspecific(binding_key, b);
+        }
+        if (b != NULL) {
+            b->slot = slot;
+            atomic_store(&b->store, store);
+            store->readers[slot].binding = b;
+        } else {
+            model_store_unregister_reader(store, slot);
+            slot = -1;
+        }
+    }
+    pthread_mutex_unlock(&binding_lock);
+    return slot;
+}
+
+// The slot this thread already keeps, or a new one
+int model_store_thread_slot(model_store *store) {
+    for (reader_binding *b = thread_bindings; b != NULL; b = b->next) {
+        if (atomic_load_explicit(&b->store, memory_order_relaxed) == store) {
+            return b->slot;
+        }
+    }
+    return bind_thread(store);
+}
+
+// Announce the epoch first, then load the pointer: a writer that advanced the epoch after
+// swapping the pointer either sees our announcement or we see its new generation
+const ngram_model *model_store_acquire(model_store *store, int slot) {
+    atomic_store(&store->readers[slot].epoch, atomic_load(&store->epoch));
+    return atomic_load(&store->current);
+}
+
+// Leave the read-side critical section
+void model_store_release(model_store *store, int slot) {
+    atomic_store_explicit(&store->readers[slot].epoch, 0, memory_order_release);
+}
+
+// Wait for a grace period: every reader is idle or entered after the epoch advanced
+void model_store_synchronize(model_store *store) {
+    unsigned long long target = atomic_fetch_add(&store->epoch, 1) + 1;
+    for (int i = 0; i < MAX_READER_SLOTS; i++) {
+        unsigned long long seen;
+        while ((seen = atomic_load(&store->readers[i].epoch)) != 0 && seen < target) {
+            sched_yield();
+        }
+    }
+}
+
+// Swap in a new generation and reclaim the old one once no reader can hold it (writer lock held)
+static void publish_locked(model_store *store, ngram_model *next) {
+    next->generation = ++store->published;
+    atomic_store(&store->order, next->order);
+    ngram_model *old = atomic_exchange(&store->current, next);
+    model_store_synchronize(store);
+    free_generation(old);
+}
+
+// A new generation ranks corrections like the current one: give its trie a vocabulary when the
+// current trie has one (writer lock held, so the current generation cannot be freed meanwhile)
+static void carry_vocab(model_store *store, ngram_model *next) {
+    const ngram_model *current = atomic_load(&store->current);
+    if (current->unigrams.vocab != NULL && next->unigrams.vocab == NULL && attach_ranking_vocab(&next->unigrams) != 0) {
+        LOG_WARN("No ranking vocabulary for generation %llu; corrections fall back to plain fuzzy matching",
+                 store->published + 1);
+    }
+}
+
+// Publish a generation built by the caller
+void model_store_publish(model_store *store, ngram_model *next) {
+    pthread_mutex_lock(&store->writer_lock);
+    carry_vocab(store, next);
+    publish_locked(store, next);
+    pthread_mutex_unlock(&store->writer_lock);
+}
+
+// Queue a count delta, merging it with any pending delta for the same n-gram
+int model_store_add_delta(model_store *store, const char *ngram, long long delta) {
+    int order = ngram_word_count(ngram);
+    if (order < 1 || order > MAX_NGRAM_ORDER || strlen(ngram) >= MAX_NGRAM_LEN || delta == 0) {
+        return -1;
+    }
+    unsigned long long bucket = hash_ngram(ngram) % DELTA_TABLE_SIZE;
+
+    pthread_mutex_lock(&store->delta_lock);
+    for (delta_entry *e = store->deltas[bucket]; e != NULL; e = e->next) {
+        if (strcmp(e->ngram, ngram) == 0) {
+            e->delta += delta;
+            pthread_mutex_unlock(&store->delta_lock);
+            return 0;
+        }
+    }
+    delta_entry *e = (delta_entry *)malloc(sizeof(delta_entry));
+    if (e == NULL) {
+        pthread_mutex_unlock(&store->delta_lock);
+        return -1;
+    }
+    strcpy(e->ngram, ngram);
+    e->order = order;
+    e->delta = delta;
+    e->next = store->deltas[bucket];
+    store->deltas[bucket] = e;
+    store->pending_deltas++;
+    pthread_mutex_unlock(&store->delta_lock);
+    return 0;
+}
+
+// Queue +1 for every n-gram of the word sequence, up to the order of the current model
+void model_store_learn_words(model_store *store, const char *words[], int num_words) {
+    int order = atomic_load(&store->order);
+    for (int start = 0; start < num_words; start++) {
+        char key[MAX_NGRAM_LEN];
+        size_t len = 0;
+        for (int n = 1; n <= order && start + n <= num_words; n++) {
+            const char *w = words[start + n - 1];
+            size_t wlen = strlen(w);
+            if (wlen == 0 || len + wlen + 2 > sizeof(key)) break;
+            if (n > 1) key[len++] = ' ';
+            memcpy(key + len, w, wlen);
+            len += wlen;
+            key[len] = '\0';
+            model_store_add_delta(store, key, 1);
+        }
+    }
+}
+
+// Apply one unigram delta to a private trie
+static void apply_unigram_delta(ngram_model *model, const char *word, long long delta) {
+    for (const char *c = word; *c != '\0'; c++) {
+        if (*c < 'a' || *c > 'z') return;                                               // The trie only indexes a-z
+    }
+    if (delta > 0) {
+        insert_word(&model->unigrams, word, delta > INT_MAX ? INT_MAX : (int)delta);
+    } else {
+        decrement_word(&model->unigrams, word, delta < -INT_MAX ? INT_MAX : (int)-delta);
+    }
+}
+
+// Apply the batch to a model that shares the current generation's structures. Only an order with
+// pending deltas gets a private copy: unigrams one by one, every n-gram table with one bulk pass,
+// then the table is packed and its filter rebuilt. Returns -1 if memory ran out
+static int apply_deltas(ngram_model *model, delta_entry *batch[], long pending) {
+    ngram_delta *updates = (ngram_delta *)malloc(sizeof(ngram_delta) * (size_t)pending);
+    if (updates == NULL) return -1;
+    for (int n = 1; n <= model->order; n++) {
+        int count = 0;
+        for (int i = 0; i < DELTA_TABLE_SIZE; i++) {
+            for (delta_entry *e = batch[i]; e != NULL; e = e->next) {
+                if (e->order != n) continue;
+                updates[count].ngram = e->ngram;
+                updates[count].delta = e->delta;
+                count++;
+            }
+        }
+        if (count == 0) continue;
+        if (unshare_ngram_order(model, n) != 0) {
+            free(updates);
+            return -1;
+        }
+        if (n == 1) {
+            for (int i = 0; i < count; i++) {
+                apply_unigram_delta(model, updates[i].ngram, updates[i].delta);
+            }
+            continue;
+        }
+        if (model->tables[n] == NULL) {
+            model->tables[n] = createBPlusTree();
+        }
+        if (model->tables[n] == NULL || applyNGramDeltas(model->tables[n], updates, count) < 0) {
+            free(updates);
+            return -1;
+        }
+        compact_ngram_table(model, n);                                                  // Fold the nodes the deltas added
+    }
+    free(updates);
+    return 0;
+}
+
+// Free a detached batch, putting its deltas back in the pending table first when requeue is set
+static void release_batch(model_store *store, delta_entry *batch[], int requeue) {
+    for (int i = 0; i < DELTA_TABLE_SIZE; i++) {
+        for (delta_entry *e = batch[i], *n; e != NULL; e = n) {
+            n = e->next;
+            if (requeue) model_store_add_delta(store, e->ngram, e->delta);
+            free(e);
+        }
+    }
+}
+
+// Merge the pending deltas into the next generation and publish it. The next generation shares
+// every table the batch does not touch with the current one and takes ownership of them on publish
+long model_store_merge(model_store *store) {
+    pthread_mutex_lock(&store->writer_lock);
+
+    // Detach the pending deltas so traffic can keep queueing while we merge
+    delta_entry *batch[DELTA_TABLE_SIZE];
+    pthread_mutex_lock(&store->delta_lock);
+    long pending = store->pending_deltas;
+    memcpy(batch, store->deltas, sizeof(batch));
+    memset(store->deltas, 0, sizeof(store->deltas));
+    store->pending_deltas = 0;
+    pthread_mutex_unlock(&store->delta_lock);
+
+    if (pending == 0) {
+        pthread_mutex_unlock(&store->writer_lock);
+        return 0;
+    }
+
+    // Only the writer swaps generations, so the current one cannot be freed under us
+    ngram_model *current = atomic_load(&store->current);
+    ngram_model *next = share_ngram_model(current);
+    int status = next != NULL ? apply_deltas(next, batch, pending) : -1;
+    release_batch(store, batch, status != 0);                                           // Requeue on failure
+    if (status != 0) {
+        free_generation(next);                                                          // Frees only the orders it copied
+        pthread_mutex_unlock(&store->writer_lock);
+        return -1;
+    }
+    carry_vocab(store, next);
+    hand_on_ngram_model(current, next);                                                 // Readers of current keep them until it is freed
+    publish_locked(store, next);
+    pthread_mutex_unlock(&store->writer_lock);
+    return pending;
+}
+
+// Background merge loop
+static void *merger_main(void *arg) {
+    model_store *store = (model_store *)arg;
+    struct timespec interval = {
+        store->merge_interval_ms / 1000,
+        (long)(store->merge_interval_ms % 1000) * 1000000L
+    };
+    while (atomic_load(&store->merger_running)) {
+        nanosleep(&interval, NULL);
+        model_store_merge(store);
+    }
+    return NULL;
+}
+
+// Start merging periodically in the background
+int model_store_start_merger(model_store *store, int interval_ms) {
+    if (atomic_load(&store->merger_running)) return 0;
+    store->merge_interval_ms = interval_ms > 0 ? interval_ms : 1000;
+    atomic_store(&store->merger_running, 1);
+    if (pthread_create(&store->merger, NULL, merger_main, store) != 0) {
+        atomic_store(&store->merger_running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the merge thread and flush what is left
+void model_store_stop_merger(model_store *store) {
+    if (!atomic_exchange(&store->merger_running, 0)) return;
+    pthread_join(store->merger, NULL);
+    model_store_merge(store);
+}
+
+// A reload request owns copies of the source paths
+typedef struct {
+    model_store *store;
+    ngram_source source;
+} reload_job;
+
+// Release the strings copied into a reload job
+static void free_reload_job(reload_job *job) {
+    free((char *)job->source.snapshot);
+    for (int n = 0; n <= MAX_NGRAM_ORDER; n++) {
+        free((char *)job->source.files[n]);
+    }
+    free(job);
+}
+
+// Background reload: build the generation without holding any lock, then publish it. The thread is
+// detached; it reports through reload_status and wakes model_store_reload_wait when it is done
+static void *reloader_main(void *arg) {
+    reload_job *job = (reload_job *)arg;
+    model_store *store = job->store;
+    ngram_model *next = load_ngram_model(&job->source);
+    free_reload_job(job);
+    int status = -1;
+    if (next != NULL) {
+        model_store_publish(store, next);                                               // Old generation is freed here, off the query path
+        LOG_INFO("Reloaded model published");
+        status = 0;
+    } else {
+        LOG_ERROR("Model reload failed; the current generation stays live");
+    }
+
+    pthread_mutex_lock(&store->reload_lock);
+    store->reload_status = status;
+    atomic_store(&store->reload_running, 0);
+    pthread_cond_broadcast(&store->reload_done);
+    pthread_mutex_unlock(&store->reload_lock);
+    return NULL;
+}
+
+// Start loading the next generation in the background
+int model_store_reload_async(model_store *store, const ngram_source *source) {
+    if (atomic_exchange(&store->reload_running, 1)) {
+        return -1;
+    }
+    reload_job *job = (reload_job *)calloc(1, sizeof(reload_job));
+    if (job == NULL) {
+        atomic_store(&store->reload_running, 0);
+        return -1;
+    }
+    job->store = store;
+    job->source = *source;
+    job->source.snapshot = source->snapshot ? strdup(source->snapshot) : NULL;
+    for (int n = 0; n <= MAX_NGRAM_ORDER; n++) {
+        job->source.files[n] = source->files[n] ? strdup(source->files[n]) : NULL;
+    }
+    pthread_attr_t attr;
+    pthread_t thread;
+    int started = pthread_attr_init(&attr) == 0;
+    if (started) {
+        started = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) == 0
+                  && pthread_create(&thread, &attr, reloader_main, job) == 0;
+        pthread_attr_destroy(&attr);
+    }
+    if (!started) {
+        free_reload_job(job);
+        atomic_store(&store->reload_running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+// Wait for the background reload to finish
+int model_store_reload_wait(model_store *store) {
+    pthread_mutex_lock(&store->reload_lock);
+    while (atomic_load(&store->reload_running)) {
+        pthread_cond_wait(&store->reload_done, &store->reload_lock);
+    }
+    int status = store->reload_status;
+    pthread_mutex_unlock(&store->reload_lock);
+    return status;
+}
+
+// Tear the store down
+void model_store_destroy(model_store *store) {
+    model_store_reload_wait(store);
+    model_store_stop_merger(store);
+    free_generation(atomic_exchange(&store->current, NULL));
+
+    // Threads that kept a slot find their binding empty and claim one elsewhere next time
+    pthread_mutex_lock(&binding_lock);
+    for (int i = 0; i < MAX_READER_SLOTS; i++) {
+        if (store->readers[i].binding != NULL) atomic_store(&store->readers[i].binding->store, NULL);
+    }
+    pthread_mutex_unlock(&binding_lock);
+    free(store->readers);
+    store->readers = NULL;
+    for (int i = 0; i < DELTA_TABLE_SIZE; i++) {
+        for (delta_entry *e = store->deltas[i], *n; e != NULL; e = n) {
+            n = e->next;
+            free(e);
+        }
+        store->deltas[i] = NULL;
+    }
+    pthread_cond_destroy(&store->reload_done);
+    pthread_mutex_destroy(&store->reload_lock);
+    pthread_mutex_destroy(&store->delta_lock);
+    pthread_mutex_destroy(&store->writer_lock);
+}
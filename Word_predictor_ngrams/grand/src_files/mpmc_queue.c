@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include "mpmc_queue.h"
+
+// Allocate the cells; cell i starts with sequence i (free for the producer of position i)
+int mpmc_init(mpmc_queue *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    void *memory = NULL;
+    if (posix_memalign(&memory, MPMC_CACHE_LINE, sizeof(mpmc_cell) * size) != 0) {
+        return -1;
+    }
+    q->cells = (mpmc_cell *)memory;
+    q->mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].sequence, i);
+        q->cells[i].data = NULL;
+    }
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+// Claim the next position whose cell is free (sequence == position), then publish the item
+int mpmc_push(mpmc_queue *q, void *item) {
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        mpmc_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->data = item;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;                                                                  // Still holds an item from one lap ago
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+// Claim the next position whose cell was published (sequence == position + 1), then free the cell for the next lap
+int mpmc_pop(mpmc_queue *q, void **item) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        mpmc_cell *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long diff = (long)(seq - (pos + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *item = cell->data;
+                atomic_store_explicit(&cell->sequence, pos + q->mask + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1;                                                                  // Nothing published here yet
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+void mpmc_destroy(mpmc_queue *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
@@ -0,0 +1,564 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ngram.h"
+#include "ranking.h"
+#include "model_stats.h"
+#include "trace.h"
+
+// Initialise an empty model; tables are created lazily when an order is loaded
+void init_ngram_model(ngram_model *model, int order) {
+    if (order < 1) order = 1;
+    if (order > MAX_NGRAM_ORDER) order = MAX_NGRAM_ORDER;
+    model->order = order;
+    init_trie(&model->unigrams);
+    for (int n = 0; n <= MAX_NGRAM_ORDER; n++) {
+        model->tables[n] = NULL;
+        model->filters[n] = NULL;
+        model->min_count[n] = 0;                                                        // 0 keeps every entry
+    }
+    model->shard = 0;
+    model->num_shards = 0;
+    model->filter_fpr = 0.0;
+    model->filter_max_bytes = 0;
+    model->generation = 0;
+    memset(model->shared, 0, sizeof(model->shared));
+}
+
+// Set the load-time pruning threshold of one order
+void set_ngram_min_count(ngram_model *model, int n, int min_count) {
+    if (n >= 1 && n <= MAX_NGRAM_ORDER) {
+        model->min_count[n] = min_count;
+    }
+}
+
+// Keep only one partition of the n-gram tables
+void set_ngram_shard(ngram_model *model, int shard, int num_shards) {
+    if (num_shards > 1 && shard >= NGRAM_SHARD_NONE && shard < num_shards) {
+        model->shard = shard;
+        model->num_shards = num_shards;
+    } else {
+        model->shard = 0;
+        model->num_shards = 0;
+    }
+}
+
+// Configure the context filters; they are (re)built by compact_ngram_model
+void set_ngram_filter(ngram_model *model, double fpr, size_t max_bytes) {
+    model->filter_fpr = fpr > 0.0 && fpr < 1.0 ? fpr : 0.0;
+    model->filter_max_bytes = max_bytes;
+}
+
+// Length of the context of an n-gram key of order n: the bytes before its (n - 1)th space, which is
+// exactly what searchNGramsContext compares against "w1 ... w(n-1) "
+static size_t context_length(const char *ngram, int n) {
+    int spaces = 0;
+    for (size_t i = 0; ngram[i] != '\0'; i++) {
+        if (ngram[i] == ' ' && ++spaces == n - 1) return i;
+    }
+    return (size_t)-1;
+}
+
+// FNV-1a of the context words joined by single spaces, without building the string
+static unsigned long long context_hash(const char *context[], int len) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (int i = 0; i < len; i++) {
+        if (i > 0) {
+            h ^= (unsigned char)' ';
+            h *= 1099511628211ULL;
+        }
+        for (const unsigned char *p = (const unsigned char *)context[i]; *p != '\0'; p++) {
+            h ^= *p;
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+// Ask the filter of order n whether the context can be in the table
+int ngram_context_may_exist(const ngram_model *model, int n, const char *context[]) {
+    if (n < 2 || n > MAX_NGRAM_ORDER || model->filters[n] == NULL) return 1;
+    return bloom_may_contain(model->filters[n], context_hash(context, n - 1));
+}
+
+// Bytes of every context filter
+size_t ngram_filter_memory_usage(const ngram_model *model) {
+    size_t bytes = 0;
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        if (model->filters[n] != NULL) bytes += sizeof(bloom_filter) + bloom_memory_usage(model->filters[n]);
+    }
+    return bytes;
+}
+
+// Release the filter of one order
+static void free_filter(ngram_model *model, int n) {
+    if (model->filters[n] != NULL) {
+        bloom_free(model->filters[n]);
+        free(model->filters[n]);
+        model->filters[n] = NULL;
+    }
+}
+
+// Build the filter of order n from the distinct contexts of its table. Keys come in sorted order
+// and every key of a context starts with "context ", so each context is one run of keys: the first
+// pass counts the runs to size the filter, the second adds them
+static void build_filter(ngram_model *model, int n) {
+    free_filter(model, n);
+    if (model->filter_fpr <= 0.0 || model->tables[n] == NULL) return;
+
+    BTreeCursor cursor;
+    char prev[MAX_KEY_LEN];
+    size_t prev_len = (size_t)-1, contexts = 0;
+    for (int more = bPlusTreeFirst(model->tables[n], &cursor); more; more = bPlusTreeNext(&cursor)) {
+        size_t len = context_length(cursor.key, n);
+        if (len == (size_t)-1) continue;
+        if (len != prev_len || memcmp(prev, cursor.key, len) != 0) {
+            memcpy(prev, cursor.key, len);
+            prev_len = len;
+            contexts++;
+        }
+    }
+
+    bloom_filter *filter = (bloom_filter *)malloc(sizeof(bloom_filter));
+    if (filter == NULL || bloom_init(filter, contexts, model->filter_fpr, model->filter_max_bytes) != 0) {
+        free(filter);                                                                   // No filter: every lookup searches
+        return;
+    }
+    prev_len = (size_t)-1;
+    for (int more = bPlusTreeFirst(model->tables[n], &cursor); more; more = bPlusTreeNext(&cursor)) {
+        size_t len = context_length(cursor.key, n);
+        if (len == (size_t)-1) continue;
+        if (len != prev_len || memcmp(prev, cursor.key, len) != 0) {
+            memcpy(prev, cursor.key, len);
+            prev_len = len;
+            bloom_add(filter, hash_ngram_prefix(cursor.key, len));
+        }
+    }
+    model->filters[n] = filter;
+}
+
+// Partition of an n-gram: hash of everything before its last word
+int ngram_shard_of(const char *ngram, int num_shards) {
+    if (num_shards <= 1) return 0;
+    const char *last_space = strrchr(ngram, ' ');
+    size_t len = last_space != NULL ? (size_t)(last_space - ngram) : strlen(ngram);
+    return (int)(hash_ngram_prefix(ngram, len) % (unsigned long long)num_shards);
+}
+
+// Partition of a context key ("w1 w2"): the same hash its continuations were placed with
+int ngram_context_shard(const char *context_key, int num_shards) {
+    if (num_shards <= 1) return 0;
+    return (int)(hash_ngram(context_key) % (unsigned long long)num_shards);
+}
+
+// Count the words of an n-gram key ("w1 w2 w3" -> 3)
+int ngram_word_count(const char *ngram) {
+    int words = 0, in_word = 0;
+    for (int i = 0; ngram[i] != '\0'; i++) {
+        if (ngram[i] == ' ') {
+            in_word = 0;
+        } else if (!in_word) {
+            in_word = 1;
+            words++;
+        }
+    }
+    return words;
+}
+
+// Check that a unigram only uses the letters the trie can index
+static int is_trie_word(const char *word) {
+    if (word[0] == '\0') return 0;
+    for (int i = 0; word[i] != '\0'; i++) {
+        if (word[i] < 'a' || word[i] > 'z') return 0;
+    }
+    return 1;
+}
+
+// Add one entry of order n to the model, applying the pruning threshold
+static int add_ngram_entry(ngram_model *model, int n, const char *ngram, int count) {
+    if (count < model->min_count[n]) {
+        return 0;
+    }
+    if (n == 1) {
+        if (!is_trie_word(ngram)) return 0;                                             // The trie only indexes a-z
+        insert_word(&model->unigrams, ngram, count);
+        return 1;
+    }
+    if (ngram_word_count(ngram) != n) {
+        return 0;
+    }
+    if (model->num_shards > 1 && ngram_shard_of(ngram, model->num_shards) != model->shard) {
+        return 0;                                                                       // Another shard owns it
+    }
+    if (model->tables[n] == NULL) {
+        model->tables[n] = createBPlusTree();
+    }
+    insertBPlusTree(model->tables[n], ngram, count);
+    size_t len = context_length(ngram, n);
+    if (model->filters[n] != NULL && len != (size_t)-1) {
+        bloom_add(model->filters[n], hash_ngram_prefix(ngram, len));                    // Keep an existing filter exact
+    }
+    return 1;
+}
+
+// Read the rows of one order from a CSV file
+long load_ngram_table(ngram_model *model, int n, const char *filename) {
+    if (n < 1 || n > model->order) {
+        return -1;
+    }
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        perror("Could not open file");
+        return -1;
+    }
+
+    char line[MAX_LINE_LENGTH];
+    long kept = 0;
+    while (fgets(line, sizeof(line), file)) {
+        char *comma = strrchr(line, ',');                                               // The count is the last field
+        if (comma == NULL || comma == line || comma - line >= MAX_NGRAM_LEN) {
+            continue;
+        }
+        *comma = '\0';
+        kept += add_ngram_entry(model, n, line, atoi(comma + 1));
+    }
+
+    fclose(file);
+    return kept;
+}
+
+// Back off from the highest usable order; a non-NULL word_prefix restricts the next word
+static int backoff_search(const ngram_model *model, const char *context[], int context_len, const char *word_prefix, bt_priority_q *result) {
+    int n = context_len + 1;
+    if (n > model->order) {
+        n = model->order;
+    }
+    TRACE_BEGIN(start);
+    for (; n >= 2; n--) {
+        BPlusTree *table = model->tables[n];
+        if (table == NULL) {
+            continue;
+        }
+        const char **words = context + context_len - (n - 1);
+        if (!ngram_context_may_exist(model, n, words)) {
+            TRACE_COUNT(TRACE_FILTER_SKIPS, 1);
+            continue;                                                                   // Certainly absent: back off right away
+        }
+        if (word_prefix == NULL) {
+            searchNGramsContext(table, words, n - 1, result);
+        } else {
+            searchNGramsCompletion(table, words, n - 1, word_prefix, result);
+        }
+        if (result->top >= 0) {
+            break;
+        }
+    }
+    TRACE_END(TRACE_BACKOFF, start);
+    return n >= 2 ? n : 0;
+}
+
+// Predict with the longest usable context, dropping the oldest word on every back off
+int predict_ngrams(const ngram_model *model, const char *context[], int context_len, bt_priority_q *result) {
+    return backoff_search(model, context, context_len, NULL, result);
+}
+
+// Complete the partly typed next word, backing off the same way
+int complete_ngrams(const ngram_model *model, const char *context[], int context_len, const char *prefix, bt_priority_q *result) {
+    return backoff_search(model, context, context_len, prefix, result);
+}
+
+// Write one snapshot record: key length, key bytes, count
+static int write_record(FILE *file, const char *key, int count) {
+    uint16_t len = (uint16_t)strlen(key);
+    int32_t c = count;
+    return fwrite(&len, sizeof(len), 1, file) == 1
+        && fwrite(key, 1, len, file) == len
+        && fwrite(&c, sizeof(c), 1, file) == 1;
+}
+
+// Walk the trie and write every word as a unigram record
+static void write_trie_records(FILE *file, trie_node *p, char *word, int level, uint64_t *written) {
+    if (p == NULL) return;
+    if (p->isEndOfWord) {
+        word[level] = '\0';
+        if (write_record(file, word, p->count)) (*written)++;
+    }
+    for (int i = 0; i < 26 && level < MAX_TOKEN_LEN - 1; i++) {
+        if (p->children[i] != NULL) {
+            word[level] = 'a' + i;
+            write_trie_records(file, p->children[i], word, level + 1, written);
+        }
+    }
+}
+
+// Write every key of a table in key order
+static void write_table_records(FILE *file, const BPlusTree *tree, uint64_t *written) {
+    BTreeCursor cursor;
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        if (write_record(file, cursor.key, cursor.count)) (*written)++;
+    }
+}
+
+// Snapshot layout (native endianness):
+//   magic[4] version:u32 order:u32 stats_size:u32 stats[stats_size] (an ngram_stats; absent in version 1)
+//   then for every order 1..order: entries:u64 followed by (len:u16, key[len], count:i32) records
+int save_ngram_snapshot(const ngram_model *model, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        perror("Could not open file");
+        return -1;
+    }
+    ngram_stats stats;
+    compute_ngram_stats(model, &stats);
+    uint32_t header[3] = { NGRAM_SNAPSHOT_VERSION, (uint32_t)model->order, (uint32_t)sizeof(stats) };
+    fwrite(NGRAM_SNAPSHOT_MAGIC, 1, 4, file);
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(&stats, sizeof(stats), 1, file);
+
+    for (int n = 1; n <= model->order; n++) {
+        long count_pos = ftell(file);
+        uint64_t written = 0;
+        fwrite(&written, sizeof(written), 1, file);                                     // Placeholder, patched below
+
+        char word[MAX_TOKEN_LEN];
+        if (n == 1) {
+            write_trie_records(file, model->unigrams.root, word, 0, &written);
+        } else {
+            write_table_records(file, model->tables[n], &written);
+        }
+
+        long end_pos = ftell(file);
+        fseek(file, count_pos, SEEK_SET);
+        fwrite(&written, sizeof(written), 1, file);
+        fseek(file, end_pos, SEEK_SET);
+    }
+
+    int failed = ferror(file);
+    fclose(file);
+    return failed ? -1 : 0;
+}
+
+// Load a snapshot written by save_ngram_snapshot
+int load_ngram_snapshot(ngram_model *model, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) {
+        perror("Could not open file");
+        return -1;
+    }
+    char magic[4];
+    uint32_t header[2];
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, NGRAM_SNAPSHOT_MAGIC, 4) != 0
+        || fread(header, sizeof(header), 1, file) != 1 || header[0] < 1 || header[0] > NGRAM_SNAPSHOT_VERSION
+        || header[1] < 1 || header[1] > MAX_NGRAM_ORDER) {
+        printf("Invalid snapshot file %s\n", filename);
+        fclose(file);
+        return -1;
+    }
+    uint32_t stats_size;
+    if (header[0] >= 2 && (fread(&stats_size, sizeof(stats_size), 1, file) != 1
+                           || fseek(file, (long)stats_size, SEEK_CUR) != 0)) {               // Only read_snapshot_stats needs it
+        printf("Truncated snapshot file %s\n", filename);
+        fclose(file);
+        return -1;
+    }
+    model->order = (int)header[1];
+
+    for (int n = 1; n <= model->order; n++) {
+        uint64_t entries;
+        if (fread(&entries, sizeof(entries), 1, file) != 1) {
+            fclose(file);
+            return -1;
+        }
+        for (uint64_t e = 0; e < entries; e++) {
+            uint16_t len;
+            int32_t count;
+            char key[MAX_NGRAM_LEN];
+            if (fread(&len, sizeof(len), 1, file) != 1 || len >= MAX_NGRAM_LEN
+                || fread(key, 1, len, file) != len || fread(&count, sizeof(count), 1, file) != 1) {
+                printf("Truncated snapshot file %s\n", filename);
+                fclose(file);
+                return -1;
+            }
+            key[len] = '\0';
+            add_ngram_entry(model, n, key, count);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+// Build a whole model from a snapshot or from the per-order CSV files
+ngram_model *load_ngram_model(const ngram_source *source) {
+    ngram_model *model = (ngram_model *)malloc(sizeof(ngram_model));
+    if (model == NULL) return NULL;
+    init_ngram_model(model, source->order);
+    for (int n = 1; n <= MAX_NGRAM_ORDER; n++) {
+        set_ngram_min_count(model, n, source->min_count[n]);
+    }
+    set_ngram_shard(model, source->shard, source->num_shards);
+    set_ngram_filter(model, source->filter_fpr, source->filter_max_bytes);
+
+    if (source->snapshot != NULL) {
+        if (load_ngram_snapshot(model, source->snapshot) != 0) {
+            free_ngram_model(model);
+            free(model);
+            return NULL;
+        }
+        compact_ngram_model(model);
+        return model;
+    }
+    for (int n = 1; n <= model->order; n++) {
+        if (source->files[n] != NULL && load_ngram_table(model, n, source->files[n]) < 0) {
+            free_ngram_model(model);                                                    // A partial model is never served
+            free(model);
+            return NULL;
+        }
+    }
+    compact_ngram_model(model);
+    return model;
+}
+
+// Pack every table into its read-only block form; a table that cannot be packed is at least laid
+// out contiguously, and one that cannot be compacted either keeps working as it is. The filters are
+// rebuilt last, so they match the tables after any bulk change that bypassed add_ngram_entry
+void compact_ngram_model(ngram_model *model) {
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        compact_ngram_table(model, n);
+    }
+}
+
+// Same for a single order (a shared table belongs to, and is compacted by, its owner)
+void compact_ngram_table(ngram_model *model, int n) {
+    if (model->shared[n]) return;
+    if (model->tables[n] != NULL && packBPlusTree(model->tables[n]) != 0) {
+        compactBPlusTree(model->tables[n]);
+    }
+    build_filter(model, n);
+}
+
+// 64-bit FNV-1a over the key bytes
+unsigned long long hash_ngram(const char *ngram) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)ngram; *p != '\0'; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// FNV-1a over a key prefix; equals hash_ngram of the prefix as its own string
+unsigned long long hash_ngram_prefix(const char *ngram, size_t len) {
+    unsigned long long h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len && ngram[i] != '\0'; i++) {
+        h ^= (unsigned char)ngram[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Copy every word below p into the destination trie
+static void clone_trie_words(trie *dst, trie_node *p, char *word, int level) {
+    if (p == NULL) return;
+    if (p->isEndOfWord) {
+        word[level] = '\0';
+        insert_word(dst, word, p->count);
+    }
+    for (int i = 0; i < 26 && level < MAX_TOKEN_LEN - 1; i++) {
+        if (p->children[i] != NULL) {
+            word[level] = 'a' + i;
+            clone_trie_words(dst, p->children[i], word, level + 1);
+        }
+    }
+}
+
+// Copy a table by re-inserting its keys in key order
+static BPlusTree *clone_table(const BPlusTree *tree) {
+    if (tree == NULL) return NULL;
+    BPlusTree *copy = createBPlusTree();
+    BTreeCursor cursor;
+    for (int more = bPlusTreeFirst(tree, &cursor); more; more = bPlusTreeNext(&cursor)) {
+        insertBPlusTree(copy, cursor.key, cursor.count);
+    }
+    return copy;
+}
+
+// Deep copy of the whole model
+ngram_model *clone_ngram_model(const ngram_model *model) {
+    ngram_model *copy = (ngram_model *)malloc(sizeof(ngram_model));
+    if (copy == NULL) return NULL;
+    init_ngram_model(copy, model->order);
+    memcpy(copy->min_count, model->min_count, sizeof(copy->min_count));
+    copy->shard = model->shard;
+    copy->num_shards = model->num_shards;
+    copy->filter_fpr = model->filter_fpr;
+    copy->filter_max_bytes = model->filter_max_bytes;
+
+    char word[MAX_TOKEN_LEN];
+    clone_trie_words(&copy->unigrams, model->unigrams.root, word, 0);
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        copy->tables[n] = clone_table(model->tables[n]);
+    }
+    compact_ngram_model(copy);
+    return copy;
+}
+
+// Copy the model header: every pointer still leads into the original's structures
+ngram_model *share_ngram_model(const ngram_model *model) {
+    ngram_model *copy = (ngram_model *)malloc(sizeof(ngram_model));
+    if (copy == NULL) return NULL;
+    *copy = *model;
+    copy->generation = 0;
+    memset(copy->shared, 1, sizeof(copy->shared));
+    return copy;
+}
+
+// Replace one shared order with a private deep copy
+int unshare_ngram_order(ngram_model *model, int n) {
+    if (n < 1 || n > MAX_NGRAM_ORDER || !model->shared[n]) {
+        return 0;
+    }
+    if (n == 1) {
+        trie copy;
+        init_trie(&copy);
+        char word[MAX_TOKEN_LEN];
+        clone_trie_words(&copy, model->unigrams.root, word, 0);
+        model->unigrams = copy;                                                         // New serial, no vocabulary yet
+    } else {
+        BPlusTree *copy = NULL;
+        if (model->tables[n] != NULL && (copy = clone_table(model->tables[n])) == NULL) {
+            return -1;
+        }
+        model->tables[n] = copy;
+        model->filters[n] = NULL;                                                       // No filter lets every context through
+    }
+    model->shared[n] = 0;
+    return 0;
+}
+
+// Ownership of whatever both models still point at moves to next
+void hand_on_ngram_model(ngram_model *prev, ngram_model *next) {
+    for (int n = 1; n <= MAX_NGRAM_ORDER; n++) {
+        if (next->shared[n]) {
+            prev->shared[n] = 1;
+            next->shared[n] = 0;
+        }
+    }
+}
+
+// Release every structure owned by the model
+void free_ngram_model(ngram_model *model) {
+    if (!model->shared[1]) {
+        detach_ranking_vocab(&model->unigrams);
+        free_trie(&model->unigrams);
+    }
+    for (int n = 0; n <= MAX_NGRAM_ORDER; n++) {
+        if (!model->shared[n]) {
+            freeBPlusTree(model->tables[n]);
+            free_filter(model, n);
+        }
+        model->tables[n] = NULL;
+        model->filters[n] = NULL;
+    }
+}
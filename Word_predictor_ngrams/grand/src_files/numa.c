@@ -0,0 +1,86 @@
+#define _GNU_SOURCE             // sched_getcpu, CPU_SET, pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "numa.h"
+
+// Set bit cpu of a node mask
+static void add_cpu(unsigned long long *mask, long cpu) {
+    if (cpu >= 0 && cpu < NUMA_MAX_CPUS) mask[cpu / 64] |= 1ULL << (cpu % 64);
+}
+
+// Parse a sysfs CPU list such as "0-3,8-11" into mask
+static void parse_cpulist(const char *list, unsigned long long *mask) {
+    memset(mask, 0, sizeof(unsigned long long) * NUMA_MASK_WORDS);
+    const char *p = list;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+        if (end == p) break;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last; cpu++) add_cpu(mask, cpu);
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+int numa_discover(numa_topology *topo) {
+    topo->num_nodes = 0;
+    for (int node = 0; node < NUMA_MAX_NODES; node++) {
+        char path[64], list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (file == NULL) break;                                                        // Online nodes are numbered densely
+        if (fgets(list, sizeof(list), file) != NULL) {
+            parse_cpulist(list, topo->cpus[node]);
+            topo->num_nodes = node + 1;
+        }
+        fclose(file);
+    }
+    if (topo->num_nodes == 0) {
+        memset(topo->cpus[0], 0, sizeof(topo->cpus[0]));
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        for (long cpu = 0; cpu < cpus; cpu++) add_cpu(topo->cpus[0], cpu);
+        topo->num_nodes = 1;
+    }
+    return topo->num_nodes;
+}
+
+int numa_current_node(const numa_topology *topo) {
+    if (topo->num_nodes <= 1) return 0;
+    int cpu = sched_getcpu();                                                           // vDSO / rseq: no system call
+    if (cpu < 0 || cpu >= NUMA_MAX_CPUS) return 0;
+    for (int node = 0; node < topo->num_nodes; node++) {
+        if (topo->cpus[node][cpu / 64] & (1ULL << (cpu % 64))) return node;
+    }
+    return 0;
+}
+
+int numa_pin_to_node(const numa_topology *topo, int node) {
+    if (node < NUMA_ANY_NODE || node >= topo->num_nodes) return -1;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int n = 0; n < topo->num_nodes; n++) {
+        if (node != NUMA_ANY_NODE && n != node) continue;
+        for (int cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            if (topo->cpus[n][cpu / 64] & (1ULL << (cpu % 64))) CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int numa_interleave_begin(const numa_topology *topo) {
+    unsigned long mask = (1UL << topo->num_nodes) - 1;
+    return syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, &mask, (unsigned long)NUMA_MAX_NODES + 1) == 0 ? 0 : -1;
+}
+
+void numa_interleave_end(void) {
+    syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0UL);
+}
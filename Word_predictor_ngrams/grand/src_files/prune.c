@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "prune.h"
+
+// One n-gram considered for pruning
+typedef struct {
+    char *key;
+    int order;
+    int count;
+    long long context_sum;  // Sum of the counts sharing this entry's context (fallback for c(h))
+    double delta;           // Estimated relative entropy added by removing the entry
+    double rank;            // Higher ranks are kept first
+    int keep;
+} prune_entry;
+
+// Keep everything unless the caller asks otherwise
+void init_prune_config(prune_config *config) {
+    config->method = PRUNE_BY_COUNT;
+    config->min_count = 0;
+    config->entropy_threshold = 0.0;
+    config->target_bytes = 0;
+}
+
+// Count of a unigram in the trie (0 if the word is unknown)
+static long long trie_count(const trie *T, const char *word, size_t len) {
+    trie_node *p = T->root;
+    for (size_t i = 0; i < len; i++) {
+        if (word[i] < 'a' || word[i] > 'z' || p->children[word[i] - 'a'] == NULL) {
+            return 0;
+        }
+        p = p->children[word[i] - 'a'];
+    }
+    return p->isEndOfWord ? p->count : 0;
+}
+
+// Count of the first len bytes of an n-gram of the given order
+static long long ngram_count(const ngram_model *model, int order, const char *ngram, size_t len) {
+    if (order == 1) {
+        return trie_count(&model->unigrams, ngram, len);
+    }
+    if (order < 1 || model->tables[order] == NULL || len >= MAX_NGRAM_LEN) {
+        return 0;
+    }
+    char key[MAX_NGRAM_LEN];
+    memcpy(key, ngram, len);
+    key[len] = '\0';
+    return searchExactNGram(model->tables[order], key);
+}
+
+// Estimate the relative entropy of dropping one n-gram (Stolcke 1998, without renormalisation):
+//   D(h,w) = p(h) * p(w|h) * (log p(w|h) - log p_backoff(w|h'))
+static double entropy_delta(const ngram_model *model, const prune_entry *e) {
+    double total = (double)model->unigrams.total_unigram_count;
+    if (total <= 0 || e->count <= 0) return 0.0;
+
+    const char *key = e->key;
+    const char *last_space = strrchr(key, ' ');
+    const char *first_space = strchr(key, ' ');
+    const char *w = last_space + 1;
+
+    // Higher-order estimate p(w|h) from the history count
+    long long c_h = ngram_count(model, e->order - 1, key, (size_t)(last_space - key));
+    if (c_h < e->context_sum) c_h = e->context_sum;
+    double p_h = (double)c_h / total;
+    double p_w_h = (double)e->count / (double)c_h;
+
+    // Backed off estimate from the shorter history h' (or the unigram when h' is empty)
+    double p_backoff = 0.0;
+    if (e->order > 2) {
+        const char *lower = first_space + 1;
+        long long c_lower = ngram_count(model, e->order - 1, lower, strlen(lower));
+        long long c_hprime = ngram_count(model, e->order - 2, lower, (size_t)(last_space - lower));
+        if (c_lower > 0 && c_hprime > 0) {
+            p_backoff = PRUNE_BACKOFF_WEIGHT * (double)c_lower / (double)c_hprime;
+        }
+    }
+    if (p_backoff <= 0.0) {
+        long long c_w = trie_count(&model->unigrams, w, strlen(w));
+        p_backoff = PRUNE_BACKOFF_WEIGHT * (double)(c_w > 0 ? c_w : 1) / total;
+    }
+
+    return p_h * p_w_h * (log(p_w_h) - log(p_backoff));
+}
+
+// Free the keys of the first size entries and the array itself
+static void free_entries(prune_entry *entries, long size) {
+    for (long i = 0; i < size; i++) free(entries[i].key);
+    free(entries);
+}
+
+// Gather every n-gram of order >= 2 in key order; NULL if memory ran out (nothing is kept then)
+static prune_entry *collect_entries(const ngram_model *model, long *num_entries, prune_report *report) {
+    long capacity = 1024, size = 0;
+    prune_entry *entries = (prune_entry *)malloc(sizeof(prune_entry) * capacity);
+    if (entries == NULL) return NULL;
+
+    for (int n = 2; n <= model->order; n++) {
+        report->entries_before[n] = 0;
+        BTreeCursor cursor;
+        for (int more = bPlusTreeFirst(model->tables[n], &cursor); more; more = bPlusTreeNext(&cursor)) {
+            if (size == capacity) {
+                capacity *= 2;
+                prune_entry *grown = (prune_entry *)realloc(entries, sizeof(prune_entry) * capacity);
+                if (grown == NULL) {
+                    free_entries(entries, size);
+                    return NULL;
+                }
+                entries = grown;
+            }
+            prune_entry *e = &entries[size];
+            e->key = strdup(cursor.key);
+            if (e->key == NULL) {
+                free_entries(entries, size);
+                return NULL;
+            }
+            e->order = n;
+            e->count = cursor.count;
+            e->context_sum = 0;
+            e->keep = 1;
+
+            size++;
+            report->entries_before[n]++;
+        }
+    }
+    *num_entries = size;
+    return entries;
+}
+
+// Length of the history part of an n-gram key (everything before the last word)
+static size_t context_len(const char *key) {
+    return (size_t)(strrchr(key, ' ') - key);
+}
+
+// Keys are sorted, so entries sharing a history are adjacent: sum each run once
+static void fill_context_sums(prune_entry *entries, long num_entries) {
+    long start = 0;
+    while (start < num_entries) {
+        size_t len = context_len(entries[start].key);
+        long end = start;
+        long long sum = 0;
+        while (end < num_entries && entries[end].order == entries[start].order
+               && context_len(entries[end].key) == len
+               && strncmp(entries[end].key, entries[start].key, len) == 0) {
+            sum += entries[end].count;
+            end++;
+        }
+        for (long i = start; i < end; i++) {
+            entries[i].context_sum = sum;
+        }
+        start = end;
+    }
+}
+
+// Sort key of one entry: the fields the ranking needs plus its index, so the sort needs no shared state
+typedef struct {
+    long index;
+    int keep;
+    double rank;
+} prune_rank;
+
+// Sort helper: kept entries first, then highest rank first, then key order
+static int compare_rank(const void *a, const void *b) {
+    const prune_rank *x = (const prune_rank *)a;
+    const prune_rank *y = (const prune_rank *)b;
+    if (x->keep != y->keep) return y->keep - x->keep;
+    if (x->rank < y->rank) return 1;
+    if (x->rank > y->rank) return -1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Build fresh tables from the kept entries and return their size in bytes once packed (the form
+// the model keeps them in)
+static long long build_tables(const prune_entry *entries, long num_entries, BPlusTree *tables[]) {
+    long long bytes = 0;
+    for (long i = 0; i < num_entries; i++) {
+        if (!entries[i].keep) continue;
+        int n = entries[i].order;
+        if (tables[n] == NULL) tables[n] = createBPlusTree();
+        insertBPlusTree(tables[n], entries[i].key, entries[i].count);
+    }
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        if (tables[n] != NULL) packBPlusTree(tables[n]);
+        bytes += bPlusTreeMemoryUsage(tables[n]);
+    }
+    return bytes;
+}
+
+// Free every table in the array
+static void free_tables(BPlusTree *tables[]) {
+    for (int n = 0; n <= MAX_NGRAM_ORDER; n++) {
+        freeBPlusTree(tables[n]);
+        tables[n] = NULL;
+    }
+}
+
+// Prune the n-gram tables of the model
+int prune_ngram_model(ngram_model *model, const prune_config *config, prune_report *report) {
+    prune_report local;
+    if (report == NULL) report = &local;
+    memset(report, 0, sizeof(*report));
+    for (int n = 2; n <= model->order; n++) {
+        report->bytes_before += bPlusTreeMemoryUsage(model->tables[n]);
+    }
+
+    long num_entries = 0;
+    prune_entry *entries = collect_entries(model, &num_entries, report);
+    if (entries == NULL) return -1;
+    fill_context_sums(entries, num_entries);
+
+    // Score every entry and apply the hard thresholds
+    for (long i = 0; i < num_entries; i++) {
+        prune_entry *e = &entries[i];
+        e->delta = entropy_delta(model, e);
+        e->rank = config->method == PRUNE_BY_ENTROPY ? e->delta : (double)e->count;
+        if (e->count < config->min_count) {
+            e->keep = 0;
+        }
+        if (config->method == PRUNE_BY_ENTROPY && config->entropy_threshold > 0.0
+            && e->delta < config->entropy_threshold) {
+            e->keep = 0;
+        }
+    }
+
+    // Rank the survivors so the budget loop can cut from the bottom
+    prune_rank *order = (prune_rank *)malloc(sizeof(prune_rank) * (num_entries > 0 ? num_entries : 1));
+    if (order == NULL) {
+        free_entries(entries, num_entries);
+        return -1;
+    }
+    long kept = 0;
+    for (long i = 0; i < num_entries; i++) {
+        order[i].index = i;
+        order[i].keep = entries[i].keep;
+        order[i].rank = entries[i].rank;
+        kept += entries[i].keep;
+    }
+    qsort(order, num_entries, sizeof(prune_rank), compare_rank);
+
+    // Rebuild, shrinking the kept set until the tables fit the budget
+    BPlusTree *tables[MAX_NGRAM_ORDER + 1] = {NULL};
+    long long bytes = build_tables(entries, num_entries, tables);
+    while (config->target_bytes > 0 && bytes > config->target_bytes && kept > 0) {
+        long next = (long)((double)kept * (double)config->target_bytes / (double)bytes * 0.95);
+        if (next >= kept) next = kept - 1;
+        for (long i = next; i < kept; i++) {
+            entries[order[i].index].keep = 0;
+        }
+        kept = next;
+        free_tables(tables);
+        bytes = build_tables(entries, num_entries, tables);
+    }
+
+    // Swap the pruned tables in and account for what was lost
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        freeBPlusTree(model->tables[n]);
+        model->tables[n] = tables[n];
+    }
+    compact_ngram_model(model);
+    for (long i = 0; i < num_entries; i++) {
+        if (entries[i].keep) {
+            report->entries_after[entries[i].order]++;
+        } else if (entries[i].delta > 0.0) {
+            report->entropy_increase += entries[i].delta;
+        }
+        free(entries[i].key);
+    }
+    report->bytes_after = bytes;
+    report->perplexity_increase = exp(report->entropy_increase) - 1.0;
+
+    free(order);
+    free(entries);
+    return 0;
+}
+
+// Print the pruning report
+void display_prune_report(const prune_report *report) {
+    printf("Pruning report:\n");
+    for (int n = 2; n <= MAX_NGRAM_ORDER; n++) {
+        if (report->entries_before[n] > 0) {
+            printf("  %d-grams: %ld -> %ld entries\n", n, report->entries_before[n], report->entries_after[n]);
+        }
+    }
+    printf("  n-gram table memory: %lld -> %lld bytes\n", report->bytes_before, report->bytes_after);
+    printf("  estimated entropy increase: %.6f nats/word (perplexity +%.2f%%)\n",
+           report->entropy_increase, report->perplexity_increase * 100.0);
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "ranking.h"
+#include "levenshtein.h"
+
+// QWERTY rows; each row is shifted right by its stagger (in key widths)
+static const char *keyboard_rows[3] = { "qwertyuiop", "asdfghjkl", "zxcvbnm" };
+static const float keyboard_stagger[3] = { 0.0f, 0.25f, 0.75f };
+
+static unsigned char key_adjacent[26][26];
+static pthread_once_t key_adjacent_once = PTHREAD_ONCE_INIT;
+
+// Two keys are neighbours when their centres are at most about one key apart
+static void init_key_adjacent(void) {
+    float x[26], y[26];
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; keyboard_rows[r][c] != '\0'; c++) {
+            int k = keyboard_rows[r][c] - 'a';
+            x[k] = (float)c + keyboard_stagger[r];
+            y[k] = (float)r;
+        }
+    }
+    for (int a = 0; a < 26; a++) {
+        for (int b = 0; b < 26; b++) {
+            float dx = x[a] - x[b], dy = y[a] - y[b];
+            key_adjacent[a][b] = a != b && dx * dx + dy * dy <= 1.6f;
+        }
+    }
+}
+
+// Substitution cost of typing a instead of b
+static float substitution_cost(char a, char b) {
+    if (a >= 'a' && a <= 'z' && b >= 'a' && b <= 'z' && key_adjacent[a - 'a'][b - 'a']) {
+        return RANK_ADJACENT_COST;
+    }
+    return 1.0f;
+}
+
+// Soundex: first letter plus three digits for the following consonant groups
+void soundex(const char *word, char out[5]) {
+    static const char codes[26] = {
+        0, '1', '2', '3', 0, '1', '2', 0, 0, '2', '2', '4', '5',
+        '5', 0, '1', '2', '6', '2', '3', 0, '1', 0, '2', 0, '2'
+    };
+    int len = 0;
+    char last = 0;
+    memset(out, '0', 4);
+    out[4] = '\0';
+    for (int i = 0; word[i] != '\0' && len < 4; i++) {
+        char ch = word[i];
+        if (ch < 'a' || ch > 'z') continue;
+        char code = codes[ch - 'a'];
+        if (len == 0) {
+            out[len++] = ch;
+        } else if (code != 0 && code != last) {
+            out[len++] = code;
+        }
+        if (ch != 'h' && ch != 'w') last = code;                                        // h and w do not separate equal codes
+    }
+}
+
+// Optimal string alignment distance with keyboard and transposition weights
+float weighted_edit_cost(const char *typed, const char *word) {
+    pthread_once(&key_adjacent_once, init_key_adjacent);
+    float rows[3][MAX_TOKEN_LEN + 1];
+    float *prev2 = rows[0], *prev = rows[1], *cur = rows[2];
+    int n = (int)strlen(typed), m = (int)strlen(word);
+    if (n > MAX_TOKEN_LEN - 1) n = MAX_TOKEN_LEN - 1;
+    if (m > MAX_TOKEN_LEN - 1) m = MAX_TOKEN_LEN - 1;
+
+    for (int j = 0; j <= m; j++) prev[j] = (float)j;
+    for (int i = 1; i <= n; i++) {
+        cur[0] = (float)i;
+        for (int j = 1; j <= m; j++) {
+            float sub = typed[i - 1] == word[j - 1] ? 0.0f : substitution_cost(typed[i - 1], word[j - 1]);
+            float best = prev[j - 1] + sub;
+            if (prev[j] + 1.0f < best) best = prev[j] + 1.0f;
+            if (cur[j - 1] + 1.0f < best) best = cur[j - 1] + 1.0f;
+            if (i > 1 && j > 1 && typed[i - 1] == word[j - 2] && typed[i - 2] == word[j - 1]
+                && typed[i - 1] != typed[i - 2] && prev2[j - 2] + RANK_TRANSPOSE_COST < best) {
+                best = prev2[j - 2] + RANK_TRANSPOSE_COST;
+            }
+            cur[j] = best;
+        }
+        float *t = prev2; prev2 = prev; prev = cur; cur = t;
+    }
+
+    float cost = prev[m];
+    char a[5], b[5];
+    soundex(typed, a);
+    soundex(word, b);
+    if (cost > 0.0f && strcmp(a, b) == 0) {
+        cost -= RANK_PHONETIC_BONUS;
+        if (cost < 0.1f) cost = 0.1f;
+    }
+    return cost;
+}
+
+// Walk the trie in alphabetical order, counting or copying the words
+static void collect_vocab(trie_node *p, char *word, int level, ranking_vocab *vocab, size_t *arena_used) {
+    if (p == NULL) return;
+    if (p->isEndOfWord) {
+        if (vocab->arena != NULL) {
+            memcpy(vocab->arena + *arena_used, word, level);
+            vocab->arena[*arena_used + level] = '\0';
+            vocab->words[vocab->size] = vocab->arena + *arena_used;
+            vocab->counts[vocab->size] = p->count;
+        }
+        *arena_used += (size_t)level + 1;
+        vocab->size++;
+    }
+    for (int i = 0; i < 26 && level < MAX_TOKEN_LEN - 1; i++) {
+        if (p->children[i] != NULL) {
+            word[level] = (char)('a' + i);
+            collect_vocab(p->children[i], word, level + 1, vocab, arena_used);
+        }
+    }
+}
+
+// Flatten the trie: one pass to size the arrays, one to fill them
+int init_ranking_vocab(ranking_vocab *vocab, trie *T) {
+    char word[MAX_TOKEN_LEN];
+    size_t arena_size = 0;
+    memset(vocab, 0, sizeof(*vocab));
+    collect_vocab(T->root, word, 0, vocab, &arena_size);
+
+    int size = vocab->size;
+    vocab->size = 0;
+    vocab->words = (const char **)malloc(sizeof(char *) * (size > 0 ? size : 1));
+    vocab->log_prior = (float *)malloc(sizeof(float) * (size > 0 ? size : 1));
+    vocab->counts = (int *)malloc(sizeof(int) * (size > 0 ? size : 1));
+    vocab->arena = (char *)malloc(arena_size > 0 ? arena_size : 1);
+    if (vocab->words == NULL || vocab->log_prior == NULL || vocab->counts == NULL || vocab->arena == NULL) {
+        free_ranking_vocab(vocab);
+        return -1;
+    }
+    size_t used = 0;
+    collect_vocab(T->root, word, 0, vocab, &used);
+
+    vocab->total_count = T->total_unigram_count;
+    for (int i = 0; i < vocab->size; i++) {
+        vocab->log_prior[i] = logf((float)vocab->counts[i] / (float)(vocab->total_count > 0 ? vocab->total_count : 1));
+    }
+    return 0;
+}
+
+void free_ranking_vocab(ranking_vocab *vocab) {
+    free(vocab->words);
+    free(vocab->log_prior);
+    free(vocab->counts);
+    free(vocab->arena);
+    memset(vocab, 0, sizeof(*vocab));
+}
+
+// Build the vocabulary on the heap and hang it off the trie
+int attach_ranking_vocab(trie *T) {
+    ranking_vocab *vocab = (ranking_vocab *)malloc(sizeof(ranking_vocab));
+    if (vocab == NULL || init_ranking_vocab(vocab, T) != 0) {
+        free(vocab);
+        return -1;
+    }
+    detach_ranking_vocab(T);
+    T->vocab = vocab;
+    return 0;
+}
+
+// Free the vocabulary attached to the trie, if any
+void detach_ranking_vocab(trie *T) {
+    if (T->vocab == NULL) return;
+    free_ranking_vocab(T->vocab);
+    free(T->vocab);
+    T->vocab = NULL;
+}
+
+// Count of a vocabulary word (binary search, the vocabulary is sorted)
+static int vocab_count(const ranking_vocab *vocab, const char *word) {
+    int lo = 0, hi = vocab->size - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(vocab->words[mid], word);
+        if (cmp == 0) return vocab->counts[mid];
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return 0;
+}
+
+// Score the vocabulary against the typed token
+int rank_candidates(const ranking_vocab *vocab, const ngram_model *model, const char *prev, const char *typed, priority_Q *result) {
+    init_priority_Q(result);
+    if (vocab->size == 0) return 0;
+
+    float *ratio = (float *)malloc(sizeof(float) * vocab->size);
+    int *candidate = (int *)malloc(sizeof(int) * vocab->size);
+    if (ratio == NULL || candidate == NULL) {
+        free(ratio);
+        free(candidate);
+        return 0;
+    }
+
+    // Stage 1: cheap filter with the batched bit-parallel kernel over the whole vocabulary
+    levenshtein_ratio_batch(typed, vocab->words, vocab->size, ratio);
+    int typed_len = (int)strlen(typed), num = 0;
+    for (int i = 0; i < vocab->size; i++) {
+        float avg = (float)(typed_len + (int)strlen(vocab->words[i])) / 2.0f;
+        if (ratio[i] <= RANK_MAX_RATIO && ratio[i] * avg <= RANK_MAX_EDITS + 0.01f) {
+            candidate[num++] = i;
+        }
+    }
+
+    // Stage 2: gather the model terms for the survivors into flat arrays
+    float *log_context = (float *)malloc(sizeof(float) * (num > 0 ? num : 1));
+    float *cost = (float *)malloc(sizeof(float) * (num > 0 ? num : 1));
+    float *score = (float *)malloc(sizeof(float) * (num > 0 ? num : 1));
+    if (log_context == NULL || cost == NULL || score == NULL) {
+        num = 0;
+    }
+    int prev_count = prev != NULL ? vocab_count(vocab, prev) : 0;
+    for (int k = 0; k < num; k++) {
+        int i = candidate[k];
+        cost[k] = weighted_edit_cost(typed, vocab->words[i]);
+        log_context[k] = vocab->log_prior[i] + logf(RANK_BACKOFF_WEIGHT);
+        if (prev_count > 0 && model != NULL && model->tables[2] != NULL) {
+            char key[MAX_NGRAM_LEN];
+            snprintf(key, sizeof(key), "%s %s", prev, vocab->words[i]);
+            int bigram = searchExactNGram(model->tables[2], key);
+            if (bigram > 0) {
+                log_context[k] = logf((float)bigram / (float)prev_count);
+            }
+        } else if (prev_count == 0) {
+            log_context[k] = vocab->log_prior[i];                                       // No context: plain prior
+        }
+    }
+
+    // Stage 3: log P(word | prev) + log P(typed | word), a straight line loop the compiler vectorizes
+    for (int k = 0; k < num; k++) {
+        score[k] = log_context[k] - RANK_CHANNEL_WEIGHT * cost[k];
+    }
+    for (int k = 0; k < num; k++) {
+        insert_pq(result, vocab->words[candidate[k]], exp((double)score[k]), cost[k]);
+    }
+
+    free(ratio);
+    free(candidate);
+    free(log_context);
+    free(cost);
+    free(score);
+    return result->size;
+}
@@ -0,0 +1,413 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "score.h"
+
+#define STATS_STRIDE (MAX_NGRAM_ORDER + 1)
+
+// One word of a slice: NUL terminated in place in the chunk buffer
+typedef struct {
+    const char *text;
+    int length;
+    int position;                   // Index of the word in its sentence.
+    int count;                      // Unigram count (0: OOV).
+} score_word;
+
+// One n-gram lookup: the key "w1 ... wn" and where its answer goes
+typedef struct {
+    unsigned long long head;        // First 8 key bytes, big endian: most comparisons end here.
+    const char *key;
+    size_t key_offset;              // Position of the key in the arena while it still grows.
+    int order;
+    int context_len;                // Bytes of the context, its trailing space included.
+    int slot;                       // Index into the slice's stats.
+} score_query;
+
+// What one order knows about one word: S(h), T(h) and c(h w)
+typedef struct {
+    long long total;
+    int types;
+    int count;
+} context_stats;
+
+// Per chunk state shared with the scoring tasks
+typedef struct {
+    const ngram_model *model;
+    double denominator;             // N + V + 1
+    char *buffer;
+    const size_t *lines;            // Start of every line, then the end of the last one.
+    const size_t *line_ends;        // End of every line (its newline excluded).
+    int num_lines;
+    sentence_score *scores;
+    int failed;
+} score_batch;
+
+// Count of a word in the unigram trie (0 if absent or not made of a-z)
+static int unigram_count(const trie *T, const char *word) {
+    const trie_node *p = T->root;
+    for (int i = 0; word[i] != '\0' && p != NULL; i++) {
+        int index = word[i] - 'a';
+        p = index >= 0 && index < 26 ? p->children[index] : NULL;
+    }
+    return p != NULL && p->isEndOfWord ? p->count : 0;
+}
+
+static long long count_words(const trie_node *p) {
+    if (p == NULL) return 0;
+    long long words = p->isEndOfWord ? 1 : 0;
+    for (int i = 0; i < 26; i++) words += count_words(p->children[i]);
+    return words;
+}
+
+static int compare_queries(const void *a, const void *b) {
+    const score_query *x = (const score_query *)a, *y = (const score_query *)b;
+    if (x->order != y->order) return x->order - y->order;
+    if (x->head != y->head) return x->head < y->head ? -1 : 1;
+    return strcmp(x->key, y->key);
+}
+
+// Append "w[first] ... w[last]" to the arena; returns its offset, or (size_t)-1 if it cannot be a key
+static size_t append_key(char **arena, size_t *used, size_t *cap, const score_word *words, int first, int last) {
+    size_t len = 0;
+    for (int i = first; i <= last; i++) len += strlen(words[i].text) + 1;
+    if (len > MAX_KEY_LEN) {
+        return (size_t)-1;                                                              // No stored n-gram is that long
+    }
+    if (*used + len > *cap) {
+        size_t grown_cap = *cap * 2 > *used + len ? *cap * 2 : *used + len;
+        char *grown = (char *)realloc(*arena, grown_cap);
+        if (grown == NULL) {
+            return (size_t)-2;
+        }
+        *arena = grown;
+        *cap = grown_cap;
+    }
+    size_t offset = *used;
+    char *p = *arena + offset;
+    for (int i = first; i <= last; i++) {
+        size_t word_len = strlen(words[i].text);
+        memcpy(p, words[i].text, word_len);
+        p += word_len;
+        *p++ = i < last ? ' ' : '\0';
+    }
+    *used += len;
+    return offset;
+}
+
+// Answer one order's sorted lookups. Lookups sharing a context are one group: its range is scanned once
+// for S and T while the group's words are merged against it. Ranges come in key order, so the cursor
+// walks forward from the end of the previous range and only seeks again after a long gap
+static void resolve_order(const BPlusTree *table, const score_query *queries, int num_queries, context_stats *stats) {
+    BTreeCursor cursor;
+    int state = -1;                                                                     // -1 unset, 1 on a key, 0 past the last key
+    int q = 0;
+    while (q < num_queries) {
+        const char *context = queries[q].key;
+        size_t context_len = (size_t)queries[q].context_len;
+        int group_end = q + 1;
+        while (group_end < num_queries && (size_t)queries[group_end].context_len == context_len
+               && memcmp(queries[group_end].key, context, context_len) == 0) {
+            group_end++;
+        }
+
+        // Move to the first key >= context
+        if (state == 1) {
+            int steps = 0;
+            while (state == 1 && strncmp(cursor.key, context, context_len) < 0) {
+                if (++steps > SCORE_SKIP_LIMIT) {
+                    state = -1;
+                } else if (!bPlusTreeNext(&cursor)) {
+                    state = 0;
+                }
+            }
+        }
+        if (state == -1) {
+            char key[MAX_KEY_LEN];
+            memcpy(key, context, context_len);
+            key[context_len] = '\0';
+            state = bPlusTreeSeek(table, key, &cursor);
+        }
+
+        // Scan the range, picking up the counts of the group's words on the way
+        long long total = 0;
+        int types = 0;
+        int next = q;
+        while (state == 1 && strncmp(cursor.key, context, context_len) == 0) {
+            total += cursor.count;
+            types++;
+            while (next < group_end && strcmp(queries[next].key, cursor.key) < 0) next++;
+            while (next < group_end && strcmp(queries[next].key, cursor.key) == 0) {
+                stats[queries[next++].slot].count = cursor.count;
+            }
+            state = bPlusTreeNext(&cursor);
+        }
+        for (int i = q; i < group_end; i++) {
+            stats[queries[i].slot].total = total;
+            stats[queries[i].slot].types = types;
+        }
+        q = group_end;
+    }
+}
+
+// Score one slice of lines: tokenize, gather and sort every lookup, resolve them, then combine
+static void score_slice(void *ctx, int index) {
+    score_batch *batch = (score_batch *)ctx;
+    const ngram_model *model = batch->model;
+    int first_line = index * SCORE_SLICE_SENTENCES;
+    int last_line = first_line + SCORE_SLICE_SENTENCES;
+    if (last_line > batch->num_lines) last_line = batch->num_lines;
+
+    size_t bytes = batch->lines[last_line] - batch->lines[first_line];
+    int max_spans = (int)(bytes / 2) + (last_line - first_line) + 1;                   // A token takes at least one byte plus a delimiter
+    token_span *spans = (token_span *)malloc(sizeof(token_span) * max_spans);
+    score_word *words = (score_word *)malloc(sizeof(score_word) * max_spans);
+    int *line_words = (int *)malloc(sizeof(int) * (last_line - first_line + 1));       // First word of every line
+    size_t arena_used = 0, arena_cap = bytes * 2 + 64;
+    char *arena = (char *)malloc(arena_cap);
+    score_query *queries = NULL;
+    context_stats *stats = NULL;
+    if (spans == NULL || words == NULL || line_words == NULL || arena == NULL) {
+        goto fail;
+    }
+
+    // Words of every line, NUL terminated in place once the whole line is tokenized
+    int num_words = 0;
+    for (int line = first_line; line < last_line; line++) {
+        char *text = batch->buffer + batch->lines[line];
+        size_t len = batch->line_ends[line] - batch->lines[line];
+        int n = tokenize_spans(text, len, spans, max_spans);
+        line_words[line - first_line] = num_words;
+        int position = 0;
+        for (int i = 0; i < n; i++) {
+            if (spans[i].kind != TOKEN_WORD) continue;
+            words[num_words].text = text + spans[i].offset;
+            words[num_words].length = spans[i].length;
+            words[num_words].position = position++;
+            num_words++;
+        }
+        for (int i = line_words[line - first_line]; i < num_words; i++) {
+            ((char *)words[i].text)[words[i].length] = '\0';                            // Over the delimiter, newline or skipped byte after it
+        }
+    }
+    line_words[last_line - first_line] = num_words;
+    for (int i = 0; i < num_words; i++) {
+        words[i].count = unigram_count(&model->unigrams, words[i].text);
+    }
+
+    // One lookup per word and order with a possible context
+    int max_queries = num_words * (model->order > 1 ? model->order - 1 : 0);
+    queries = (score_query *)malloc(sizeof(score_query) * (max_queries > 0 ? max_queries : 1));
+    stats = (context_stats *)calloc((size_t)num_words * STATS_STRIDE + 1, sizeof(context_stats));
+    if (queries == NULL || stats == NULL) {
+        goto fail;
+    }
+    int num_queries = 0;
+    for (int i = 0; i < num_words; i++) {
+        for (int n = 2; n <= model->order && n - 1 <= words[i].position; n++) {
+            if (model->tables[n] == NULL) continue;
+            const char *context[MAX_NGRAM_ORDER];
+            for (int k = 0; k < n - 1; k++) context[k] = words[i - (n - 1) + k].text;
+            if (!ngram_context_may_exist(model, n, context)) continue;                  // S(h) = 0: the order passes through
+            size_t offset = append_key(&arena, &arena_used, &arena_cap, words, i - (n - 1), i);
+            if (offset == (size_t)-2) goto fail;
+            if (offset == (size_t)-1) continue;
+            score_query *query = &queries[num_queries++];
+            query->key_offset = offset;
+            query->order = n;
+            query->context_len = (int)(strlen(arena + offset) - strlen(words[i].text));
+            query->slot = i * STATS_STRIDE + n;
+        }
+    }
+    for (int i = 0; i < num_queries; i++) {
+        queries[i].key = arena + queries[i].key_offset;                                 // The arena no longer moves
+        unsigned long long head = 0;
+        int k = 0;
+        for (; k < 8 && queries[i].key[k] != '\0'; k++) head = head << 8 | (unsigned char)queries[i].key[k];
+        queries[i].head = head << (8 * (8 - k));
+    }
+    qsort(queries, (size_t)num_queries, sizeof(score_query), compare_queries);
+    for (int q = 0; q < num_queries;) {
+        int end = q;
+        while (end < num_queries && queries[end].order == queries[q].order) end++;
+        resolve_order(model->tables[queries[q].order], queries + q, end - q, stats);
+        q = end;
+    }
+
+    // Interpolate from the unigram up in every word's own order
+    for (int line = first_line; line < last_line; line++) {
+        sentence_score *score = &batch->scores[line];
+        score->logprob = 0.0;
+        score->words = line_words[line - first_line + 1] - line_words[line - first_line];
+        score->oovs = 0;
+        double product = 1.0;                                                           // One log10 per run of words, not per word
+        for (int i = line_words[line - first_line]; i < line_words[line - first_line + 1]; i++) {
+            double prob = (words[i].count + 1) / batch->denominator;
+            if (words[i].count == 0) score->oovs++;
+            for (int n = 2; n <= model->order && n - 1 <= words[i].position; n++) {
+                const context_stats *st = &stats[i * STATS_STRIDE + n];
+                if (st->total > 0) {
+                    double discounted = st->count > SCORE_DISCOUNT ? st->count - SCORE_DISCOUNT : 0.0;
+                    prob = (discounted + SCORE_DISCOUNT * st->types * prob) / (double)st->total;
+                }
+            }
+            product *= prob;
+            if (product < 1e-250) {
+                score->logprob += log10(product);
+                product = 1.0;
+            }
+        }
+        score->logprob += log10(product);
+    }
+    goto done;
+
+fail:
+    batch->failed = 1;
+done:
+    free(spans);
+    free(words);
+    free(line_words);
+    free(arena);
+    free(queries);
+    free(stats);
+}
+
+// printf("%.*f") for the common magnitudes, which glibc formats far slower than the scores are computed
+static char *append_fixed(char *p, double value, int decimals) {
+    static const double scale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    if (!(value > -1e12 && value < 1e12)) {
+        return p + sprintf(p, "%.*f", decimals, value);                                 // Huge, infinite or NaN
+    }
+    if (value < 0) {
+        *p++ = '-';                                                                     // Like printf, also when it rounds to zero
+        value = -value;
+    }
+    unsigned long long fixed = (unsigned long long)(value * scale[decimals] + 0.5);
+    unsigned long long whole = fixed / (unsigned long long)scale[decimals];
+    unsigned long long fraction = fixed % (unsigned long long)scale[decimals];
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    while (n > 0) *p++ = digits[--n];
+    *p++ = '.';
+    for (int i = decimals - 1; i >= 0; i--) {
+        p[i] = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    return p + decimals;
+}
+
+// Score the whole input one chunk of complete lines at a time
+int score_stream(FILE *in, FILE *out, const ngram_model *model, threadpool *pool, score_totals *totals) {
+    memset(totals, 0, sizeof(*totals));
+    size_t cap = SCORE_CHUNK_SIZE;
+    char *buffer = (char *)malloc(cap + 1);                                             // +1: the last word may be terminated in place
+    size_t line_cap = 1024;
+    size_t *lines = (size_t *)malloc(sizeof(size_t) * (line_cap + 1));
+    size_t *line_ends = (size_t *)malloc(sizeof(size_t) * line_cap);
+    sentence_score *scores = (sentence_score *)malloc(sizeof(sentence_score) * line_cap);
+    int status = 0;
+    if (buffer == NULL || lines == NULL || line_ends == NULL || scores == NULL) {
+        status = -1;
+        goto done;
+    }
+    double denominator = (double)model->unigrams.total_unigram_count + (double)count_words(model->unigrams.root) + 1.0;
+
+    size_t filled = 0;
+    int eof = 0;
+    while (!eof || filled > 0) {
+        // Top the buffer up; bytes carried over from the previous chunk stay at the front
+        if (!eof) {
+            size_t got = fread(buffer + filled, 1, cap - filled, in);
+            filled += got;
+            if (filled < cap) {
+                if (ferror(in)) {
+                    status = -1;
+                    break;
+                }
+                eof = 1;
+            }
+        }
+
+        // Cut after the last newline; a sentence longer than the buffer grows it instead of being split
+        size_t cut = filled;
+        if (!eof) {
+            while (cut > 0 && buffer[cut - 1] != '\n') cut--;
+            if (cut == 0) {
+                char *grown = (char *)realloc(buffer, cap * 2 + 1);
+                if (grown == NULL) {
+                    status = -1;
+                    break;
+                }
+                buffer = grown;
+                cap *= 2;
+                continue;
+            }
+        }
+
+        // Line boundaries of the chunk
+        int num_lines = 0;
+        for (size_t start = 0; start < cut;) {
+            const char *newline = (const char *)memchr(buffer + start, '\n', cut - start);
+            size_t end = newline != NULL ? (size_t)(newline - buffer) : cut;
+            if ((size_t)num_lines == line_cap) {
+                line_cap *= 2;
+                size_t *grown_lines = (size_t *)realloc(lines, sizeof(size_t) * (line_cap + 1));
+                if (grown_lines != NULL) lines = grown_lines;
+                size_t *grown_ends = (size_t *)realloc(line_ends, sizeof(size_t) * line_cap);
+                if (grown_ends != NULL) line_ends = grown_ends;
+                sentence_score *grown_scores = (sentence_score *)realloc(scores, sizeof(sentence_score) * line_cap);
+                if (grown_scores != NULL) scores = grown_scores;
+                if (grown_lines == NULL || grown_ends == NULL || grown_scores == NULL) {
+                    status = -1;
+                    goto done;
+                }
+            }
+            lines[num_lines] = start;
+            line_ends[num_lines++] = end;
+            start = end + 1;
+        }
+        lines[num_lines] = cut;
+
+        score_batch batch = { model, denominator, buffer, lines, line_ends, num_lines, scores, 0 };
+        threadpool_run(pool, score_slice, &batch, (num_lines + SCORE_SLICE_SENTENCES - 1) / SCORE_SLICE_SENTENCES);
+        if (batch.failed) {
+            status = -1;
+            break;
+        }
+        for (int i = 0; i < num_lines; i++) {
+            const sentence_score *score = &scores[i];
+            double perplexity = score->words > 0 ? pow(10.0, -score->logprob / score->words) : 0.0;
+            char line[128];
+            char *p = append_fixed(line, score->logprob, 6);
+            *p++ = '\t';
+            p = append_fixed(p, perplexity, 4);
+            p += sprintf(p, "\t%d\t%d\n", score->words, score->oovs);
+            fwrite(line, 1, (size_t)(p - line), out);
+            totals->sentences++;
+            totals->words += score->words;
+            totals->oovs += score->oovs;
+            totals->logprob += score->logprob;
+        }
+
+        memmove(buffer, buffer + cut, filled - cut);
+        filled -= cut;
+    }
+    fflush(out);
+    if (ferror(out)) status = -1;
+
+done:
+    free(buffer);
+    free(lines);
+    free(line_ends);
+    free(scores);
+    return status;
+}
+
+void display_score_totals(FILE *out, const score_totals *totals) {
+    double perplexity = totals->words > 0 ? pow(10.0, -totals->logprob / (double)totals->words) : 0.0;
+    fprintf(out, "# sentences %lld words %lld oovs %lld logprob %.4f perplexity %.4f\n",
+            totals->sentences, totals->words, totals->oovs, totals->logprob, perplexity);
+}
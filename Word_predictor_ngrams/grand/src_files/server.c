@@ -0,0 +1,582 @@
+#define _GNU_SOURCE             // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "server.h"
+#include "log.h"
+
+// Store a formatted response on the request
+static void set_response(server_request *req, const char *prefix, const char *body) {
+    size_t prefix_len = strlen(prefix), body_len = strlen(body);
+    req->response = (char *)malloc(prefix_len + body_len + 2);
+    if (req->response == NULL) {
+        req->response_len = 0;
+        return;
+    }
+    memcpy(req->response, prefix, prefix_len);
+    memcpy(req->response + prefix_len, body, body_len);
+    req->response[prefix_len + body_len] = '\n';
+    req->response[prefix_len + body_len + 1] = '\0';
+    req->response_len = prefix_len + body_len + 1;
+}
+
+// Run one request line on the engine (worker threads)
+static void handle_request(wp_engine *engine, server_request *req) {
+    char *text = strchr(req->line, ' ');
+    size_t command_len = text != NULL ? (size_t)(text - req->line) : strlen(req->line);
+    text = text != NULL ? text + 1 : req->line + command_len;
+
+    int predict = command_len == 7 && strncmp(req->line, "PREDICT", 7) == 0;
+    if (predict || (command_len == 8 && strncmp(req->line, "COMPLETE", 8) == 0)) {
+        wp_suggestion suggestions[WP_MAX_SUGGESTIONS];
+        int found = predict ? wp_predict(engine, text, suggestions, WP_MAX_SUGGESTIONS, NULL)
+                            : wp_complete(engine, text, suggestions, WP_MAX_SUGGESTIONS, NULL);
+        if (found < 0) {
+            set_response(req, "ERR ", "predict failed");
+            return;
+        }
+        char body[WP_MAX_SUGGESTIONS * (MAX_TOKEN_LEN + 16) + 1];
+        size_t used = 0;
+        body[0] = '\0';
+        for (int i = 0; i < found; i++) {
+            used += (size_t)snprintf(body + used, sizeof(body) - used, " %s %d", suggestions[i].word, suggestions[i].count);
+        }
+        set_response(req, "OK", body);
+    } else if (command_len == 7 && strncmp(req->line, "CORRECT", 7) == 0) {
+        size_t len = strlen(text);
+        char stack[1024];
+        char *corrected = stack;
+        int needed = wp_correct(engine, text, len, stack, sizeof(stack));
+        if (needed >= (int)sizeof(stack)) {
+            corrected = (char *)malloc((size_t)needed + 1);
+            if (corrected == NULL || wp_correct(engine, text, len, corrected, (size_t)needed + 1) < 0) needed = -1;
+        }
+        if (needed < 0) {
+            set_response(req, "ERR ", "correct failed");
+        } else {
+            while (needed > 0 && corrected[needed - 1] == ' ') corrected[--needed] = '\0';   // Tokens come back space terminated
+            set_response(req, "OK ", corrected);
+        }
+        if (corrected != stack) free(corrected);
+    } else if (command_len == 5 && strncmp(req->line, "LEARN", 5) == 0) {
+        if (wp_learn(engine, text) >= 0) {
+            set_response(req, "OK", "");
+        } else {
+            set_response(req, "ERR ", "learn failed");
+        }
+    } else if (command_len == 6 && strncmp(req->line, "RELOAD", 6) == 0) {
+        if (wp_reload(engine) == 0) {
+            set_response(req, "OK", "");
+        } else {
+            set_response(req, "ERR ", "reload not started");
+        }
+    } else {
+        set_response(req, "ERR ", "unknown command");
+    }
+}
+
+// Worker loop: sleep until a request is queued, answer it, hand it back to the event loop
+static void *worker_main(void *arg) {
+    wp_server *server = (wp_server *)arg;
+    wp_pin_thread(server->engine, atomic_fetch_add(&server->next_worker, 1));           // Read the local replica, if any
+    for (;;) {
+        while (sem_wait(&server->work_ready) != 0) {
+            // EINTR
+        }
+        if (!atomic_load(&server->running)) {
+            return NULL;
+        }
+        void *item;
+        while (mpmc_pop(&server->requests, &item) != 0) {
+            sched_yield();                                                              // Posted after the push, so it is on its way
+        }
+        handle_request(server->engine, (server_request *)item);
+        while (mpmc_push(&server->responses, item) != 0) {
+            sched_yield();                                                              // Cannot stay full: it has room for every request in flight
+        }
+        if (atomic_exchange(&server->wake_pending, 1) == 0) {
+            uint64_t one = 1;
+            if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+                // The counter cannot overflow in practice; the loop drains on its next wakeup anyway
+            }
+        }
+    }
+}
+
+// Queue a connection for the end-of-round pass
+static void mark_dirty(wp_server *server, wp_connection *conn) {
+    if (!conn->dirty) {
+        conn->dirty = 1;
+        conn->next_dirty = server->dirty;
+        server->dirty = conn;
+    }
+}
+
+// Stop using a socket after an error or once the connection is finished
+static void close_socket(wp_server *server, wp_connection *conn) {
+    if (conn->fd >= 0) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
+
+// Unlink and free a connection together with the responses it still holds
+static void free_connection(wp_server *server, wp_connection *conn) {
+    close_socket(server, conn);
+    for (int i = 0; i < SERVER_PIPELINE_DEPTH; i++) {
+        if (conn->ready[i] != NULL) {
+            free(conn->ready[i]->response);
+            free(conn->ready[i]);
+        }
+    }
+    if (conn->prev != NULL) conn->prev->next = conn->next;
+    else server->connections = conn->next;
+    if (conn->next != NULL) conn->next->prev = conn->prev;
+    free(conn);
+}
+
+// Free the responses a dead connection will never write, so only requests still held by workers
+// keep it alive
+static void drop_responses(wp_connection *conn) {
+    for (int i = 0; i < SERVER_PIPELINE_DEPTH; i++) {
+        if (conn->ready[i] != NULL) {
+            free(conn->ready[i]->response);
+            free(conn->ready[i]);
+            conn->ready[i] = NULL;
+            conn->inflight--;
+        }
+    }
+}
+
+// A request came back (or was answered on the spot): park it in its connection's reorder window
+static void complete_request(wp_server *server, server_request *req) {
+    wp_connection *conn = req->conn;
+    if (conn->dead || req->response == NULL) {
+        free(req->response);
+        free(req);
+        conn->inflight--;
+        if (!conn->dead) conn->dead = 1;                                                // Out of memory: give up on the connection
+        mark_dirty(server, conn);
+        return;
+    }
+    conn->ready[req->seq % SERVER_PIPELINE_DEPTH] = req;
+    mark_dirty(server, conn);
+}
+
+// Hand one request line to the workers
+static void submit_request(wp_server *server, wp_connection *conn, const char *line, size_t len) {
+    server_request *req = (server_request *)malloc(sizeof(server_request) + len + 1);
+    if (req == NULL) {
+        conn->dead = 1;
+        return;
+    }
+    req->conn = conn;
+    req->seq = conn->next_seq++;
+    req->response = NULL;
+    req->response_len = 0;
+    memcpy(req->line, line, len);
+    req->line[len] = '\0';
+    conn->inflight++;
+
+    if (server->inflight >= SERVER_QUEUE_CAPACITY || mpmc_push(&server->requests, req) != 0) {
+        set_response(req, "ERR ", "busy");                                              // Shed load instead of queueing without bound
+        complete_request(server, req);
+        return;
+    }
+    server->inflight++;
+    sem_post(&server->work_ready);
+}
+
+// Submit every complete line in the input buffer, up to the pipeline depth
+static void split_requests(wp_server *server, wp_connection *conn) {
+    size_t start = 0;
+    while (!conn->dead && conn->inflight < SERVER_PIPELINE_DEPTH) {
+        char *newline = (char *)memchr(conn->in + start, '\n', conn->in_used - start);
+        if (newline == NULL) break;
+        size_t len = (size_t)(newline - (conn->in + start));
+        if (len > 0 && conn->in[start + len - 1] == '\r') len--;
+        if (len > 0) submit_request(server, conn, conn->in + start, len);              // Blank lines are ignored
+        start = (size_t)(newline - conn->in) + 1;
+    }
+    memmove(conn->in, conn->in + start, conn->in_used - start);
+    conn->in_used -= start;
+}
+
+// Read what the socket has (the event is level triggered, so one read per wakeup is enough)
+static void read_requests(wp_server *server, wp_connection *conn) {
+    size_t room = sizeof(conn->in) - conn->in_used;
+    if (room == 0) {
+        LOG_WARN("Request line longer than %d bytes, closing the connection", SERVER_MAX_LINE);
+        conn->dead = 1;
+        return;
+    }
+    ssize_t got = recv(conn->fd, conn->in + conn->in_used, room, 0);
+    if (got > 0) {
+        conn->in_used += (size_t)got;
+        split_requests(server, conn);
+        if (conn->in_used == sizeof(conn->in) && memchr(conn->in, '\n', conn->in_used) == NULL) {
+            LOG_WARN("Request line longer than %d bytes, closing the connection", SERVER_MAX_LINE);
+            conn->dead = 1;
+        }
+    } else if (got == 0) {
+        conn->eof = 1;
+    } else if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+        conn->dead = 1;
+    }
+}
+
+// Write every response that is next in request order with as few sendmsg calls as possible
+static void write_responses(wp_connection *conn) {
+    while (!conn->dead) {
+        struct iovec iov[SERVER_IOV_BATCH];
+        int count = 0;
+        size_t total = 0;
+        for (unsigned int seq = conn->send_seq; count < SERVER_IOV_BATCH; seq++) {
+            server_request *req = conn->ready[seq % SERVER_PIPELINE_DEPTH];
+            if (req == NULL) break;
+            size_t skip = count == 0 ? conn->sent : 0;
+            iov[count].iov_base = req->response + skip;
+            iov[count].iov_len = req->response_len - skip;
+            total += iov[count].iov_len;
+            count++;
+        }
+        if (count == 0) {
+            conn->blocked = 0;
+            return;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)count;
+        ssize_t sent = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                conn->blocked = 1;
+            } else {
+                conn->dead = 1;
+            }
+            return;
+        }
+
+        // Retire the responses that went out completely
+        size_t left = (size_t)sent;
+        while (left > 0) {
+            unsigned int slot = conn->send_seq % SERVER_PIPELINE_DEPTH;
+            server_request *req = conn->ready[slot];
+            size_t remaining = req->response_len - conn->sent;
+            if (left < remaining) {
+                conn->sent += left;
+                break;
+            }
+            left -= remaining;
+            free(req->response);
+            free(req);
+            conn->ready[slot] = NULL;
+            conn->send_seq++;
+            conn->sent = 0;
+            conn->inflight--;
+        }
+        if ((size_t)sent < total) {
+            conn->blocked = 1;                                                          // Socket buffer full
+            return;
+        }
+    }
+}
+
+// Register the events the connection needs now: input unless paused or finished, output while blocked
+static void update_events(wp_server *server, wp_connection *conn) {
+    int wanted = 0;
+    if (!conn->eof && conn->inflight < SERVER_PIPELINE_DEPTH) wanted |= EPOLLIN;
+    if (conn->blocked) wanted |= EPOLLOUT;
+    if (wanted != conn->events) {
+        struct epoll_event event;
+        event.events = (uint32_t)wanted;
+        event.data.ptr = conn;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = wanted;
+    }
+}
+
+// End-of-round pass over one connection: write, resume paused input, then close it if it is done
+static void service_connection(wp_server *server, wp_connection *conn) {
+    if (!conn->dead) {
+        write_responses(conn);
+        split_requests(server, conn);                                                   // Lines held back by the pipeline depth
+        write_responses(conn);                                                          // Requests refused on the spot
+    }
+    if (conn->dead) {
+        close_socket(server, conn);
+        drop_responses(conn);
+        if (conn->inflight == 0) free_connection(server, conn);                         // Otherwise when the last worker hands it back
+        return;
+    }
+    if (conn->eof && conn->inflight == 0 && memchr(conn->in, '\n', conn->in_used) == NULL) {
+        free_connection(server, conn);
+        return;
+    }
+    update_events(server, conn);
+}
+
+// Accept every pending connection
+static void accept_connections(wp_server *server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) LOG_WARN("accept: %s", strerror(errno));
+            return;
+        }
+        if (!server->unix_socket) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));                 // Responses are small and latency bound
+        }
+        wp_connection *conn = (wp_connection *)calloc(1, sizeof(wp_connection));
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (conn == NULL || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+        conn->next = server->connections;
+        if (server->connections != NULL) server->connections->prev = conn;
+        server->connections = conn;
+    }
+}
+
+// Take every finished request off the response queue
+static void collect_responses(wp_server *server) {
+    uint64_t wakeups;
+    if (read(server->wake_fd, &wakeups, sizeof(wakeups)) < 0) {
+        // Nothing to read: a previous round already drained the counter
+    }
+    atomic_store(&server->wake_pending, 0);                                             // Before draining, so no push is missed
+    void *item;
+    while (mpmc_pop(&server->responses, &item) == 0) {
+        server->inflight--;
+        complete_request(server, (server_request *)item);
+    }
+}
+
+int wp_server_run(wp_server *server) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (atomic_load(&server->running)) {
+        int n = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            return -1;
+        }
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &server->listen_fd) {
+                accept_connections(server);
+            } else if (tag == &server->wake_fd) {
+                collect_responses(server);
+            } else {
+                wp_connection *conn = (wp_connection *)tag;
+                if (events[i].events & EPOLLIN) {
+                    read_requests(server, conn);
+                } else if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    conn->dead = 1;
+                }
+                mark_dirty(server, conn);
+            }
+        }
+
+        // Every connection touched this round gets one batched write
+        while (server->dirty != NULL) {
+            wp_connection *conn = server->dirty;
+            server->dirty = conn->next_dirty;
+            conn->dirty = 0;
+            service_connection(server, conn);
+        }
+
+        // A reload only starts the loader thread, so the loop is not held up
+        if (atomic_exchange(&server->reload_requested, 0)) {
+            if (wp_reload(server->engine) == 0) {
+                LOG_INFO("Reloading the model");
+            } else {
+                LOG_WARN("Model reload not started (one is running or the engine cannot reload)");
+            }
+        }
+    }
+    return 0;
+}
+
+void wp_server_stop(wp_server *server) {
+    atomic_store(&server->running, 0);
+    uint64_t one = 1;
+    if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+        // The loop also checks the flag after its current round
+    }
+}
+
+void wp_server_reload(wp_server *server) {
+    atomic_store(&server->reload_requested, 1);
+    uint64_t one = 1;
+    if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+        // The loop also checks the flag after its current round
+    }
+}
+
+// Create the listening socket: a Unix socket for paths, TCP otherwise
+static int open_listener(wp_server *server, const char *address) {
+    int fd;
+    if (strncmp(address, "unix:", 5) == 0 || strchr(address, '/') != NULL) {
+        const char *path = strncmp(address, "unix:", 5) == 0 ? address + 5 : address;
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            LOG_ERROR("Socket path too long: %s", path);
+            return -1;
+        }
+        strcpy(addr.sun_path, path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+        server->unix_socket = 1;
+        strcpy(server->path, path);
+    } else {
+        char host[64] = "127.0.0.1";
+        const char *colon = strrchr(address, ':');
+        const char *port = colon != NULL ? colon + 1 : address;
+        if (colon != NULL && (size_t)(colon - address) < sizeof(host)) {
+            memcpy(host, address, (size_t)(colon - address));
+            host[colon - address] = '\0';
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)atoi(port));
+        if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+            LOG_ERROR("Invalid address: %s", address);
+            return -1;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int wp_server_init(wp_server *server, wp_engine *engine, const char *address, int num_workers) {
+    memset(server, 0, sizeof(*server));
+    server->engine = engine;
+    server->listen_fd = server->epoll_fd = server->wake_fd = -1;
+    atomic_init(&server->running, 1);
+    atomic_init(&server->reload_requested, 0);
+    atomic_init(&server->wake_pending, 0);
+    atomic_init(&server->next_worker, 0);
+    if (num_workers < 1) num_workers = 1;
+    if (num_workers > SERVER_MAX_WORKERS) {
+        LOG_WARN("Capping %d workers at %d (one engine reader slot each)", num_workers, SERVER_MAX_WORKERS);
+        num_workers = SERVER_MAX_WORKERS;
+    }
+    if (mpmc_init(&server->requests, SERVER_QUEUE_CAPACITY) != 0) {
+        return -1;
+    }
+    if (mpmc_init(&server->responses, SERVER_QUEUE_CAPACITY) != 0) {
+        mpmc_destroy(&server->requests);
+        return -1;
+    }
+    sem_init(&server->work_ready, 0, 0);
+
+    server->listen_fd = open_listener(server, address);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = &server->listen_fd };
+    struct epoll_event wake_event = { .events = EPOLLIN, .data.ptr = &server->wake_fd };
+    if (server->listen_fd < 0 || server->epoll_fd < 0 || server->wake_fd < 0
+        || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &listen_event) != 0
+        || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->wake_fd, &wake_event) != 0) {
+        wp_server_destroy(server);
+        return -1;
+    }
+
+    server->workers = (pthread_t *)malloc(sizeof(pthread_t) * (size_t)num_workers);
+    if (server->workers == NULL) {
+        wp_server_destroy(server);
+        return -1;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        if (pthread_create(&server->workers[i], NULL, worker_main, server) != 0) {
+            wp_server_destroy(server);
+            return -1;
+        }
+        server->num_workers++;
+    }
+    LOG_INFO("Serving on %s with %d workers", address, num_workers);
+    return 0;
+}
+
+void wp_server_destroy(wp_server *server) {
+    // Workers exit on their next wakeup once running is cleared
+    atomic_store(&server->running, 0);
+    for (int i = 0; i < server->num_workers; i++) {
+        sem_post(&server->work_ready);
+    }
+    for (int i = 0; i < server->num_workers; i++) {
+        pthread_join(server->workers[i], NULL);
+    }
+    free(server->workers);
+    server->workers = NULL;
+    server->num_workers = 0;
+
+    // Requests still queued either way belong to connections that are about to be freed
+    void *item;
+    while (server->requests.cells != NULL && mpmc_pop(&server->requests, &item) == 0) free(item);
+    while (server->responses.cells != NULL && mpmc_pop(&server->responses, &item) == 0) {
+        free(((server_request *)item)->response);
+        free(item);
+    }
+    while (server->connections != NULL) {
+        free_connection(server, server->connections);
+    }
+
+    if (server->listen_fd >= 0) close(server->listen_fd);
+    if (server->epoll_fd >= 0) close(server->epoll_fd);
+    if (server->wake_fd >= 0) close(server->wake_fd);
+    if (server->unix_socket) unlink(server->path);
+    server->listen_fd = server->epoll_fd = server->wake_fd = -1;
+    if (server->requests.cells != NULL) {
+        mpmc_destroy(&server->requests);
+        mpmc_destroy(&server->responses);
+        sem_destroy(&server->work_ready);
+    }
+}
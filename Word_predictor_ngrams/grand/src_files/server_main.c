@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include "engine.h"
+#include "server.h"
+#include "log.h"
+
+static wp_server server;
+
+static void usage(const char *prog) {
+    printf("Usage: %s [--order N] [--ngrams N file.csv] [--snapshot model.snap] [--router socket]...\n"
+           "          [--listen unix:/path|host:port|port] [--workers N] [--numa off|replicate|interleave]\n"
+           "          [--learn-interval ms] [-v]\n", prog);
+}
+
+static void on_signal(int sig) {
+    if (sig == SIGHUP) {
+        wp_server_reload(&server);                                                      // Load the model files again
+    } else {
+        wp_server_stop(&server);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    wp_options opts;
+    wp_default_options(&opts);
+    opts.learn_interval_ms = 1000;                                                      // LEARN reaches predictions within a second (0: LEARN off)
+    const char *address = "7070";
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;                               // One core for the event loop
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--order") == 0 && i + 1 < argc) {
+            opts.source.order = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ngrams") == 0 && i + 2 < argc) {
+            int n = atoi(argv[++i]);
+            if (n >= 1 && n <= MAX_NGRAM_ORDER) opts.source.files[n] = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            opts.source.snapshot = argv[++i];
+        } else if (strcmp(argv[i], "--router") == 0 && i + 1 < argc && opts.num_shards < SHARD_MAX) {
+            opts.shards[opts.num_shards++] = argv[++i];
+        } else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            address = argv[++i];
+        } else if (strcmp(argv[i], "--learn-interval") == 0 && i + 1 < argc) {
+            opts.learn_interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--numa") == 0 && i + 1 < argc && wp_parse_numa_mode(argv[i + 1], &opts.numa) == 0) {
+            i++;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            log_level++;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    wp_engine *engine = wp_open(&opts);
+    if (engine == NULL) {
+        return 1;
+    }
+    if (wp_server_init(&server, engine, address, workers) != 0) {
+        wp_close(engine);
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGHUP, &action, NULL);
+
+    int status = wp_server_run(&server);
+    wp_server_destroy(&server);
+    wp_close(engine);
+    return status == 0 ? 0 : 1;
+}
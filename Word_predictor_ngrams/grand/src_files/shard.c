@@ -0,0 +1,303 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "shard.h"
+#include "log.h"
+
+// Write the whole buffer; MSG_NOSIGNAL turns a dead peer into an error instead of SIGPIPE
+static int send_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+// Fill a Unix socket address; returns -1 if the path does not fit
+static int socket_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Split a request line into its order, context words and optional word prefix (the line is modified
+// in place); *prefix is NULL when the request has none
+static int parse_request(char *line, const char *words[], const char **prefix) {
+    char *save = NULL;
+    char *field = strtok_r(line, " \r\n", &save);
+    if (field == NULL) return -1;
+    int order = atoi(field);
+    if (order < 2 || order > MAX_NGRAM_ORDER) return -1;
+    int num_words = 0;
+    *prefix = NULL;
+    while ((field = strtok_r(NULL, " \r\n", &save)) != NULL) {
+        if (*prefix != NULL) return -1;
+        if (num_words == order - 1) {
+            *prefix = field;                                                            // One word past the context
+        } else {
+            words[num_words++] = field;
+        }
+    }
+    return num_words == order - 1 ? order : -1;
+}
+
+// Answer one request line into buf; returns the response length
+static size_t answer_request(const ngram_model *model, char *line, char *buf, size_t cap) {
+    const char *words[MAX_NGRAM_ORDER];
+    const char *prefix;
+    int order = parse_request(line, words, &prefix);
+    if (order < 0) {
+        return (size_t)snprintf(buf, cap, "-1\n");
+    }
+    bt_priority_q q;
+    init_bt_pq(&q);
+    if (model->tables[order] != NULL && ngram_context_may_exist(model, order, words)) {
+        if (prefix == NULL) {
+            searchNGramsContext(model->tables[order], words, order - 1, &q);
+        } else {
+            searchNGramsCompletion(model->tables[order], words, order - 1, prefix, &q);
+        }
+    }
+    size_t used = (size_t)snprintf(buf, cap, "%d\n", q.top + 1);
+    for (int i = 0; i <= q.top; i++) {
+        used += (size_t)snprintf(buf + used, cap - used, "%d %s\n", q.count[i], q.ngram[i]);
+    }
+    free_bt_q(&q);
+    return used;
+}
+
+typedef struct {
+    const ngram_model *model;
+    int fd;
+} shard_client;
+
+// Serve one router connection until it closes
+static void *client_main(void *arg) {
+    shard_client *client = (shard_client *)arg;
+    FILE *in = fdopen(client->fd, "r");
+    if (in == NULL) {
+        close(client->fd);
+        free(client);
+        return NULL;
+    }
+    char line[SHARD_LINE_LEN];
+    char response[4 * SHARD_LINE_LEN];                                                  // Count line plus three matches
+    while (fgets(line, sizeof(line), in) != NULL) {
+        size_t len = answer_request(client->model, line, response, sizeof(response));
+        if (send_all(client->fd, response, len) != 0) break;
+    }
+    fclose(in);
+    free(client);
+    return NULL;
+}
+
+// Accept loop of a shard process
+int shard_serve(const ngram_model *model, const char *socket_path) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr, socket_path) != 0) {
+        LOG_ERROR("Socket path too long: %s", socket_path);
+        return -1;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+        perror("bind");
+        close(listener);
+        return -1;
+    }
+    LOG_INFO("Shard %d/%d serving on %s", model->shard, model->num_shards, socket_path);
+
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        shard_client *client = (shard_client *)malloc(sizeof(shard_client));
+        pthread_t thread;
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        client->model = model;
+        client->fd = fd;
+        if (pthread_create(&thread, NULL, client_main, client) != 0) {
+            close(fd);
+            free(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    close(listener);
+    unlink(socket_path);
+    return -1;
+}
+
+// Drop a broken connection; the next request reconnects
+static void disconnect(shard_conn *conn) {
+    if (conn->in != NULL) {
+        fclose(conn->in);                                                               // Closes fd too
+    } else if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    conn->in = NULL;
+    conn->fd = -1;
+}
+
+// (Re)connect to a shard; called with the connection locked
+static int connect_shard(shard_conn *conn) {
+    if (conn->fd >= 0) return 0;
+    struct sockaddr_un addr;
+    if (socket_address(&addr, conn->path) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        LOG_WARN("Shard %s unreachable: %s", conn->path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    conn->fd = fd;
+    conn->in = fdopen(fd, "r");
+    if (conn->in == NULL) {
+        disconnect(conn);
+        return -1;
+    }
+    return 0;
+}
+
+int shard_router_open(shard_router *router, const char *const paths[], int num_shards) {
+    if (num_shards < 1 || num_shards > SHARD_MAX) {
+        return -1;
+    }
+    router->num_shards = num_shards;
+    for (int i = 0; i < num_shards; i++) {
+        shard_conn *conn = &router->shards[i];
+        strncpy(conn->path, paths[i], SHARD_PATH_LEN - 1);
+        conn->path[SHARD_PATH_LEN - 1] = '\0';
+        conn->fd = -1;
+        conn->in = NULL;
+        pthread_mutex_init(&conn->lock, NULL);
+    }
+    for (int i = 0; i < num_shards; i++) {
+        if (connect_shard(&router->shards[i]) != 0) {
+            shard_router_close(router);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Read one response into q; returns -1 on I/O or protocol errors
+static int read_response(shard_conn *conn, bt_priority_q *q) {
+    char line[SHARD_LINE_LEN];
+    if (fgets(line, sizeof(line), conn->in) == NULL) return -1;
+    int k = atoi(line);
+    if (k < 0 || k > 3) return -1;
+    for (int i = 0; i < k; i++) {
+        char *space;
+        if (fgets(line, sizeof(line), conn->in) == NULL || (space = strchr(line, ' ')) == NULL) return -1;
+        line[strcspn(line, "\r\n")] = '\0';
+        insert_bt_pq(q, space + 1, atoi(line));
+    }
+    return 0;
+}
+
+// Fan the orders out to the shards owning their contexts; a non-NULL word_prefix restricts the next word
+static int route_search(shard_router *router, int order, const char *context[], int context_len, const char *word_prefix,
+                        bt_priority_q *result) {
+    int top = context_len + 1;
+    if (top > order) top = order;
+    if (top > MAX_NGRAM_ORDER) top = MAX_NGRAM_ORDER;
+    if (top < 2) return 0;
+
+    // One request per order, routed by the context it searches
+    char requests[MAX_NGRAM_ORDER + 1][SHARD_LINE_LEN];
+    size_t lengths[MAX_NGRAM_ORDER + 1];
+    int owner[MAX_NGRAM_ORDER + 1];
+    unsigned char involved[SHARD_MAX] = {0};
+    for (int n = top; n >= 2; n--) {
+        const char **words = context + context_len - (n - 1);
+        char key[SHARD_LINE_LEN];
+        size_t len = 0;
+        key[0] = '\0';
+        for (int i = 0; i < n - 1; i++) {
+            int w = snprintf(key + len, sizeof(key) - len, "%s%s", i > 0 ? " " : "", words[i]);
+            if (w < 0 || (size_t)w >= sizeof(key) - len) return -1;
+            len += (size_t)w;
+        }
+        owner[n] = ngram_context_shard(key, router->num_shards);
+        involved[owner[n]] = 1;
+        int w = word_prefix == NULL ? snprintf(requests[n], sizeof(requests[n]), "%d %s\n", n, key)
+                                    : snprintf(requests[n], sizeof(requests[n]), "%d %s %s\n", n, key, word_prefix);
+        if (w < 0 || (size_t)w >= sizeof(requests[n])) return -1;
+        lengths[n] = (size_t)w;
+    }
+
+    // Lock the shards in index order (no deadlock between concurrent callers), send every request,
+    // then collect the answers: the orders are searched in parallel across shards
+    int status = 0;
+    for (int s = 0; s < router->num_shards; s++) {
+        if (involved[s]) pthread_mutex_lock(&router->shards[s].lock);
+    }
+    for (int n = top; n >= 2 && status == 0; n--) {
+        shard_conn *conn = &router->shards[owner[n]];
+        if (connect_shard(conn) != 0 || send_all(conn->fd, requests[n], lengths[n]) != 0) status = -1;
+    }
+    bt_priority_q answers[MAX_NGRAM_ORDER + 1];
+    for (int n = top; n >= 2; n--) {
+        init_bt_pq(&answers[n]);
+        if (status == 0 && read_response(&router->shards[owner[n]], &answers[n]) != 0) status = -1;
+    }
+    for (int s = 0; s < router->num_shards; s++) {
+        if (!involved[s]) continue;
+        if (status != 0) disconnect(&router->shards[s]);                               // Responses may be out of step
+        pthread_mutex_unlock(&router->shards[s].lock);
+    }
+
+    // Back off: the highest order with matches is merged into the result
+    int found = 0;
+    for (int n = top; n >= 2; n--) {
+        if (status == 0 && found == 0 && answers[n].top >= 0) {
+            for (int i = 0; i <= answers[n].top; i++) {
+                insert_bt_pq(result, answers[n].ngram[i], answers[n].count[i]);
+            }
+            found = n;
+        }
+        free_bt_q(&answers[n]);
+    }
+    return status == 0 ? found : -1;
+}
+
+int shard_router_predict(shard_router *router, int order, const char *context[], int context_len, bt_priority_q *result) {
+    return route_search(router, order, context, context_len, NULL, result);
+}
+
+int shard_router_complete(shard_router *router, int order, const char *context[], int context_len, const char *prefix,
+                          bt_priority_q *result) {
+    return route_search(router, order, context, context_len, prefix, result);
+}
+
+void shard_router_close(shard_router *router) {
+    for (int i = 0; i < router->num_shards; i++) {
+        disconnect(&router->shards[i]);
+        pthread_mutex_destroy(&router->shards[i].lock);
+    }
+    router->num_shards = 0;
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spell_cache.h"
+#include "ranking.h"
+#include "trace.h"
+
+// Allocate every shard
+int spell_cache_init(spell_cache *cache, int capacity) {
+    int per_shard = capacity / SPELL_CACHE_SHARDS;
+    if (per_shard < SPELL_CACHE_PROBES) per_shard = SPELL_CACHE_PROBES;
+
+    for (int i = 0; i < SPELL_CACHE_SHARDS; i++) {
+        spell_cache_shard *shard = &cache->shards[i];
+        shard->entries = (spell_cache_entry *)calloc(per_shard, sizeof(spell_cache_entry));
+        if (shard->entries == NULL) {
+            while (--i >= 0) free(cache->shards[i].entries);
+            return -1;
+        }
+        shard->capacity = per_shard;
+        shard->victim_offset = 0;
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->misses, 0);
+    atomic_init(&cache->evictions, 0);
+    return 0;
+}
+
+// Free every shard
+void spell_cache_destroy(spell_cache *cache) {
+    for (int i = 0; i < SPELL_CACHE_SHARDS; i++) {
+        pthread_mutex_destroy(&cache->shards[i].lock);
+        free(cache->shards[i].entries);
+        cache->shards[i].entries = NULL;
+    }
+}
+
+// Run the full cascade (same order as validate and correct_word); the fuzzy step uses the noisy
+// channel ranking when the trie carries a vocabulary. *ranked tells whether that ranking decided
+static int run_cascade(trie *T, const ngram_model *model, const char *prev, const char *token, word_element *best,
+                       int *ranked) {
+    priority_Q pq;
+    init_priority_Q(&pq);
+    *ranked = 0;
+    if (is_unigram(*T, token, &pq) == 0.0 && !is_prefix(*T, token, &pq)) {
+        if (T->vocab != NULL) {
+            rank_candidates(T->vocab, model, prev, token, &pq);
+            *ranked = 1;
+        } else {
+            is_fuzzymatch(*T, token, &pq);
+        }
+    }
+    if (pq.size == 0) {
+        return 0;
+    }
+    *best = pq.words_collection[0];
+    return 1;
+}
+
+// Shard and home slot of a hash
+static spell_cache_shard *locate(spell_cache *cache, unsigned long long h, int *home) {
+    spell_cache_shard *shard = &cache->shards[h % SPELL_CACHE_SHARDS];
+    *home = (int)((h / SPELL_CACHE_SHARDS) % shard->capacity);
+    return shard;
+}
+
+// Search the probe window of h for a decision on the token that holds after prev; returns 1 on a hit
+static int probe(spell_cache *cache, unsigned long long h, unsigned long long generation, const char *prev,
+                 const char *token, word_element *best, int *has_match) {
+    int home;
+    spell_cache_shard *shard = locate(cache, h, &home);
+    pthread_mutex_lock(&shard->lock);
+    for (int p = 0; p < SPELL_CACHE_PROBES; p++) {
+        spell_cache_entry *e = &shard->entries[(home + p) % shard->capacity];
+        if (e->used && e->generation == generation && strcmp(e->token, token) == 0
+            && (e->any_prev || strcmp(e->prev, prev) == 0)) {
+            e->referenced = 1;
+            *has_match = e->has_match;
+            *best = e->best;
+            pthread_mutex_unlock(&shard->lock);
+            return 1;
+        }
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+// Store a decision in the probe window of h: a free or stale slot, otherwise a victim chosen by second
+// chance within the window. The scan starts at a rotating offset and evicts the first slot not hit
+// since a scan last passed it, clearing the bits of the slots it passes
+static void store(spell_cache *cache, unsigned long long h, unsigned long long generation, const char *prev,
+                  const char *token, int any_prev, const word_element *best, int has_match) {
+    int home;
+    spell_cache_shard *shard = locate(cache, h, &home);
+    pthread_mutex_lock(&shard->lock);
+    spell_cache_entry *slot = NULL;
+    for (int p = 0; p < SPELL_CACHE_PROBES && slot == NULL; p++) {
+        spell_cache_entry *e = &shard->entries[(home + p) % shard->capacity];
+        if (!e->used || e->generation != generation || (strcmp(e->token, token) == 0 && strcmp(e->prev, prev) == 0)) {
+            slot = e;
+        }
+    }
+    if (slot == NULL) {
+        for (int p = 0; p < 2 * SPELL_CACHE_PROBES; p++) {
+            spell_cache_entry *e = &shard->entries[(home + shard->victim_offset) % shard->capacity];
+            shard->victim_offset = (shard->victim_offset + 1) % SPELL_CACHE_PROBES;
+            if (!e->referenced) {
+                slot = e;
+                break;
+            }
+            e->referenced = 0;                                                          // Second chance
+        }
+        if (slot == NULL) slot = &shard->entries[home];
+        atomic_fetch_add_explicit(&cache->evictions, 1, memory_order_relaxed);
+    }
+    strcpy(slot->token, token);
+    strcpy(slot->prev, prev);
+    slot->generation = generation;
+    slot->best = *best;
+    slot->has_match = has_match;
+    slot->any_prev = any_prev;
+    slot->used = 1;
+    slot->referenced = 0;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Look the token up, computing and inserting the decision on a miss. Decisions the previous word
+// cannot change (exact and prefix hits, unranked fuzzy matches) are keyed on the token alone, so a
+// correct word is cached once whatever precedes it; only ranked corrections are keyed on prev too
+static int lookup(spell_cache *cache, trie *T, const ngram_model *model, const char *prev, const char *token,
+                  word_element *best) {
+    if (prev == NULL) prev = "";
+    int ranked;
+    if (cache == NULL || strlen(token) >= MAX_TOKEN_LEN || strlen(prev) >= MAX_TOKEN_LEN) {
+        return run_cascade(T, model, prev[0] != '\0' ? prev : NULL, token, best, &ranked);
+    }
+    unsigned long long token_hash = hash_ngram(token);
+    unsigned long long context_hash = token_hash ^ (hash_ngram(prev) * 31);
+    unsigned long long generation = T->serial;
+    int has_match;
+    if (probe(cache, token_hash, generation, prev, token, best, &has_match)
+        || (prev[0] != '\0' && T->vocab != NULL && probe(cache, context_hash, generation, prev, token, best, &has_match))) {
+        atomic_fetch_add_explicit(&cache->hits, 1, memory_order_relaxed);
+        return has_match;
+    }
+    atomic_fetch_add_explicit(&cache->misses, 1, memory_order_relaxed);
+
+    // The cascade can be slow (fuzzy matching walks the trie), so it runs without the lock
+    has_match = run_cascade(T, model, prev[0] != '\0' ? prev : NULL, token, best, &ranked);
+    if (ranked && prev[0] != '\0') {
+        store(cache, context_hash, generation, prev, token, 0, best, has_match);
+    } else {
+        store(cache, token_hash, generation, "", token, !ranked, best, has_match);    // Ranked without context: holds after no word only
+    }
+    return has_match;
+}
+
+// Cached validate
+word_element spell_cache_validate(spell_cache *cache, trie *T, const char *token) {
+    word_element best;
+    TRACE_BEGIN(start);
+    int found = lookup(cache, T, NULL, NULL, token, &best);
+    TRACE_END(TRACE_CORRECT, start);
+    if (found) {
+        return best;
+    }
+    word_element empty = {"", 0.0, 0};
+    return empty;
+}
+
+// Cached validate with the previous word as context
+word_element spell_cache_validate_context(spell_cache *cache, ngram_model *model, const char *prev, const char *token) {
+    word_element best;
+    TRACE_BEGIN(start);
+    int found = lookup(cache, &model->unigrams, model, prev, token, &best);
+    TRACE_END(TRACE_CORRECT, start);
+    if (found) {
+        return best;
+    }
+    word_element empty = {"", 0.0, 0};
+    return empty;
+}
+
+// Cached correct_word
+void spell_cache_correct(spell_cache *cache, trie *T, const char *token, char out[MAX_TOKEN_LEN]) {
+    word_element best;
+    TRACE_BEGIN(start);
+    const char *chosen = lookup(cache, T, NULL, NULL, token, &best) ? best.word : token;
+    TRACE_END(TRACE_CORRECT, start);
+    strncpy(out, chosen, MAX_TOKEN_LEN - 1);
+    out[MAX_TOKEN_LEN - 1] = '\0';
+}
+
+// Print the cache counters
+void display_spell_cache_stats(spell_cache *cache) {
+    unsigned long long hits = atomic_load(&cache->hits);
+    unsigned long long misses = atomic_load(&cache->misses);
+    unsigned long long lookups = hits + misses;
+    printf("Spell cache: %llu hits, %llu misses (%.1f%% hit rate), %llu evictions\n",
+           hits, misses, lookups ? 100.0 * (double)hits / (double)lookups : 0.0,
+           atomic_load(&cache->evictions));
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+
+// Per chunk state shared with the correction tasks
+typedef struct {
+    trie *T;
+    spell_cache *cache;
+    const char *buffer;
+    const token_span *spans;
+    int num_spans;
+    char (*fixes)[MAX_TOKEN_LEN];   // Correction of span i, valid when changed[i] is set
+    unsigned char *changed;
+} stream_batch;
+
+// Correct one slice of the chunk's spans
+static void correct_slice(void *ctx, int index) {
+    stream_batch *batch = (stream_batch *)ctx;
+    int start = index * STREAM_SLICE_SPANS;
+    int end = start + STREAM_SLICE_SPANS;
+    if (end > batch->num_spans) end = batch->num_spans;
+
+    char token[MAX_TOKEN_LEN];
+    for (int i = start; i < end; i++) {
+        const token_span *span = &batch->spans[i];
+        batch->changed[i] = 0;
+        if (span->kind != TOKEN_WORD || span->length >= MAX_TOKEN_LEN) {
+            continue;                                                                   // Left as it is
+        }
+        span_to_string(batch->buffer, span, token, sizeof(token));
+        spell_cache_correct(batch->cache, batch->T, token, batch->fixes[i]);
+        batch->changed[i] = strcmp(batch->fixes[i], token) != 0;
+    }
+}
+
+// Write the chunk in input order: unchanged byte ranges go out directly from the buffer
+static int write_chunk(FILE *out, const char *buffer, size_t len, const stream_batch *batch) {
+    size_t pending = 0;                                                                 // Start of the bytes not written yet
+    for (int i = 0; i < batch->num_spans; i++) {
+        if (!batch->changed[i]) continue;
+        const token_span *span = &batch->spans[i];
+        size_t fix_len = strlen(batch->fixes[i]);
+        if (fwrite(buffer + pending, 1, (size_t)span->offset - pending, out) != (size_t)span->offset - pending
+            || fwrite(batch->fixes[i], 1, fix_len, out) != fix_len) {
+            return -1;
+        }
+        pending = (size_t)span->offset + (size_t)span->length;
+    }
+    return fwrite(buffer + pending, 1, len - pending, out) == len - pending ? 0 : -1;
+}
+
+// Stream the whole input through the corrector
+int stream_correct(FILE *in, FILE *out, trie *T, spell_cache *cache, threadpool *pool) {
+    int max_spans = STREAM_CHUNK_SIZE / 2 + 1;                                          // A token takes at least one byte plus a delimiter
+    char *buffer = (char *)malloc(STREAM_CHUNK_SIZE);
+    token_span *spans = (token_span *)malloc(sizeof(token_span) * max_spans);
+    char (*fixes)[MAX_TOKEN_LEN] = malloc(sizeof(*fixes) * max_spans);
+    unsigned char *changed = (unsigned char *)malloc(max_spans);
+    int status = 0;
+    if (buffer == NULL || spans == NULL || fixes == NULL || changed == NULL) {
+        status = -1;
+        goto done;
+    }
+
+    size_t filled = 0;
+    int eof = 0;
+    while (!eof || filled > 0) {
+        // Top the buffer up; bytes carried over from the previous chunk stay at the front
+        if (!eof) {
+            size_t got = fread(buffer + filled, 1, STREAM_CHUNK_SIZE - filled, in);
+            filled += got;
+            if (filled < STREAM_CHUNK_SIZE) {
+                if (ferror(in)) {
+                    status = -1;
+                    break;
+                }
+                eof = 1;
+            }
+        }
+
+        // Cut after the last whitespace so the tail token is completed by the next read
+        size_t cut = filled;
+        if (!eof) {
+            while (cut > 0 && !(char_class[(unsigned char)buffer[cut - 1]] & CC_SPACE)) cut--;
+            if (cut == 0) cut = filled;                                                 // One token fills the chunk: split it
+        }
+
+        stream_batch batch = { T, cache, buffer, spans, 0, fixes, changed };
+        batch.num_spans = tokenize_spans(buffer, cut, spans, max_spans);
+        threadpool_run(pool, correct_slice, &batch, (batch.num_spans + STREAM_SLICE_SPANS - 1) / STREAM_SLICE_SPANS);
+        if (write_chunk(out, buffer, cut, &batch) != 0) {
+            status = -1;
+            break;
+        }
+
+        memmove(buffer, buffer + cut, filled - cut);
+        filled -= cut;
+    }
+    fflush(out);
+
+done:
+    free(buffer);
+    free(spans);
+    free(fixes);
+    free(changed);
+    return status;
+}
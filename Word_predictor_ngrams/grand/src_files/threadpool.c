@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include "threadpool.h"
+
+// Claim and run tasks of the current batch until none are left (called with the lock held)
+static void run_tasks_locked(threadpool *pool) {
+    while (pool->task != NULL && pool->next_task < pool->num_tasks) {
+        int index = pool->next_task++;
+        threadpool_task task = pool->task;
+        void *ctx = pool->ctx;
+        pthread_mutex_unlock(&pool->lock);
+        task(ctx, index);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->work_done);
+        }
+    }
+}
+
+// Worker loop: sleep until a batch is posted, help finish it, repeat
+static void *worker_main(void *arg) {
+    threadpool *pool = (threadpool *)arg;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->shutdown) {
+        if (pool->task == NULL || pool->next_task >= pool->num_tasks) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+            continue;
+        }
+        run_tasks_locked(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start the workers
+int threadpool_init(threadpool *pool, int num_threads) {
+    pool->num_threads = 0;
+    pool->task = NULL;
+    pool->ctx = NULL;
+    pool->num_tasks = 0;
+    pool->next_task = 0;
+    pool->pending = 0;
+    pool->shutdown = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * (num_threads > 0 ? num_threads : 1));
+    if (pool->threads == NULL) return -1;
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            break;                                                                      // Run with the workers we got
+        }
+        pool->num_threads++;
+    }
+    return 0;
+}
+
+// Post a batch, work on it from the calling thread too, and wait for it to drain
+void threadpool_run(threadpool *pool, threadpool_task task, void *ctx, int num_tasks) {
+    if (num_tasks <= 0) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->num_tasks = num_tasks;
+    pool->next_task = 0;
+    pool->pending = num_tasks;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    run_tasks_locked(pool);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pool->task = NULL;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Stop the workers
+void threadpool_destroy(threadpool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_cond_destroy(&pool->work_done);
+}
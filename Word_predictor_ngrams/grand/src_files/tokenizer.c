@@ -0,0 +1,131 @@
+#include <string.h>
+#include "tokenizer.h"
+#include "trace.h"
+
+#define SEGMENT_SPANS 64    // Spans kept per whitespace separated segment during the reverse scan
+
+// Class of every byte; mirrors DELIMS plus isspace() from functions.h
+const unsigned char char_class[256] = {
+    [' '] = CC_DELIM | CC_SPACE, ['\t'] = CC_DELIM | CC_SPACE, ['\n'] = CC_DELIM | CC_SPACE,
+    ['\v'] = CC_DELIM | CC_SPACE, ['\f'] = CC_DELIM | CC_SPACE, ['\r'] = CC_DELIM | CC_SPACE,
+    ['.'] = CC_DELIM, [','] = CC_DELIM, ['/'] = CC_DELIM, ['?'] = CC_DELIM, [';'] = CC_DELIM,
+    [':'] = CC_DELIM, ['{'] = CC_DELIM, ['}'] = CC_DELIM, ['['] = CC_DELIM, [']'] = CC_DELIM,
+    ['~'] = CC_DELIM, ['`'] = CC_DELIM, ['!'] = CC_DELIM, ['|'] = CC_DELIM, ['$'] = CC_DELIM,
+    ['%'] = CC_DELIM, ['&'] = CC_DELIM, ['*'] = CC_DELIM, ['('] = CC_DELIM, [')'] = CC_DELIM,
+    ['_'] = CC_DELIM, ['-'] = CC_DELIM, ['+'] = CC_DELIM, ['='] = CC_DELIM, ['^'] = CC_DELIM,
+    ['\''] = CC_DELIM, ['"'] = CC_DELIM,
+    ['0' ... '9'] = CC_DIGIT | CC_ALNUM,
+    ['a' ... 'z'] = CC_ALNUM,
+    ['A' ... 'Z'] = CC_ALNUM | CC_UPPER,
+    ['#'] = CC_HASH,
+    [0xF0 ... 0xFF] = CC_EMOJI,
+};
+
+#define CLASS(ch) char_class[(unsigned char)(ch)]
+
+// Record a span; in ring mode only the last max_spans spans are kept (at count % max_spans)
+static void emit(token_span *spans, int max_spans, int ring, int count, int offset, int length, token_kind kind) {
+    int slot = ring ? count % max_spans : count;
+    if (slot < max_spans) {
+        spans[slot].offset = offset;
+        spans[slot].length = length;
+        spans[slot].kind = kind;
+    }
+}
+
+// Forward scan of input[start..end): the single pass behind both entry points
+static int scan_tokens(char *input, size_t start, size_t end, token_span *spans, int max_spans, int ring) {
+    int count = 0;
+    size_t i = start;
+
+    while (i < end) {
+        unsigned char cls = CLASS(input[i]);
+
+        if (cls & CC_DELIM) {                                                           // Skip over the delimiter
+            i++;
+            continue;
+        }
+        if (cls & CC_EMOJI) {                                                           // Skip emoji bytes
+            i += 4;
+            continue;
+        }
+        if (cls & CC_HASH) {                                                            // Handle hashtags
+            size_t j = i + 1;
+            while (j < end && (CLASS(input[j]) & CC_ALNUM)) {
+                if (CLASS(input[j]) & CC_UPPER) input[j] += 'a' - 'A';
+                j++;
+            }
+            if (j > i + 1) {
+                emit(spans, max_spans, ring, count++, (int)i, (int)(j - i), TOKEN_HASHTAG);
+            }
+            i = j;
+            continue;
+        }
+
+        // Words and numbers run until the next delimiter; numbers keep their decimal points
+        size_t token_start = i;
+        token_kind kind = (cls & CC_DIGIT) ? TOKEN_NUMBER : TOKEN_WORD;
+        while (i < end) {
+            cls = CLASS(input[i]);
+            if (cls & CC_DIGIT) {
+                while (i < end && ((CLASS(input[i]) & CC_DIGIT) || input[i] == '.')) i++;
+                continue;
+            }
+            if (cls & (CC_DELIM | CC_EMOJI | CC_HASH)) break;
+            if (cls & CC_UPPER) input[i] += 'a' - 'A';
+            i++;
+        }
+        emit(spans, max_spans, ring, count++, (int)token_start, (int)(i - token_start), kind);
+    }
+    return count;
+}
+
+// Tokenize the whole input
+int tokenize_spans(char *input, size_t len, token_span *spans, int max_spans) {
+    TRACE_BEGIN(start);
+    int count = scan_tokens(input, 0, len, spans, max_spans, 0);
+    TRACE_END(TRACE_TOKENIZE, start);
+    return count;
+}
+
+// Whitespace always ends a token, so the input can be tokenized backwards one whitespace
+// separated segment at a time and the scan stops as soon as enough words were seen
+int last_word_spans(char *input, size_t len, token_span *spans, int wanted) {
+    TRACE_BEGIN(start);
+    token_span segment[SEGMENT_SPANS];
+    int found = 0;
+    size_t seg_end = len;
+
+    while (found < wanted) {
+        while (seg_end > 0 && (CLASS(input[seg_end - 1]) & CC_SPACE)) seg_end--;
+        if (seg_end == 0) break;
+        size_t seg_start = seg_end;
+        while (seg_start > 0 && !(CLASS(input[seg_start - 1]) & CC_SPACE)) seg_start--;
+
+        int n = scan_tokens(input, seg_start, seg_end, segment, SEGMENT_SPANS, 1);
+        int oldest = n > SEGMENT_SPANS ? n - SEGMENT_SPANS : 0;
+        for (int k = n - 1; k >= oldest && found < wanted; k--) {
+            const token_span *span = &segment[k % SEGMENT_SPANS];
+            if (span->kind == TOKEN_WORD) {
+                spans[wanted - 1 - found] = *span;                                      // Fill from the back
+                found++;
+            }
+        }
+        seg_end = seg_start;
+    }
+
+    if (found < wanted) {
+        memmove(spans, spans + (wanted - found), sizeof(token_span) * found);
+    }
+    TRACE_END(TRACE_TOKENIZE, start);
+    return found;
+}
+
+// Copy a span out of the input
+void span_to_string(const char *input, const token_span *span, char *out, size_t cap) {
+    size_t len = (size_t)span->length;
+    if (cap == 0) return;
+    if (len >= cap) len = cap - 1;
+    memcpy(out, input + span->offset, len);
+    out[len] = '\0';
+}
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+static const char *stage_names[TRACE_NUM_STAGES] = { "tokenize", "correct", "backoff", "search", "display" };
+static const char *counter_names[TRACE_NUM_COUNTERS] = { "btree_nodes_visited", "btree_leaves_scanned", "trie_nodes_visited", "filter_skips" };
+
+// Every thread that recorded something; states live until exit so the dump can always read them
+static trace_thread_state *thread_states[TRACE_MAX_THREADS];
+static atomic_int num_thread_states;
+static trace_thread_state overflow_state;                                               // Shared by threads past the limit
+static _Thread_local trace_thread_state *local_state;
+
+unsigned long long trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// The calling thread's state, registered on first use
+static trace_thread_state *get_state(void) {
+    if (local_state == NULL) {
+        int slot = atomic_fetch_add(&num_thread_states, 1);
+        if (slot < TRACE_MAX_THREADS) {
+            trace_thread_state *state = (trace_thread_state *)calloc(1, sizeof(trace_thread_state));
+            thread_states[slot] = state != NULL ? state : &overflow_state;
+        }
+        local_state = slot < TRACE_MAX_THREADS ? thread_states[slot] : &overflow_state;
+    }
+    return local_state;
+}
+
+// Single writer per state, so a relaxed load + store is enough (no locked read-modify-write)
+static inline void bump(atomic_ullong *cell, unsigned long long n) {
+    atomic_store_explicit(cell, atomic_load_explicit(cell, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Values below 2^SUB_BUCKET_BITS get exact buckets; above, the top SUB_BUCKET_BITS bits after the msb pick the sub-bucket
+static int bucket_index(unsigned long long v) {
+    if (v < TRACE_SUB_BUCKETS) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int sub = (int)((v >> (msb - TRACE_SUB_BUCKET_BITS)) & (TRACE_SUB_BUCKETS - 1));
+    return (msb - TRACE_SUB_BUCKET_BITS + 1) * TRACE_SUB_BUCKETS + sub;
+}
+
+// Lowest value that falls into the bucket
+static unsigned long long bucket_value(int index) {
+    if (index < TRACE_SUB_BUCKETS) return (unsigned long long)index;
+    int msb = index / TRACE_SUB_BUCKETS + TRACE_SUB_BUCKET_BITS - 1;
+    unsigned long long sub = (unsigned long long)(index % TRACE_SUB_BUCKETS);
+    return (1ULL << msb) | (sub << (msb - TRACE_SUB_BUCKET_BITS));
+}
+
+void trace_record(trace_stage stage, unsigned long long ns) {
+    trace_histogram *h = &get_state()->stages[stage];
+    bump(&h->buckets[bucket_index(ns)], 1);
+    bump(&h->count, 1);
+    bump(&h->sum, ns);
+    if (ns > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, ns, memory_order_relaxed);
+    }
+}
+
+void trace_add(trace_counter counter, unsigned long long n) {
+    bump(&get_state()->counters[counter], n);
+}
+
+// Visit every registered state (plus the overflow state)
+static int registered_states(trace_thread_state *states[TRACE_MAX_THREADS + 1]) {
+    int n = atomic_load(&num_thread_states);
+    if (n > TRACE_MAX_THREADS) n = TRACE_MAX_THREADS;
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        if (thread_states[i] != NULL) states[found++] = thread_states[i];
+    }
+    states[found++] = &overflow_state;
+    return found;
+}
+
+void trace_reset(void) {
+    trace_thread_state *states[TRACE_MAX_THREADS + 1];
+    int n = registered_states(states);
+    for (int s = 0; s < n; s++) {
+        for (int i = 0; i < TRACE_NUM_STAGES; i++) {
+            trace_histogram *h = &states[s]->stages[i];
+            for (int b = 0; b < TRACE_BUCKETS; b++) atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+            atomic_store_explicit(&h->count, 0, memory_order_relaxed);
+            atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+            atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+        }
+        for (int i = 0; i < TRACE_NUM_COUNTERS; i++) atomic_store_explicit(&states[s]->counters[i], 0, memory_order_relaxed);
+    }
+}
+
+// Value at quantile q of a merged bucket array
+static unsigned long long quantile(const unsigned long long *buckets, unsigned long long count, double q) {
+    if (count == 0) return 0;
+    unsigned long long rank = (unsigned long long)(q * (double)(count - 1)) + 1, seen = 0;
+    for (int b = 0; b < TRACE_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank) return bucket_value(b);
+    }
+    return 0;
+}
+
+void trace_dump(FILE *out) {
+    trace_thread_state *states[TRACE_MAX_THREADS + 1];
+    int n = registered_states(states);
+    static unsigned long long merged[TRACE_BUCKETS];
+
+    fprintf(out, "{\"threads\":%d,\"stages\":{", n - 1);
+    for (int i = 0; i < TRACE_NUM_STAGES; i++) {
+        unsigned long long count = 0, sum = 0, max = 0;
+        for (int b = 0; b < TRACE_BUCKETS; b++) merged[b] = 0;
+        for (int s = 0; s < n; s++) {
+            trace_histogram *h = &states[s]->stages[i];
+            for (int b = 0; b < TRACE_BUCKETS; b++) merged[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            count += atomic_load_explicit(&h->count, memory_order_relaxed);
+            sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+            unsigned long long m = atomic_load_explicit(&h->max, memory_order_relaxed);
+            if (m > max) max = m;
+        }
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"mean_ns\":%.0f,\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+                i > 0 ? "," : "", stage_names[i], count, count ? (double)sum / (double)count : 0.0,
+                quantile(merged, count, 0.50), quantile(merged, count, 0.90),
+                quantile(merged, count, 0.99), quantile(merged, count, 0.999), max);
+    }
+    fprintf(out, "},\"counters\":{");
+    for (int i = 0; i < TRACE_NUM_COUNTERS; i++) {
+        unsigned long long total = 0;
+        for (int s = 0; s < n; s++) total += atomic_load_explicit(&states[s]->counters[i], memory_order_relaxed);
+        fprintf(out, "%s\"%s\":%llu", i > 0 ? "," : "", counter_names[i], total);
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+}